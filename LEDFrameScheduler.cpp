@@ -0,0 +1,155 @@
+/*
+LEDFrameScheduler
+Deadline-driven display cycles for LEDSegs. See LEDFrameScheduler.h.
+*/
+
+#include "LEDFrameScheduler.h"
+
+/*__________________________________
+LEDFrameScheduler::LEDFrameScheduler
+*/
+
+LEDFrameScheduler::LEDFrameScheduler(LEDSegs *Strip, short FramesPerSecond, bool doLeft, bool doRight) {
+  short iTask;
+
+  strip = Strip;
+  readLeft = doLeft;
+  readRight = doRight;
+  started = false;
+  lastWasFrame = false;
+  nextFrame = 0;
+  for (iTask = 0; iTask < cSchedMaxTasks; iTask++) {tasks[iTask].taskRoutine = NULL;}
+  idleRoutine = NULL;
+  idleEstimate = taskEstimate = 0;
+  frameEstimate = ((unsigned long) strip->GetNumLEDs()) * cSchedShowMicrosPerLED + cSchedShowLatchMicros;
+  nFramesShown = nFramesDropped = maxLateness = 0;
+  SetFrameRate(FramesPerSecond);
+}
+
+/*_______________________________
+LEDFrameScheduler::SetFramePeriod
+*/
+
+void LEDFrameScheduler::SetFramePeriod(unsigned long Micros) {
+  framePeriod = max(Micros, 1UL);
+  started = false;  //Start a new grid from the next frame
+}
+
+/*________________________
+LEDFrameScheduler::AddTask
+*/
+
+short LEDFrameScheduler::AddTask(SchedulerRoutine Routine, unsigned long PeriodMS, bool RunNow) {
+  short iTask;
+
+  for (iTask = 0; iTask < cSchedMaxTasks; iTask++) {
+    if (tasks[iTask].taskRoutine == NULL) {
+      tasks[iTask].taskRoutine = Routine;
+      tasks[iTask].taskPeriod = PeriodMS;
+      tasks[iTask].taskNext = millis() + (RunNow ? 0 : PeriodMS);
+      return iTask;
+    }
+  }
+  return -1;
+}
+
+/*________________________
+LEDFrameScheduler::Service
+The frame if it is due, otherwise a task that is due, otherwise the idle routine. Tasks and the
+idle routine only run early if their longest time so far fits before the frame. Tasks also get their
+turn straight after a frame, so they still run when every frame is late.
+*/
+
+byte LEDFrameScheduler::Service() {
+  unsigned long now, late, missed, start;
+  bool due, afterFrame;
+
+  now = micros();
+  if (!started) {
+    started = true;
+    nextFrame = now;
+  }
+  due = ((long) (now - nextFrame) >= 0);
+  afterFrame = lastWasFrame;
+  lastWasFrame = false;
+
+  if ((afterFrame || (!due && (nextFrame - now > taskEstimate))) && RunTasks()) {
+    taskEstimate = max(taskEstimate, micros() - now);
+    return cSchedTask;
+  }
+
+  //Not due yet: use the time, if there's enough of it
+  if (!due) {
+    if ((idleRoutine != NULL) && (nextFrame - now > idleEstimate)) {
+      start = micros();
+      idleRoutine();
+      idleEstimate = max(idleEstimate, micros() - start);
+      return cSchedIdle;
+    }
+    return cSchedWaiting;
+  }
+
+  //Frames whose whole period has gone by are dropped, keeping the grid. The latest one due is
+  //displayed, however late it is.
+  late = now - nextFrame;
+  if (late >= framePeriod) {
+    missed = late / framePeriod;
+    nFramesDropped += missed;
+    nextFrame += missed * framePeriod;
+    late -= missed * framePeriod;
+  }
+
+  maxLateness = max(maxLateness, late);
+  RunFrame(now);
+  nextFrame += framePeriod;
+  lastWasFrame = true;
+  return cSchedFrame;
+}
+
+/*_________________________
+LEDFrameScheduler::RunFrame
+DisplaySpectrum(), timed
+*/
+
+void LEDFrameScheduler::RunFrame(unsigned long now) {
+  unsigned long skipped;
+
+  //Frames that didn't need a show() would pull the estimate down
+  skipped = strip->GetSkippedFrames();
+  strip->DisplaySpectrum(readLeft, readRight);
+  if (strip->GetSkippedFrames() == skipped) {Average(&frameEstimate, micros() - now);}
+  nFramesShown++;
+}
+
+/*_________________________
+LEDFrameScheduler::RunTasks
+Run the first task that is due. Returns true if one ran.
+*/
+
+bool LEDFrameScheduler::RunTasks() {
+  short iTask;
+  unsigned long now = millis();
+  schedTask *task;
+
+  for (iTask = 0; iTask < cSchedMaxTasks; iTask++) {
+    task = &tasks[iTask];
+    if ((task->taskRoutine == NULL) || ((long) (now - task->taskNext) < 0)) {continue;}
+
+    //Keep to the task's period, but don't run it twice to catch up
+    task->taskNext += task->taskPeriod;
+    if ((long) (now - task->taskNext) >= 0) {task->taskNext = now + task->taskPeriod;}
+    task->taskRoutine();
+    return true;
+  }
+  return false;
+}
+
+/*________________________
+LEDFrameScheduler::Average
+Moving average over about the last 8 measurements
+*/
+
+void LEDFrameScheduler::Average(unsigned long *Estimate, unsigned long Measured) {
+  if (Measured >= *Estimate) {*Estimate += (Measured - *Estimate + 7) >> 3;}
+  else {*Estimate -= (*Estimate - Measured) >> 3;}
+}
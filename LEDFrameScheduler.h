@@ -0,0 +1,96 @@
+#ifndef _LEDFRAMESCHEDULER_H
+#define _LEDFRAMESCHEDULER_H
+
+#include "LEDSegs.h"
+
+//What the strip's show() costs before any has been measured: 24 bits at 800KHz per LED, plus the
+//reset/latch time
+const unsigned long cSchedShowMicrosPerLED = 30;
+const unsigned long cSchedShowLatchMicros = 50;
+
+//What Service() did
+const byte cSchedWaiting = 0;   //Nothing due yet
+const byte cSchedIdle = 1;      //Ran the idle routine
+const byte cSchedTask = 2;      //Ran a scheduled task
+const byte cSchedFrame = 3;     //Displayed a frame
+
+typedef void (*SchedulerRoutine) ();
+
+/*_______________
+LEDFrameScheduler
+Runs a strip's display cycles on a fixed frame grid instead of "display, then wait at least n ms".
+Call Service() from loop() as often as you can; it never waits itself.
+
+Frame n is due n frame periods after the first, so the rate doesn't drift with the frame time. A
+frame that starts late is still displayed, and the frames after it catch up with the grid as long as
+they take less than a period. Only when a frame period has gone by altogether, with no frame started
+in it, is its frame dropped; the next one shows the latest audio in its place. Frames are displayed
+with DisplaySpectrum(), so a profiler on the strip (see LEDProfile.h) sees them like any others.
+
+Between frames, Service() runs periodic tasks (e.g. rotating segment programs) when they come due,
+and otherwise the idle routine (e.g. feeding audio to an LEDPCMAnalyzer), as long as their longest
+time so far fits before the next frame; tasks that don't fit wait until just after it.
+
+  scheduler = new LEDFrameScheduler(strip, 30);
+  scheduler->AddTask(NextSegmentSet, 20000UL);
+  ...
+  void loop() {scheduler->Service();}
+*/
+
+class LEDFrameScheduler {
+
+  public:
+    LEDFrameScheduler(LEDSegs *Strip, short FramesPerSecond, bool doLeft = true, bool doRight = true);
+
+    void SetFrameRate(short FramesPerSecond) {SetFramePeriod(1000000UL / max(FramesPerSecond, (short) 1));}
+    void SetFramePeriod(unsigned long Micros);
+    unsigned long GetFramePeriod() {return framePeriod;}
+
+    //Call Routine every PeriodMS milliseconds; first on the next Service() if RunNow. Returns the
+    //task's index, or -1 if all cSchedMaxTasks are in use.
+    short AddTask(SchedulerRoutine Routine, unsigned long PeriodMS, bool RunNow = true);
+    void RemoveTask(short iTask) {if ((iTask >= 0) && (iTask < cSchedMaxTasks)) {tasks[iTask].taskRoutine = NULL;}}
+
+    //Called while waiting for the next frame. Keep it short: it only runs when its longest time so far
+    //fits before the frame.
+    void SetIdleRoutine(SchedulerRoutine Routine) {idleRoutine = Routine;}
+
+    //Run whatever is due. Returns what was done (cSchedWaiting etc.)
+    byte Service();
+
+    unsigned long GetFramesShown() {return nFramesShown;}
+    unsigned long GetFramesDropped() {return nFramesDropped;}
+    //Microseconds a frame takes, averaged over the frames that were shown. It starts from what show()
+    //would take for the LED count.
+    unsigned long GetFrameEstimate() {return frameEstimate;}
+    unsigned long GetMaxLateness() {return maxLateness;}        //Latest a shown frame started after it was due
+
+  private:
+    const static short cSchedMaxTasks = 4;
+
+    struct schedTask {
+      SchedulerRoutine taskRoutine;
+      unsigned long taskPeriod;  //ms
+      unsigned long taskNext;    //millis() when due
+    };
+
+    LEDSegs *strip;
+    bool readLeft, readRight;
+    unsigned long framePeriod;
+    unsigned long nextFrame;     //micros() when the next frame is due
+    bool started;
+    bool lastWasFrame;
+
+    schedTask tasks[cSchedMaxTasks];
+    SchedulerRoutine idleRoutine;
+    unsigned long idleEstimate, taskEstimate;  //Longest run so far
+
+    unsigned long frameEstimate;
+    unsigned long nFramesShown, nFramesDropped, maxLateness;
+
+    bool RunTasks();
+    void RunFrame(unsigned long now);
+    static void Average(unsigned long *Estimate, unsigned long Measured);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _LEDFRAMESINK_H
+#define _LEDFRAMESINK_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+//Bytes per LED in a NeoPixel strip's buffer for its type (NEO_GRB + NEO_KHZ800 etc.): 4 when it
+//has a white channel
+inline byte NeoPixelBytesPerLED(uint16_t LedType) {return (((LedType >> 6) & 3) == ((LedType >> 4) & 3)) ? 3 : 4;}
+
+/*__________
+LEDFrameSink
+Somewhere other than the strip that LEDSegs hands each frame to, e.g. an LEDFrameStream sending it
+to a host for preview. See LEDSegs::SetFrameSink().
+*/
+
+class LEDFrameSink {
+
+  public:
+    virtual ~LEDFrameSink() {}
+
+    //A frame is complete. Pixels is the NeoPixel strip's buffer: nLEDs pixels in the strip's color
+    //order, 3 bytes each, or 4 if LedType (NEO_GRB + NEO_KHZ800 etc.) has a white channel. Changed
+    //is false for a frame where nothing changed and the strip wasn't shown again.
+    virtual void WriteFrame(const byte *Pixels, short nLEDs, uint16_t LedType, bool Changed) = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+LEDFrameStream
+Streams frames to a host. The format is described in LEDFrameStream.h.
+*/
+
+#include "LEDFrameStream.h"
+
+/*____________________________
+LEDFrameStream::LEDFrameStream
+*/
+
+LEDFrameStream::LEDFrameStream(Print &Out) {
+  out = &Out;
+  sentPixels = NULL;
+  nSentLEDs = 0;
+  bytesPerLED = 3;
+  sentLedType = 0;
+  pending = false;
+  keyDue = true;
+  keyInterval = cStreamDefaultKeyInterval;
+  nSinceKey = 0;
+  sequence = 0;
+  byteMicros16 = 0;
+  linkFreeMicros = 0;
+  nFramesSent = nFramesDropped = nBytesSent = 0;
+  lastPacketBytes = 0;
+}
+
+LEDFrameStream::~LEDFrameStream() {
+  delete[] sentPixels;
+}
+
+/*________________________
+LEDFrameStream::WriteFrame
+Send the frame if it says something new (or a key is due) and the link has room for it.
+*/
+
+void LEDFrameStream::WriteFrame(const byte *Pixels, short nLEDs, uint16_t LedType, bool Changed) {
+  //The first frame, or a different strip: start over from a key
+  if ((sentPixels == NULL) || (nLEDs != nSentLEDs) || (LedType != sentLedType)) {
+    delete[] sentPixels;
+    bytesPerLED = ShowBytesPerLED(LedType);
+    sentPixels = new byte[((long) nLEDs) * bytesPerLED];
+    nSentLEDs = nLEDs;
+    sentLedType = LedType;
+    keyDue = true;
+  }
+
+  if (Changed) {pending = true;}
+  if ((keyInterval > 0) && (++nSinceKey >= keyInterval)) {keyDue = true;}
+  if (!pending && !keyDue) {return;}
+  if (!LinkReady()) {
+    if (pending) {nFramesDropped++;}
+    return;
+  }
+  SendPacket(Pixels, keyDue);
+}
+
+/*_______________________
+LEDFrameStream::LinkReady
+Whether the link has carried everything written so far. Time the link sat idle isn't saved up: a
+UART can't send faster later for having been idle before.
+*/
+
+bool LEDFrameStream::LinkReady() {
+  if (byteMicros16 == 0) {return true;}
+  return (long) (micros() - linkFreeMicros) >= 0;
+}
+
+/*________________________
+LEDFrameStream::SendPacket
+The runs from sentPixels (or all off, for a key) to Pixels, covering every LED
+*/
+
+void LEDFrameStream::SendPacket(const byte *Pixels, bool Key) {
+  byte check1, check2;
+
+  if (Key) {memset(sentPixels, 0, ((long) nSentLEDs) * bytesPerLED);}
+  lastPacketBytes = 0;
+  sum1 = sum2 = 0;
+
+  out->write(cStreamSync);
+  lastPacketBytes++;
+  WriteByte(bytesPerLED | (Key ? cStreamKey : 0));
+  WriteByte(sequence++);
+  WriteByte(nSentLEDs & 0xFF);
+  WriteByte(nSentLEDs >> 8);
+  if (Key) {
+    WriteByte(sentLedType & 0xFF);
+    WriteByte(sentLedType >> 8);
+  }
+
+  ShowEncodeRuns(Pixels, sentPixels, nSentLEDs, bytesPerLED, true, WriteRunByte, this);
+
+  //The checksum isn't part of itself, so take both halves before writing either
+  check1 = sum1;
+  check2 = sum2;
+  out->write(check1);
+  out->write(check2);
+  lastPacketBytes += 2;
+
+  nFramesSent++;
+  nBytesSent += lastPacketBytes;
+  pending = keyDue = false;
+  if (Key) {nSinceKey = 0;}
+  if (byteMicros16 != 0) {linkFreeMicros = micros() + ((lastPacketBytes * byteMicros16) >> 4);}
+}
+
+/*_______________________
+LEDFrameStream::WriteByte
+Write a byte of the packet, adding it to the checksum
+*/
+
+void LEDFrameStream::WriteByte(byte Value) {
+  out->write(Value);
+  lastPacketBytes++;
+  sum1 += Value;
+  if (sum1 < Value) {sum1++;}   //Modulo 255: 256 is 1
+  sum2 += sum1;
+  if (sum2 < sum1) {sum2++;}
+}
@@ -0,0 +1,108 @@
+#ifndef _LEDFRAMESTREAM_H
+#define _LEDFRAMESTREAM_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+ #include "Print.h"
+#else
+ #include "WProgram.h"
+#endif
+
+#include <string.h>
+#include "LEDFrameSink.h"
+#include "LEDShowPlayer.h"
+
+/*
+Frame streams
+
+A frame stream carries a strip's frames over a serial link or a socket, for previewing or
+monitoring an installation from a host (extras/host, lightorgan_stream). Each frame goes out as a
+packet of the runs that take the frame sent before it to this one, in the run coding of show files
+(see LEDShowPlayer.h), so a bar graph moving costs a few bytes per segment rather than 3 per LED.
+
+All numbers are little endian. Each packet is:
+  0  byte    cStreamSync
+  1  byte    flags: bytes per LED (3 or 4) in the low three bits, cStreamKey
+  2  byte    sequence number, one more than the packet before (wrapping)
+  3  uint16  number of LEDs
+  5  uint16  only in key packets: the NeoPixel type (NEO_GRB + NEO_KHZ800 etc.)
+  .. runs    show file runs, which here always cover every LED: a frame that changed nothing is
+             just skips
+  .. byte    Fletcher-16 checksum of everything from the flags on: sum1, the sum of the bytes,
+  .. byte    and sum2, the sum of the sum1s, both taken modulo 255 with end-around carry (so 0..255)
+A key packet's runs start from all LEDs off rather than from the frame before. The stream sends one
+every SetKeyInterval() frames, so a receiver that starts listening late, or loses or garbles a
+packet (a gap in the sequence, or a bad checksum), can pick the stream up again at the next key.
+*/
+
+const byte cStreamSync = 0xA5;
+const byte cStreamKey = 0x80;
+const byte cStreamBytesPerLEDMask = 0x07;
+const short cStreamHeaderBytes = 5;
+const short cStreamKeyHeaderBytes = 7;
+const short cStreamChecksumBytes = 2;
+
+/*____________
+LEDFrameStream
+A frame sink (see LEDSegs::SetFrameSink()) that writes the frames as a stream to any Print:
+
+  LEDFrameStream stream(Serial);
+  Serial.begin(115200);
+  stream.SetByteRate(11520);           //What the link carries a second: 115200 baud is 11520 bytes
+  strip->SetFrameSink(&stream);
+
+It keeps a copy of the last frame sent, so it takes 3 (or 4) bytes of RAM per LED. With a byte rate
+set, a frame that comes before the link has had time to carry the packets already written is not
+sent; the next one sent carries its changes as well. The Print's write() still blocks while its
+buffer is full, so on a board with a small serial buffer, a frame's packet costs the frame loop up
+to the time the link takes to carry it.
+*/
+
+class LEDFrameStream : public LEDFrameSink {
+
+  public:
+    LEDFrameStream(Print &Out);
+    ~LEDFrameStream();
+
+    //Bytes per second the link carries; 0 (the default) sends every frame
+    void SetByteRate(unsigned long BytesPerSecond) {byteMicros16 = (BytesPerSecond > 0) ? (16000000UL / BytesPerSecond) : 0;}
+    //Frames between key packets (the default is cStreamDefaultKeyInterval); 0 sends only the first
+    void SetKeyInterval(unsigned short nFrames) {keyInterval = nFrames;}
+    //Make the next packet a key
+    void SendKey() {keyDue = true;}
+
+    unsigned long GetFramesSent() {return nFramesSent;}
+    unsigned long GetFramesDropped() {return nFramesDropped;}   //Not sent for want of link time
+    unsigned long GetBytesSent() {return nBytesSent;}
+    unsigned long GetLastPacketBytes() {return lastPacketBytes;}
+
+    //LEDFrameSink
+    void WriteFrame(const byte *Pixels, short nLEDs, uint16_t LedType, bool Changed);
+
+  private:
+    const static unsigned short cStreamDefaultKeyInterval = 60;
+
+    Print *out;
+    byte *sentPixels;                 //The last frame sent, as the receiver has it
+    short nSentLEDs;
+    byte bytesPerLED;
+    uint16_t sentLedType;
+    bool pending;                     //A frame changed something that hasn't been sent yet
+    bool keyDue;
+    unsigned short keyInterval, nSinceKey;
+    byte sequence;
+
+    unsigned long byteMicros16;       //Link time per byte, in 16ths of a microsecond (0: no limit)
+    unsigned long linkFreeMicros;     //When the link will have carried the packets written so far
+
+    unsigned long nFramesSent, nFramesDropped, nBytesSent;
+    unsigned long lastPacketBytes;
+    byte sum1, sum2;                  //Running Fletcher-16 checksum of the packet
+
+    bool LinkReady();
+    void SendPacket(const byte *Pixels, bool Key);
+    void WriteByte(byte Value);
+    static void WriteRunByte(void *Context, byte Value) {((LEDFrameStream *) Context)->WriteByte(Value);}
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+LEDLayout
+Maps a strip's logical LEDs to its physical ones. See LEDLayout.h.
+*/
+
+#include <string.h>
+#include "LEDLayout.h"
+
+const long cLayoutMaxLEDs = 0x7FFF;
+
+/*__________________
+LEDLayout::LEDLayout
+*/
+
+LEDLayout::LEDLayout() {
+  runs = NULL;
+  nRunsAlloc = 0;
+  version = 0;
+  Clear();
+}
+
+LEDLayout::~LEDLayout() {
+  delete[] runs;
+}
+
+/*______________
+LEDLayout::Clear
+Forget the map, keeping the run storage
+*/
+
+void LEDLayout::Clear() {
+  nRuns = 0;
+  nLogical = nPhysical = 0;
+  position = 0;
+  version++;
+}
+
+/*_______________
+LEDLayout::AddRun
+Map the next Count logical LEDs to the next Count physical LEDs. A run that carries straight on
+from the run before, in the same direction, is added to it.
+*/
+
+bool LEDLayout::AddRun(short Count, bool Reversed) {
+  layoutRun *newRuns, *last;
+  short stride, first;
+
+  if ((Count <= 0) || (nLogical + (long) Count > cLayoutMaxLEDs) || (position + (long) Count > cLayoutMaxLEDs)) {return false;}
+  stride = (Reversed && (Count > 1)) ? -1 : 1;
+  first = (stride > 0) ? position : position + Count - 1;
+
+  last = (nRuns > 0) ? &runs[nRuns - 1] : NULL;
+  if ((last != NULL) && (last->runCount == 1) && (Count > 1) && (last->runPhysical + stride == first)) {
+    last->runStride = stride;   //A single LED goes either way
+  }
+  if ((last != NULL) && (last->runPhysical + last->runCount * last->runStride == first) &&
+    ((last->runStride == stride) || (Count == 1))) {
+    last->runCount += Count;
+  }
+  else {
+    if (nRuns >= nRunsAlloc) {
+      nRunsAlloc = max(8, nRunsAlloc * 2);
+      newRuns = new layoutRun[nRunsAlloc];
+      if (nRuns > 0) {memcpy(newRuns, runs, nRuns * sizeof(layoutRun));}
+      delete[] runs;
+      runs = newRuns;
+    }
+    runs[nRuns].runLogical = nLogical;
+    runs[nRuns].runPhysical = first;
+    runs[nRuns].runCount = Count;
+    runs[nRuns].runStride = stride;
+    nRuns++;
+  }
+
+  nLogical += Count;
+  position += Count;
+  nPhysical = max(nPhysical, position);
+  version++;
+  return true;
+}
+
+/*________________
+LEDLayout::AddRows
+A panel of Rows rows of Columns LEDs, row by row
+*/
+
+bool LEDLayout::AddRows(short Columns, short Rows, bool Serpentine, bool FirstReversed) {
+  short iRow;
+  long nLEDs = ((long) Columns) * Rows;
+
+  if ((Columns <= 0) || (Rows <= 0) || (nLogical + nLEDs > cLayoutMaxLEDs) || (position + nLEDs > cLayoutMaxLEDs)) {return false;}
+  for (iRow = 0; iRow < Rows; iRow++) {AddRun(Columns, FirstReversed != (Serpentine && (iRow & 1)));}
+  return true;
+}
+
+/*_______________
+LEDLayout::AddGap
+*/
+
+bool LEDLayout::AddGap(short Count) {
+  if ((Count <= 0) || (position + (long) Count > cLayoutMaxLEDs)) {return false;}
+  position += Count;
+  return true;
+}
+
+/*____________________
+LEDLayout::SetPosition
+*/
+
+bool LEDLayout::SetPosition(short PhysicalLED) {
+  if (PhysicalLED < 0) {return false;}
+  position = PhysicalLED;
+  return true;
+}
+
+/*________________
+LEDLayout::FindRun
+Binary search of the runs, which are in logical order and leave no logical LED out
+*/
+
+short LEDLayout::FindRun(short LogicalLED) {
+  short lo = 0, hi = nRuns - 1, mid;
+
+  if ((LogicalLED < 0) || (LogicalLED >= nLogical)) {return -1;}
+  while (lo < hi) {
+    mid = (lo + hi + 1) >> 1;
+    if (runs[mid].runLogical <= LogicalLED) {lo = mid;}
+    else {hi = mid - 1;}
+  }
+  return lo;
+}
+
+/*_________________
+LEDLayout::Physical
+*/
+
+short LEDLayout::Physical(short LogicalLED) {
+  short iRun = FindRun(LogicalLED);
+
+  if (iRun < 0) {return -1;}
+  return runs[iRun].runPhysical + (LogicalLED - runs[iRun].runLogical) * runs[iRun].runStride;
+}
@@ -0,0 +1,72 @@
+#ifndef _LEDLAYOUT_H
+#define _LEDLAYOUT_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+/*
+Physical layouts
+
+Segments are placed on a logical strip: LEDs 0, 1, 2... in the order the display reads them. An
+installation wired as serpentine panels, folded runs or strips joined out of order has those LEDs
+elsewhere on the physical strip. An LEDLayout maps logical LEDs to physical ones, built once from a
+description of the wiring:
+
+  LEDLayout wiring;
+  wiring.AddRows(16, 8, true);   //A panel of 8 rows of 16, wired back and forth
+  wiring.AddGap(3);              //3 LEDs on the lead to the next run, not part of the display
+  wiring.AddRun(60, true);       //A 60-LED run, wired from its far end
+  strip->SetPhysicalLayout(&wiring);
+
+The strip folds the map into each segment's render plan when either changes (see
+LEDSegs::BuildPlans), so a frame costs the same to render with a map as without one. Physical LEDs
+that no logical LED maps to, like gaps, are left off.
+*/
+
+class LEDLayout {
+
+  public:
+    LEDLayout();
+    ~LEDLayout();
+
+    //The wiring, in logical order. Each call maps the next logical LEDs to the physical LEDs that
+    //follow those mapped last (from LED 0, or from where SetPosition() moved to). They return
+    //false, and map nothing, if Count, Columns or Rows isn't positive or the map would grow past
+    //32767 LEDs.
+    bool AddRun(short Count, bool Reversed = false);   //Count LEDs, the last of them first if Reversed
+    bool AddRows(short Columns, short Rows, bool Serpentine, bool FirstReversed = false);  //Serpentine reverses every other row
+    bool AddGap(short Count);                          //Skip Count physical LEDs
+    bool SetPosition(short PhysicalLED);               //Carry on from elsewhere, for runs wired out of order
+    void Clear();
+
+    short GetNumLEDs() {return nLogical;}              //Logical LEDs mapped
+    short GetPhysicalLEDs() {return nPhysical;}        //One past the furthest physical LED mapped
+    short Physical(short LogicalLED);                  //-1 for an LED past the end of the map
+
+    //The map is kept as runs of consecutive logical LEDs mapped to consecutive physical LEDs, in
+    //logical order
+    struct layoutRun {
+      short runLogical;     //First logical LED of the run
+      short runPhysical;    //Physical LED it maps to
+      short runCount;
+      short runStride;      //1, or -1 for a reversed run
+    };
+    short GetNumRuns() {return nRuns;}
+    const layoutRun *GetRun(short iRun) {return &runs[iRun];}
+    short FindRun(short LogicalLED);                   //The run holding LogicalLED, -1 if none
+
+    //Changes whenever the map does, so a strip using it knows to rebuild its plans
+    unsigned short GetVersion() {return version;}
+
+  private:
+    layoutRun *runs;
+    short nRuns, nRunsAlloc;
+    short nLogical, nPhysical;
+    short position;                 //Physical LED the next run starts at
+    unsigned short version;
+};
+
+#endif
@@ -0,0 +1,287 @@
+/*
+LEDPCMAnalyzer
+Spectrum band levels from PCM audio, for LEDSegs. See LEDPCMAnalyzer.h.
+*/
+
+#include "LEDPCMAnalyzer.h"
+#include <math.h>
+#include <string.h>
+
+//The shield's MSGEQ7 band centers
+static const long cMSGEQ7Centers[cPCMMaxBands] = {63, 160, 400, 1000, 2500, 6250, 16000};
+
+/*____________________________
+LEDPCMAnalyzer::LEDPCMAnalyzer
+*/
+
+LEDPCMAnalyzer::LEDPCMAnalyzer(long SampleRate, short nChannels) {
+  sampleRate = SampleRate;
+  nAnalyzerChannels = (nChannels == 2) ? 2 : 1;
+  levelGain = cDefaultGain;
+  noiseFloor = cDefaultNoiseFloor;
+  nBlocks = 0;
+  inLeft = inRight = window = twiddleCos = twiddleSin = NULL;
+  fftRe = fftIm = NULL;
+  nAnalyzerBands = 0;
+  blockSize = 0;
+  SetBlockSize(cDefaultBlockSize);
+  SetBands(cPCMMaxBands, NULL);
+}
+
+LEDPCMAnalyzer::~LEDPCMAnalyzer() {
+  FreeBlock();
+}
+
+void LEDPCMAnalyzer::FreeBlock() {
+  delete[] inLeft;
+  delete[] inRight;
+  delete[] window;
+  delete[] twiddleCos;
+  delete[] twiddleSin;
+  delete[] fftRe;
+  delete[] fftIm;
+}
+
+/*__________________________
+LEDPCMAnalyzer::SetBlockSize
+Allocate the block buffers and fill in the window and twiddle tables for a new block size.
+*/
+
+bool LEDPCMAnalyzer::SetBlockSize(short nSamples) {
+  short i, nBits;
+
+  for (nBits = 0; (1L << nBits) < nSamples; nBits++) {}
+  if ((nSamples < cMinBlockSize) || (nSamples > cMaxBlockSize) || ((1L << nBits) != nSamples)) {return false;}
+
+  FreeBlock();
+  blockSize = nSamples;
+  blockBits = nBits;
+  nBuffered = 0;
+  inLeft = new int16_t[blockSize];
+  inRight = new int16_t[blockSize];
+  window = new int16_t[blockSize];
+  twiddleCos = new int16_t[blockSize / 2];
+  twiddleSin = new int16_t[blockSize / 2];
+  fftRe = new int32_t[blockSize];
+  fftIm = new int32_t[blockSize];
+
+  for (i = 0; i < blockSize; i++) {window[i] = (int16_t) lround(32767.0 * 0.5 * (1.0 - cos(2.0 * M_PI * i / blockSize)));}
+  for (i = 0; i < blockSize / 2; i++) {
+    twiddleCos[i] = (int16_t) lround(32767.0 * cos(2.0 * M_PI * i / blockSize));
+    twiddleSin[i] = (int16_t) lround(32767.0 * sin(2.0 * M_PI * i / blockSize));
+  }
+
+  //The bins and the level scale depend on the block size
+  if (nAnalyzerBands > 0) {BandBins();}
+  LevelScale();
+  return true;
+}
+
+/*______________________
+LEDPCMAnalyzer::SetBands
+*/
+
+bool LEDPCMAnalyzer::SetBands(short nBands, const long *CentersHz) {
+  short iBand;
+
+  if ((nBands < 1) || (nBands > cPCMMaxBands)) {return false;}
+  if (CentersHz == NULL) {
+    if (nBands != cPCMMaxBands) {return false;}
+    CentersHz = cMSGEQ7Centers;
+  }
+  for (iBand = 1; iBand < nBands; iBand++) {
+    if (CentersHz[iBand] <= CentersHz[iBand - 1]) {return false;}
+  }
+
+  nAnalyzerBands = nBands;
+  for (iBand = 0; iBand < cPCMMaxBands; iBand++) {
+    bandCenters[iBand] = (iBand < nBands) ? CentersHz[iBand] : 0;
+    bandLeft[iBand] = bandRight[iBand] = 0;
+  }
+  BandBins();
+  return true;
+}
+
+/*______________________
+LEDPCMAnalyzer::BandBins
+Work out each band's FFT bins. A band reaches to the geometric midpoints with its neighbours; the
+outer bands reach as far again on their open sides. Bin 0 (DC) is never used, and a band too narrow
+for any bin of its own gets the bin nearest its center.
+*/
+
+void LEDPCMAnalyzer::BandBins() {
+  short iBand, lastUsable;
+  double binHz, lowHz, highHz;
+
+  binHz = (double) sampleRate / blockSize;
+  lastUsable = blockSize / 2 - 1;
+  for (iBand = 0; iBand < nAnalyzerBands; iBand++) {
+    if (iBand > 0) {lowHz = sqrt((double) bandCenters[iBand - 1] * bandCenters[iBand]);}
+    else if (nAnalyzerBands > 1) {lowHz = bandCenters[0] * sqrt((double) bandCenters[0] / bandCenters[1]);}
+    else {lowHz = bandCenters[0] / 2.0;}
+    if (iBand < nAnalyzerBands - 1) {highHz = sqrt((double) bandCenters[iBand] * bandCenters[iBand + 1]);}
+    else if (nAnalyzerBands > 1) {highHz = bandCenters[iBand] * sqrt((double) bandCenters[iBand] / bandCenters[iBand - 1]);}
+    else {highHz = bandCenters[0] * 2.0;}
+
+    //Bins from the one above lowHz up to the one at or below highHz (the next band starts above it)
+    bandFirstBin[iBand] = max((short) (floor(lowHz / binHz) + 1), (short) 1);
+    bandLastBin[iBand] = min((short) floor(highHz / binHz), lastUsable);
+    if (bandFirstBin[iBand] > bandLastBin[iBand]) {
+      bandFirstBin[iBand] = bandLastBin[iBand] = constrain((short) lround(bandCenters[iBand] / binHz), (short) 1, lastUsable);
+    }
+  }
+}
+
+/*________________________
+LEDPCMAnalyzer::LevelScale
+levelMul takes a band's amplitude to a level where a full scale sine reads 1023 at unity gain.
+Windowed by the Hann window, a sine of amplitude A puts A*N/4 into its bin and A*N/8 into each
+neighbour, for an amplitude over the band of A*N*sqrt(3/32).
+*/
+
+void LEDPCMAnalyzer::LevelScale() {
+  double fullScale;
+
+  if (blockSize == 0) {return;}
+  fullScale = 32767.0 * blockSize * sqrt(3.0 / 32.0);
+  levelMul = (uint32_t) min(1023.0 * levelGain / 256.0 / fullScale * 4294967296.0, 4294967295.0);
+}
+
+/*_________________________
+LEDPCMAnalyzer::PushSamples
+*/
+
+void LEDPCMAnalyzer::PushSamples(const int16_t *Samples, long nFrames) {
+  long iFrame;
+  short half = blockSize / 2;
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    inLeft[nBuffered] = Samples[0];
+    inRight[nBuffered] = (nAnalyzerChannels == 2) ? Samples[1] : 0;
+    Samples += nAnalyzerChannels;
+
+    //Blocks overlap by half, so a sound falling on a block edge still gets a full weight block
+    if (++nBuffered == blockSize) {
+      AnalyzeBlock();
+      memmove(inLeft, inLeft + half, half * sizeof(int16_t));
+      memmove(inRight, inRight + half, half * sizeof(int16_t));
+      nBuffered = half;
+    }
+  }
+}
+
+/*__________________________
+LEDPCMAnalyzer::AnalyzeBlock
+Both channels go through one complex FFT as z = left + j*right. With Z[k] = a+jb and
+Z[N-k] = c+jd, the channels' spectra come back out as
+  Left[k]  = ((a+c) + j(b-d)) / 2
+  Right[k] = ((b+d) - j(a-c)) / 2
+A mono block has nothing in the imaginary part, and its spectrum is Left.
+*/
+
+void LEDPCMAnalyzer::AnalyzeBlock() {
+  short i, iBand, k;
+  int32_t a, b, c, d;
+  uint64_t powerLeft, powerRight;
+  uint32_t level;
+
+  for (i = 0; i < blockSize; i++) {
+    fftRe[i] = ((int32_t) inLeft[i] * window[i] + 16384) >> 15;
+    fftIm[i] = ((int32_t) inRight[i] * window[i] + 16384) >> 15;
+  }
+  FFT();
+
+  for (iBand = 0; iBand < nAnalyzerBands; iBand++) {
+    powerLeft = powerRight = 0;
+    for (k = bandFirstBin[iBand]; k <= bandLastBin[iBand]; k++) {
+      a = fftRe[k];
+      b = fftIm[k];
+      c = fftRe[blockSize - k];
+      d = fftIm[blockSize - k];
+      powerLeft += (uint64_t) ((int64_t) (a + c) * (a + c)) + (uint64_t) ((int64_t) (b - d) * (b - d));
+      if (nAnalyzerChannels == 2) {powerRight += (uint64_t) ((int64_t) (b + d) * (b + d)) + (uint64_t) ((int64_t) (a - c) * (a - c));}
+    }
+
+    //The channel amplitudes are half the roots of the sums
+    level = ((uint64_t) (Sqrt64(powerLeft) >> 1) * levelMul) >> 32;
+    bandLeft[iBand] = min(level, (uint32_t) 1023);
+    level = ((uint64_t) (Sqrt64(powerRight) >> 1) * levelMul) >> 32;
+    bandRight[iBand] = (nAnalyzerChannels == 2) ? min(level, (uint32_t) 1023) : bandLeft[iBand];
+  }
+  nBlocks++;
+}
+
+/*_________________
+LEDPCMAnalyzer::FFT
+In-place radix-2 decimation-in-time FFT on fftRe/fftIm with Q15 twiddles. The samples come in as
+16 bits, so even a 4096 point transform (12 bits of growth) stays well inside 32 bits unscaled.
+*/
+
+void LEDPCMAnalyzer::FFT() {
+  short i, j, bit, len, half, step, k, iTw;
+  int32_t tRe, tIm, uRe, uIm;
+
+  //Bit reversal
+  for (i = 1, j = 0; i < blockSize; i++) {
+    for (bit = blockSize >> 1; j & bit; bit >>= 1) {j ^= bit;}
+    j |= bit;
+    if (i < j) {
+      tRe = fftRe[i]; fftRe[i] = fftRe[j]; fftRe[j] = tRe;
+      tIm = fftIm[i]; fftIm[i] = fftIm[j]; fftIm[j] = tIm;
+    }
+  }
+
+  //Butterflies, with w = cos - j*sin
+  for (len = 2; len <= blockSize; len <<= 1) {
+    half = len >> 1;
+    step = blockSize / len;
+    for (i = 0; i < blockSize; i += len) {
+      for (k = 0, iTw = 0; k < half; k++, iTw += step) {
+        tRe = (int32_t) (((int64_t) fftRe[i + k + half] * twiddleCos[iTw] + (int64_t) fftIm[i + k + half] * twiddleSin[iTw] + 16384) >> 15);
+        tIm = (int32_t) (((int64_t) fftIm[i + k + half] * twiddleCos[iTw] - (int64_t) fftRe[i + k + half] * twiddleSin[iTw] + 16384) >> 15);
+        uRe = fftRe[i + k];
+        uIm = fftIm[i + k];
+        fftRe[i + k] = uRe + tRe;
+        fftIm[i + k] = uIm + tIm;
+        fftRe[i + k + half] = uRe - tRe;
+        fftIm[i + k + half] = uIm - tIm;
+      }
+    }
+  }
+}
+
+/*____________________
+LEDPCMAnalyzer::Sqrt64
+Integer square root, bit by bit
+*/
+
+uint32_t LEDPCMAnalyzer::Sqrt64(uint64_t value) {
+  uint64_t root = 0, bit = 1ULL << 62;
+
+  while (bit > value) {bit >>= 2;}
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else {root >>= 1;}
+    bit >>= 2;
+  }
+  return (uint32_t) root;
+}
+
+/*_______________________
+LEDPCMAnalyzer::ReadBands
+*/
+
+void LEDPCMAnalyzer::ReadBands(short *Levels, short nBands, bool doLeft, bool doRight) {
+  short iBand;
+
+  for (iBand = 0; iBand < nBands; iBand++) {
+    if (iBand >= nAnalyzerBands) {Levels[iBand] = 0;}
+    else if (doLeft && doRight) {Levels[iBand] = (bandLeft[iBand] + bandRight[iBand]) >> 1;}
+    else if (doLeft) {Levels[iBand] = bandLeft[iBand];}
+    else if (doRight) {Levels[iBand] = bandRight[iBand];}
+    else {Levels[iBand] = 0;}
+  }
+}
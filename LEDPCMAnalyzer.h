@@ -0,0 +1,96 @@
+#ifndef _LEDPCMANALYZER_H
+#define _LEDPCMANALYZER_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+#include "LEDSpectrumSource.h"
+
+//Most bands an analyzer can have: LEDSegs segments pick their bands with a seven bit mask
+const short cPCMMaxBands = 7;
+
+/*____________
+LEDPCMAnalyzer
+A spectrum source that works on PCM audio instead of the shield: 16-bit samples from a WAV file on
+the host, or from an ADC/I2S DMA buffer on the board, are pushed in as they arrive. Every half block
+of samples, the last block is Hann windowed and run through a fixed-point FFT (both stereo channels
+in one complex FFT), and each band's level is the root of the energy in its bins.
+
+By default the bands match the shield's MSGEQ7 (63Hz, 160Hz, 400Hz, 1KHz, 2.5KHz, 6.25KHz, 16KHz),
+each reaching halfway (geometrically) to its neighbours, so a sketch written for the shield behaves
+the same. A full scale sine reads 1023 at a gain of 256.
+
+The analyzer needs about 10 bytes per block sample, so it is meant for 32-bit boards and the host
+rather than an Uno.
+
+  LEDPCMAnalyzer pcm(44100, 2);
+  strip->SetSpectrumSource(&pcm);
+  ...
+  pcm.PushSamples(samples, nFrames);  //As audio arrives
+  strip->DisplaySpectrum(true, true);
+*/
+
+class LEDPCMAnalyzer : public LEDSpectrumSource {
+
+  public:
+    LEDPCMAnalyzer(long SampleRate, short nChannels);  //nChannels 1 (mono) or 2 (interleaved L,R)
+    ~LEDPCMAnalyzer();
+
+    //Samples per FFT block, a power of two from 64 to 4096 (default 1024). Larger blocks separate the
+    //low bands better but respond more slowly. Returns false (and changes nothing) if out of range.
+    bool SetBlockSize(short nSamples);
+
+    //Center frequencies (Hz, ascending) of nBands bands, 1..cPCMMaxBands. NULL gives the MSGEQ7 bands.
+    bool SetBands(short nBands, const long *CentersHz);
+    short GetNumBands() {return nAnalyzerBands;}
+
+    //Level gain, 256 = 1.0 (the default is 1024, which brings typical program material into the range
+    //the shield reads). The noise floor goes to LEDSegs when the analyzer is made its spectrum source.
+    void SetGain(short Gain) {levelGain = Gain; LevelScale();}
+    void SetNoiseFloor(short Level) {noiseFloor = Level;}
+
+    //Add nFrames frames of audio (nFrames * nChannels samples, interleaved). Each time another half
+    //block has come in, the band levels are updated.
+    void PushSamples(const int16_t *Samples, long nFrames);
+    unsigned long GetBlocks() {return nBlocks;}  //Blocks analyzed so far
+
+    //LEDSpectrumSource
+    void ReadBands(short *Levels, short nBands, bool doLeft, bool doRight);
+    short GetNoiseFloor(short iBand) {return noiseFloor;}
+
+  private:
+    const static short cMinBlockSize = 64;
+    const static short cMaxBlockSize = 4096;
+    const static short cDefaultBlockSize = 1024;
+    const static short cDefaultGain = 1024;
+    const static short cDefaultNoiseFloor = 16;
+
+    long sampleRate;
+    short nAnalyzerChannels;
+    short blockSize, blockBits;
+    short nBuffered;                  //Samples of the current block in inLeft/inRight
+    int16_t *inLeft, *inRight;
+    int16_t *window;                  //Hann window, Q15
+    int16_t *twiddleCos, *twiddleSin; //cos/sin(2*pi*k/blockSize), k < blockSize/2, Q15
+    int32_t *fftRe, *fftIm;
+
+    short nAnalyzerBands;
+    long bandCenters[cPCMMaxBands];
+    short bandFirstBin[cPCMMaxBands], bandLastBin[cPCMMaxBands];
+    short bandLeft[cPCMMaxBands], bandRight[cPCMMaxBands];
+    short levelGain, noiseFloor;
+    uint32_t levelMul;                //Band amplitude to level, 32.32 fixed point
+    unsigned long nBlocks;
+
+    void FreeBlock();
+    void BandBins();
+    void LevelScale();
+    void AnalyzeBlock();
+    void FFT();
+    static uint32_t Sqrt64(uint64_t value);
+};
+
+#endif
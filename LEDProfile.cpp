@@ -0,0 +1,155 @@
+/*
+LEDProfiler
+Hot path instrumentation for LEDSegs. See LEDProfile.h.
+*/
+
+#include "LEDProfile.h"
+#include <string.h>
+
+static const char *const cProfileStageNames[cProfileNumStages] = {"read", "map", "routine", "composite", "show", "frame"};
+
+/*______________________
+LEDProfiler::LEDProfiler
+*/
+
+LEDProfiler::LEDProfiler() {
+#if !defined(HOST_SIM_CYCLES) && (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__))
+  //Turn on the DWT cycle counter: TRCENA in DEMCR, then CYCCNTENA in DWT_CTRL
+  *(volatile uint32_t *) 0xE000EDFC |= (1UL << 24);
+  *(volatile uint32_t *) 0xE0001000 |= 1UL;
+#endif
+  budgetTicks = 0;
+  Reset();
+}
+
+void LEDProfiler::Reset() {
+  memset(stageCount, 0, sizeof(stageCount));
+  memset(stageTotal, 0, sizeof(stageTotal));
+  memset(stageMax, 0, sizeof(stageMax));
+  memset(stageHist, 0, sizeof(stageHist));
+  nextEvent = nEvents = 0;
+  frameOverruns = routineOverruns = 0;
+  lastOverrunSegment = -1;
+}
+
+/*_________________
+LEDProfiler::Record
+*/
+
+void LEDProfiler::Record(byte Stage, short iSegment, uint32_t Start) {
+  uint32_t ticks = LEDProfileTicks() - Start;
+  short bucket;
+  profileEvent *event;
+
+  stageCount[Stage]++;
+  stageTotal[Stage] += ticks;
+  if (ticks > stageMax[Stage]) {stageMax[Stage] = ticks;}
+
+  //The bucket is the number of significant bits
+  for (bucket = 0; (bucket < cProfileHistBuckets - 1) && ((ticks >> bucket) != 0); bucket++) {}
+  if (stageHist[Stage][bucket] != 0xFFFF) {stageHist[Stage][bucket]++;}
+
+  event = &events[nextEvent];
+  event->eventStart = Start;
+  event->eventTicks = ticks;
+  event->eventStage = Stage;
+  event->eventSegment = iSegment;
+  nextEvent = (nextEvent + 1) % LEDSEGS_PROFILE_RING;
+  if (nEvents < LEDSEGS_PROFILE_RING) {nEvents++;}
+
+  if ((budgetTicks != 0) && (ticks > budgetTicks)) {
+    if (Stage == cProfileFrame) {frameOverruns++;}
+    else if (Stage == cProfileRoutine) {
+      routineOverruns++;
+      lastOverrunSegment = iSegment;
+    }
+  }
+}
+
+/*_______________
+LEDProfiler::Dump
+*/
+
+void LEDProfiler::Dump(Print &Out) {
+  byte stage;
+  short bucket, i;
+  const profileEvent *event;
+
+  Out.println("stage        count      avg us      max us");
+  for (stage = 0; stage < cProfileNumStages; stage++) {
+    Out.print(cProfileStageNames[stage]);
+    for (i = strlen(cProfileStageNames[stage]); i < 10; i++) {Out.print(' ');}
+    PrintPadded(Out, stageCount[stage], 8);
+    Out.print("  ");
+    PrintMicros(Out, (stageCount[stage] > 0) ? (uint32_t) (stageTotal[stage] / stageCount[stage]) : 0);
+    Out.print("  ");
+    PrintMicros(Out, stageMax[stage]);
+    Out.println();
+  }
+  if (budgetTicks != 0) {
+    Out.print("overruns: ");
+    Out.print(frameOverruns);
+    Out.print(" frames, ");
+    Out.print(routineOverruns);
+    Out.print(" display routines (last segment ");
+    Out.print((int) lastOverrunSegment);
+    Out.println(")");
+  }
+
+  //Histograms: "< limit: count" for each bucket in use
+  for (stage = 0; stage < cProfileNumStages; stage++) {
+    if (stageCount[stage] == 0) {continue;}
+    Out.print(cProfileStageNames[stage]);
+    Out.print(" histogram (ticks, ");
+    Out.print((unsigned long) cProfileTicksPerMicro);
+    Out.println(" per us):");
+    for (bucket = 0; bucket < cProfileHistBuckets; bucket++) {
+      if (stageHist[stage][bucket] == 0) {continue;}
+      Out.print((bucket < cProfileHistBuckets - 1) ? "  < " : "  >=");
+      Out.print((bucket < cProfileHistBuckets - 1) ? (1UL << bucket) : (1UL << (bucket - 1)));
+      Out.print(": ");
+      Out.println((unsigned int) stageHist[stage][bucket]);
+    }
+  }
+
+  Out.println("recent (start us, stage, segment, us):");
+  for (i = 0; i < nEvents; i++) {
+    event = GetEvent(i);
+    Out.print("  ");
+    Out.print((unsigned long) (event->eventStart / cProfileTicksPerMicro));
+    Out.print(' ');
+    Out.print(cProfileStageNames[event->eventStage]);
+    Out.print(' ');
+    Out.print((int) event->eventSegment);
+    Out.print(' ');
+    PrintMicros(Out, event->eventTicks);
+    Out.println();
+  }
+}
+
+/*______________________
+LEDProfiler::PrintMicros
+Ticks as microseconds, right aligned in 10 columns, with as many decimals (1..3) as the ticks resolve
+*/
+
+void LEDProfiler::PrintMicros(Print &Out, uint32_t Ticks) {
+  unsigned long scale, value, digit;
+  short decimals, width;
+
+  decimals = (cProfileTicksPerMicro >= 1000) ? 3 : ((cProfileTicksPerMicro >= 10) ? 2 : 1);
+  for (scale = 1, width = 0; width < decimals; width++) {scale *= 10;}
+  value = (((unsigned long long) Ticks) * scale) / cProfileTicksPerMicro;
+
+  PrintPadded(Out, value / scale, 9 - decimals);
+  Out.print('.');
+  for (digit = scale / 10; digit > 0; digit /= 10) {Out.print((unsigned long) ((value / digit) % 10));}
+}
+
+void LEDProfiler::PrintPadded(Print &Out, unsigned long Value, short Width) {
+  unsigned long rest;
+  short nDigits;
+
+  for (nDigits = 1, rest = Value; rest >= 10; rest /= 10, nDigits++) {}
+  for (; nDigits < Width; nDigits++) {Out.print(' ');}
+  Out.print(Value);
+}
@@ -0,0 +1,129 @@
+#ifndef _LEDPROFILE_H
+#define _LEDPROFILE_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+ #include "Print.h"
+#else
+ #include "WProgram.h"
+#endif
+
+/*
+Hot path instrumentation for LEDSegs, built in only when LEDSEGS_PROFILE is defined (see the top of
+LEDSegs.h). Each DisplaySpectrum() stage is timed as it runs: ReadSpectrum(), MapBandsToSegments()
+(less the display routines), each segment display routine, the ShowSegments() compositing passes,
+show(), and the whole frame. Nothing is allocated; every timing goes into:
+  - a count, total and maximum for its stage
+  - a log2 histogram for its stage (bucket b counts times of 2^(b-1) up to 2^b ticks)
+  - a ring buffer of the last LEDSEGS_PROFILE_RING timings, with their start times
+Times are in ticks of the best counter the board has: CPU cycles (the DWT cycle counter) on
+Cortex-M3/M4/M7, micros() elsewhere, and nanoseconds on the host build.
+*/
+
+//Stages
+const byte cProfileRead = 0;       //ReadSpectrum()
+const byte cProfileMap = 1;        //MapBandsToSegments(), not counting the display routines
+const byte cProfileRoutine = 2;    //One segment display routine
+const byte cProfileComposite = 3;  //ShowSegments() finding and painting what changed
+const byte cProfileShow = 4;       //The strip's show()
+const byte cProfileFrame = 5;      //All of DisplaySpectrum()
+const byte cProfileNumStages = 6;
+
+const short cProfileHistBuckets = 32;
+
+#ifndef LEDSEGS_PROFILE_RING
+ #ifdef __AVR__
+  #define LEDSEGS_PROFILE_RING 16
+ #else
+  #define LEDSEGS_PROFILE_RING 64
+ #endif
+#endif
+
+//The tick counter
+#if defined(HOST_SIM_CYCLES)
+ const uint32_t cProfileTicksPerMicro = 1000;
+ inline uint32_t LEDProfileTicks() {return hostCycles();}
+#elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+ const uint32_t cProfileTicksPerMicro = F_CPU / 1000000UL;
+ inline uint32_t LEDProfileTicks() {return *(volatile uint32_t *) 0xE0001004;}  //DWT_CYCCNT
+#else
+ const uint32_t cProfileTicksPerMicro = 1;
+ inline uint32_t LEDProfileTicks() {return micros();}
+#endif
+
+struct profileEvent {
+  uint32_t eventStart;   //Tick count when it started
+  uint32_t eventTicks;   //How long it took
+  byte eventStage;
+  short eventSegment;    //The segment, for a display routine; otherwise -1
+};
+
+/*_________
+LEDProfiler
+*/
+
+class LEDProfiler {
+
+  public:
+    LEDProfiler();
+    void Reset();
+
+    //Time allowed for a frame (e.g. the sketch's refresh delay), 0 for none. Frames, and display
+    //routines on their own, that take longer are counted as overruns.
+    void SetBudgetMicros(unsigned long Micros) {budgetTicks = Micros * cProfileTicksPerMicro;}
+
+    //Record a stage that started at tick Start and has just finished
+    void Record(byte Stage, short iSegment, uint32_t Start);
+
+    unsigned long GetCount(byte Stage) {return stageCount[Stage];}
+    uint32_t GetMaxTicks(byte Stage) {return stageMax[Stage];}
+    unsigned long long GetTotalTicks(byte Stage) {return stageTotal[Stage];}
+    uint16_t GetHistogram(byte Stage, short Bucket) {return stageHist[Stage][Bucket];}  //Stops at 65535
+    static uint32_t GetTicksPerMicro() {return cProfileTicksPerMicro;}
+
+    //Ring buffer, oldest first
+    short GetNumEvents() {return nEvents;}
+    const profileEvent *GetEvent(short i) {return &events[(nextEvent - nEvents + i + LEDSEGS_PROFILE_RING) % LEDSEGS_PROFILE_RING];}
+
+    unsigned long GetFrameOverruns() {return frameOverruns;}
+    unsigned long GetRoutineOverruns() {return routineOverruns;}
+    short GetLastOverrunSegment() {return lastOverrunSegment;}  //Display routine that last overran, or -1
+
+    //Print the statistics, histograms and ring buffer, e.g. Dump(Serial)
+    void Dump(Print &Out);
+
+  private:
+    unsigned long stageCount[cProfileNumStages];
+    unsigned long long stageTotal[cProfileNumStages];
+    uint32_t stageMax[cProfileNumStages];
+    uint16_t stageHist[cProfileNumStages][cProfileHistBuckets];
+
+    profileEvent events[LEDSEGS_PROFILE_RING];
+    short nextEvent, nEvents;
+
+    uint32_t budgetTicks;
+    unsigned long frameOverruns, routineOverruns;
+    short lastOverrunSegment;
+
+    static void PrintMicros(Print &Out, uint32_t Ticks);
+    static void PrintPadded(Print &Out, unsigned long Value, short Width);
+};
+
+/*_____________
+LEDProfileScope
+Times the rest of the enclosing block as one stage
+*/
+
+class LEDProfileScope {
+
+  public:
+    LEDProfileScope(LEDProfiler *Profiler, byte Stage) : profiler(Profiler), stage(Stage), start(LEDProfileTicks()) {}
+    ~LEDProfileScope() {profiler->Record(stage, -1, start);}
+
+  private:
+    LEDProfiler *profiler;
+    byte stage;
+    uint32_t start;
+};
+
+#endif
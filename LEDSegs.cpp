@@ -1,54 +1,205 @@
 #include "LEDSegs.h"
 #include <Adafruit_NeoPixel.h>
 
+//Stage timing (see LEDProfile.h); nothing at all unless LEDSEGS_PROFILE is defined
+#ifdef LEDSEGS_PROFILE
+  #define PROFILE_BEGIN(start) uint32_t start = LEDProfileTicks()
+  #define PROFILE_END(start, stage, iSegment) profiler.Record(stage, iSegment, start)
+  #define PROFILE_SCOPE(stage) LEDProfileScope profileScope(&profiler, stage)
+#else
+  #define PROFILE_BEGIN(start)
+  #define PROFILE_END(start, stage, iSegment)
+  #define PROFILE_SCOPE(stage)
+#endif
+
 /*______________
 LEDSegsInit:Common constructor code
 */
 
 void LEDSegs::LEDSegsInit(short nLEDs, short pinData, short ledType) {
-  unsigned short iBand;
+  byte iTransform;
   
   segCurrentIndex = 0;
   segMaxDefinedIndex = -1;
+  nSkippedFrames = 0;
+  heapPeak = heapScratch = 0;
+  reshuffleFrames = 0;
 
-  //Noise values for each spectrum band (0..1023). Determined by experimentation. YMMV
-  nNoiseFloor[0] =  90;
-  nNoiseFloor[1] =  90;
-  nNoiseFloor[2] =  90;
-  nNoiseFloor[3] = 100;
-  nNoiseFloor[4] = 100;
-  nNoiseFloor[5] = 110;
-  nNoiseFloor[6] = 120;
-    
-  //Initialize the max level seen for each band.
-  for (iBand = 0; iBand < cSegNumBands; iBand++) {maxBandValue[iBand] = cInitialMaxBandValue;}
+  //A spectrum of the strip's own (which sets up the shield), until one is shared with it
+  spectrum = NULL;
+  ownSpectrum = false;
+  SetSpectrum(NULL);
+  spectrumChannels = 0;
 
   //Create an LED strip object. Either SPI or digital pins
 
   objPxlStrip = new Adafruit_NeoPixel(nLEDs, pinData, ledType);  
   
   nLEDsInStrip = nLEDs;
-  
-  //Setup pins to drive the spectrum analyzer. 
-  pinMode(cSpectrumReset, OUTPUT);
-  pinMode(cSpectrumStrobe, OUTPUT);
-
-  //Init spectrum analyzer to start reading from lowest band
-  digitalWrite(cSpectrumStrobe,LOW);
-    delay(1);
-  digitalWrite(cSpectrumReset,HIGH);
-    delay(1);
-  digitalWrite(cSpectrumStrobe,HIGH);
-    delay(1);
-  digitalWrite(cSpectrumStrobe,LOW);
-    delay(1);
-  digitalWrite(cSpectrumReset,LOW);
-    delay(5);
+  stripLedType = ledType;
+  bytesPerPixel = NeoPixelBytesPerLED(ledType);
+  frameSink = NULL;
+  showStrip = true;
+  planRuns = NULL;
+  nPlanRunsAlloc = 0;
+  physLayout = NULL;
+  physLayoutVersion = 0;
+  compSpans = NULL;
+  nCompSpans = nCompSpansAlloc = 0;
+  compositeDirty = false;
+  compLayers = NULL;
+  nCompLayersAlloc = 0;
+  maskTable = NULL;
+  nMasks = nMasksAlloc = 0;
+  for (iTransform = 0; iTransform < cMaxLevelTransforms; iTransform++) {levelTransforms[iTransform] = NULL;}
+  anyTransforms = false;
+  levelRoutine = NULL;
+  colorCurve = NULL;
 
   //Init this guy
   ResetStrip();
 }
 
+/*____________________
+LEDSegs::~LEDSegs
+*/
+
+LEDSegs::~LEDSegs() {
+  byte iTransform;
+
+  if (ownSpectrum) {delete spectrum;}
+  delete objPxlStrip;
+  delete[] planRuns;
+  delete[] compSpans;
+  delete[] compLayers;
+  delete[] maskTable;
+  delete[] colorCurve;
+  if (ownSegmentStorage) {
+    delete[] SegmentData;
+    delete[] SegmentState;
+    delete[] SegmentLevels;
+  }
+  for (iTransform = 0; iTransform < cMaxLevelTransforms; iTransform++) {delete levelTransforms[iTransform];}
+}
+
+/*___________________
+LEDSegs::GetHeapBytes
+*/
+
+long LEDSegs::GetHeapBytes() {
+  long nBytes;
+  byte iTransform;
+
+  nBytes = sizeof(Adafruit_NeoPixel) + ((long) nLEDsInStrip) * bytesPerPixel;
+  if (ownSpectrum) {nBytes += sizeof(LEDSpectrum);}
+  if (ownSegmentStorage) {nBytes += nLayoutsAlloc * (long) sizeof(stripSegment) + nSegmentsAlloc * (long) (sizeof(segmentState) + sizeof(short));}
+  nBytes += nPlanRunsAlloc * (long) sizeof(ledRun) + nCompSpansAlloc * (long) sizeof(compSpan);
+  nBytes += nCompLayersAlloc * (long) sizeof(compLayer) + nMasksAlloc * (long) sizeof(bandMask);
+  if (colorCurve != NULL) {nBytes += cColorCurveSize;}
+  for (iTransform = 0; iTransform < cMaxLevelTransforms; iTransform++) {
+    if (levelTransforms[iTransform] != NULL) {nBytes += sizeof(levelTransform);}
+  }
+  return nBytes;
+}
+
+/*________________________
+LEDSegs::SetSegmentStorage
+Point the segment arrays at storage for nSegments segments, nLayouts of them with layout storage.
+NULL arrays are allocated as segments are defined (see GrowSegments), and freed by the destructor.
+*/
+
+void LEDSegs::SetSegmentStorage(stripSegment *Layout, segmentState *State, short *Levels, short nSegments, short nLayouts) {
+  ownSegmentStorage = (State == NULL);
+  SegmentData = ownSegmentStorage ? NULL : Layout;
+  SegmentState = ownSegmentStorage ? NULL : State;
+  SegmentLevels = ownSegmentStorage ? NULL : Levels;
+  nSegmentsMax = nSegments;
+  nLayoutsMax = nLayouts;
+  nSegmentsAlloc = ownSegmentStorage ? 0 : nSegments;
+  nLayoutsAlloc = ownSegmentStorage ? 0 : nLayouts;
+  flashProgram = NULL;
+}
+
+/*___________________
+LEDSegs::GrowSegments
+Make room for nSegments segments, if we allocated the segment arrays: they grow a few segments at a
+time, up to their capacity, and the new segments start out blank. Returns false if there is no
+room for that many.
+*/
+
+bool LEDSegs::GrowSegments(short nSegments) {
+  stripSegment *newData;
+  segmentState *newState;
+  short *newLevels, nAlloc, i;
+
+  if (nSegments <= nSegmentsAlloc) {return true;}
+  if (!ownSegmentStorage || (nSegments > nSegmentsMax)) {return false;}
+  nAlloc = min(((nSegments + cSegmentsGrowStep - 1L) / cSegmentsGrowStep) * cSegmentsGrowStep, (long) nSegmentsMax);
+  NoteHeapPeak(nAlloc * (long) (sizeof(stripSegment) + sizeof(segmentState) + sizeof(short)));  //Old and new arrays, while copying
+
+  newData = new stripSegment[nAlloc];
+  newState = new segmentState[nAlloc];
+  newLevels = new short[nAlloc];
+  if (nSegmentsAlloc > 0) {
+    memcpy(newData, SegmentData, nSegmentsAlloc * sizeof(stripSegment));
+    memcpy(newState, SegmentState, nSegmentsAlloc * sizeof(segmentState));
+    memcpy(newLevels, SegmentLevels, nSegmentsAlloc * sizeof(short));
+  }
+  memset(&newState[nSegmentsAlloc], 0, (nAlloc - nSegmentsAlloc) * sizeof(segmentState));
+  for (i = nSegmentsAlloc; i < nAlloc; i++) {
+    newData[i] = ProgramSegment(0, 0, cSegActionNone, RGBOff, 0);
+    newLevels[i] = 0;
+  }
+  delete[] SegmentData;
+  delete[] SegmentState;
+  delete[] SegmentLevels;
+  SegmentData = newData;
+  SegmentState = newState;
+  SegmentLevels = newLevels;
+  nSegmentsAlloc = nLayoutsAlloc = nAlloc;
+  return true;
+}
+
+/*__________________
+LEDSegs::LoadProgram
+Make a segment program (see the class definition) the strip's layout. It shows on the next frame.
+*/
+
+void LEDSegs::LoadProgram(const stripSegment *Program, short nSegments) {
+  short i;
+
+  nSegments = min(nSegments, nSegmentsMax);
+  GrowSegments(nSegments);
+  for (i = 0; i < nSegments; i++) {
+    SegmentLevels[i] = 0;
+    SegmentState[i].segBackColorChanged = false;
+  }
+  flashProgram = Program;
+  segMaxDefinedIndex = nSegments - 1;
+  segCurrentIndex = max(segMaxDefinedIndex, (short) 0);
+  layoutDirty = true;
+  masksDirty = true;
+}
+
+/*______________________
+LEDSegs::WritableSegment
+The SRAM layout of a segment that is about to change, or NULL if there is no room for it. The first
+change to a loaded program copies the program there.
+*/
+
+LEDSegs::stripSegment *LEDSegs::WritableSegment(short nSegment) {
+  if (flashProgram != NULL) {
+    if (segMaxDefinedIndex >= nLayoutsMax) {return NULL;}
+#ifdef LEDSEGS_FLASH_COPY
+    memcpy_P(SegmentData, flashProgram, (segMaxDefinedIndex + 1) * sizeof(stripSegment));
+#else
+    memcpy(SegmentData, flashProgram, (segMaxDefinedIndex + 1) * sizeof(stripSegment));
+#endif
+    flashProgram = NULL;
+  }
+  return ((nSegment >= 0) && (nSegment < nLayoutsMax) && GrowSegments(nSegment + 1)) ? &SegmentData[nSegment] : NULL;
+}
+
 /*____________________
 LEDSegs::DefineSegment
 Set the properties of the current LED segment. A -1 value indicates that the corresponding property should not be changed.
@@ -59,6 +210,7 @@ short LEDSegs::DefineSegment(short FirstLED, short nLEDs, short Action, uint32_t
 
   //Move to next segment (if no segments yet, start with #0)
   if (segMaxDefinedIndex < 0) {SetSegmentIndex(0);} else {SetSegmentIndex(segCurrentIndex + 1);}
+  if (WritableSegment(segCurrentIndex) == NULL) {return -1;}  //Only programs can be loaded
   
   //Set the segment properties passed in
   SetSegment_FirstLED(FirstLED);
@@ -72,9 +224,12 @@ short LEDSegs::DefineSegment(short FirstLED, short nLEDs, short Action, uint32_t
   SetSegment_Spacing(0);
   SetSegment_Options(segCurrentIndex, 0);
   SetSegment_DisplayRoutine(segCurrentIndex, NULL);
+  SetSegment_Transform(segCurrentIndex, 0);
 
   //Track the highest segment index defined. This speeds the refresh loop a bit.
   segMaxDefinedIndex = max(segMaxDefinedIndex, segCurrentIndex);
+  layoutDirty = true;
+  masksDirty = true;
 
   //Return the segment index that was updated, before incrementing it
   return segCurrentIndex;
@@ -86,9 +241,12 @@ Sample and display according to the defined segments
 */
 
 void LEDSegs::DisplaySpectrum(bool doLeft, bool doRight) { 
+  PROFILE_BEGIN(frameStart);
+
   ReadSpectrum(doLeft, doRight);
   MapBandsToSegments();
   ShowSegments();
+  PROFILE_END(frameStart, cProfileFrame, -1);
 };
 
 /*_________________________
@@ -98,77 +256,215 @@ We average all the bands defined for the segment, and then scale the final segme
 */
 
 void LEDSegs::MapBandsToSegments() {
-  short iSegment, iBand, nLEDs, segBands;
+  short iSegment, iMask, iBand, segBands;
   unsigned long maxTotal, sampleTotal;
+  const short *bandLevels, *bandMaxes;
+  bandMask *mask;
   SegmentDisplayRoutine thisDisplayRoutine;
+  stripSegment segBuf;
+  PROFILE_BEGIN(mapStart);
+
+  if (masksDirty) {BuildMaskTable();}
   
-  //Loop all defined segments to calc the normalized band value. We do this even for ActionNone segments
-  //in case a segment display routine wants to change the action
-  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
-    nLEDs = SegmentData[iSegment].segNumLEDs;
-    segBands = SegmentData[iSegment].segBands;
+  //Segments only differ by which bands they average, so do the averaging once for each distinct
+  //band mask in use.
+  for (iMask = 0; iMask < nMasks; iMask++) {
+    mask = &maskTable[iMask];
+    segBands = mask->maskBands;
+    bandLevels = spectrum->GetLevels(mask->maskChannel);
+    bandMaxes = spectrum->GetMaxes(mask->maskChannel);
 
-    //Loop spectrum bands. For any that are mapped into this segment we total both the sample values and the
+    //Loop spectrum bands. For any that are mapped into this mask we total both the sample values and the
     //max possible values, in order to do the normalization.
     maxTotal = 0;
     sampleTotal = 0;
 
     for (iBand = 0; iBand < cSegNumBands; iBand++) {
       if ((segBands >> iBand) & 1) {
-        maxTotal += maxBandValue[iBand];
-        sampleTotal += SpectrumLevel[iBand];
+        maxTotal += bandMaxes[iBand];
+        sampleTotal += bandLevels[iBand];
       }
     }
     if (maxTotal <= 0) {maxTotal = 1;} //Safety for use as divisor
       
-    //Normalize the averaged level to 0..1023 and record in the level array element for this segment
-    sampleTotal = (sampleTotal * cMaxSegmentLevel) / maxTotal;
-    SegmentData[iSegment].segLevel = sampleTotal;
-    SegmentData[iSegment].segMaxLevel = maxTotal;
-  } //end segments loop
+    //Normalize the averaged level to 0..1023
+    mask->maskLevel = (sampleTotal * cMaxSegmentLevel) / maxTotal;
+  }
+
+  //Record the level for each segment. We do this even for ActionNone segments in case a segment
+  //display routine wants to change the action
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    SegmentLevels[iSegment] = maskTable[SegmentState[iSegment].segMaskSlot].maskLevel;
+  }
+  if (anyTransforms) {ApplyLevelTransforms();}
+  PROFILE_END(mapStart, cProfileMap, -1);
+
+  if (levelRoutine != NULL) {
+    PROFILE_BEGIN(levelStart);
+    levelRoutine(SegmentLevels, segMaxDefinedIndex + 1);
+    PROFILE_END(levelStart, cProfileRoutine, -1);
+  }
   
   //Now that all the segments are setup, call any segment display routines that are defined
   for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
-    thisDisplayRoutine = SegmentData[iSegment].segDisplayRoutine;
-    if (thisDisplayRoutine != NULL) {thisDisplayRoutine(iSegment);}
+    thisDisplayRoutine = Layout(iSegment, &segBuf)->segDisplayRoutine;
+    if (thisDisplayRoutine != NULL) {
+      PROFILE_BEGIN(routineStart);
+      thisDisplayRoutine(iSegment);
+      PROFILE_END(routineStart, cProfileRoutine, iSegment);
+    }
   };  
 };  
 
+/*___________________________
+LEDSegs::ApplyLevelTransforms
+Run each segment's level through its transform (see SetLevelTransform). The curve is looked up at
+the level's 16-level step and interpolated within it.
+*/
+
+void LEDSegs::ApplyLevelTransforms() {
+  short iSegment, level, iStep, *levelptr;
+  const short *curve;
+  levelTransform *xf;
+
+  levelptr = SegmentLevels;
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++, levelptr++) {
+    if (SegmentState[iSegment].segTransform == 0) {continue;}
+    xf = levelTransforms[SegmentState[iSegment].segTransform - 1];
+    if (xf == NULL) {continue;}
+
+    level = constrain(*levelptr, 0, cMaxSegmentLevel);
+    if (xf->xfInvert) {level = cMaxSegmentLevel - level;}
+    if (xf->xfSteps > 0) {
+      for (iStep = 0; (iStep < xf->xfSteps - 1) && (level >= xf->xfCurve[iStep]); iStep++) {;}
+      level = xf->xfCurve[cMaxLevelSteps + iStep];
+    }
+    else {
+      curve = &xf->xfCurve[level >> 4];
+      level = curve[0] + (((curve[1] - curve[0]) * (level & 15)) >> 4);
+    }
+    *levelptr = constrain(level, xf->xfMin, xf->xfMax);
+  }
+}
+
+/*________________________
+LEDSegs::SetLevelTransform
+Sample the transform's curve (see the class definition) into its table, or keep its steps there
+*/
+
+bool LEDSegs::SetLevelTransform(byte iTransform, const short *CurveIn, const short *CurveOut, short nPoints, short Min, short Max, bool Invert, bool Steps) {
+  levelTransform *xf;
+  short i, iPoint, level;
+
+  if ((iTransform < 1) || (iTransform > cMaxLevelTransforms)) {return false;}
+  if (Steps && (nPoints > cMaxLevelSteps)) {return false;}
+  xf = levelTransforms[iTransform - 1];
+  if (xf == NULL) {xf = levelTransforms[iTransform - 1] = new levelTransform;}
+  xf->xfMin = Min;
+  xf->xfMax = Max;
+  xf->xfInvert = Invert;
+  xf->xfSteps = 0;
+  masksDirty = true;
+
+  //Steps are looked up as they are, so they keep their exact levels
+  if (Steps && (nPoints > 0)) {
+    for (i = 0; i < nPoints; i++) {
+      xf->xfCurve[i] = CurveIn[i];
+      xf->xfCurve[cMaxLevelSteps + i] = constrain(CurveOut[i], 0, cMaxSegmentLevel);
+    }
+    xf->xfSteps = nPoints;
+    return true;
+  }
+
+  for (i = 0; i < cLevelCurvePoints; i++) {
+    level = i << 4;
+    for (iPoint = 0; (iPoint < nPoints) && (CurveIn[iPoint] <= level); iPoint++) {;}
+    if (nPoints <= 0) {xf->xfCurve[i] = level;}
+    else if (iPoint == 0) {xf->xfCurve[i] = CurveOut[0];}
+    else if (iPoint == nPoints) {xf->xfCurve[i] = CurveOut[nPoints - 1];}
+    else {
+      xf->xfCurve[i] = CurveOut[iPoint - 1] + (((long) (CurveOut[iPoint] - CurveOut[iPoint - 1])) * (level - CurveIn[iPoint - 1]))
+        / (CurveIn[iPoint] - CurveIn[iPoint - 1]);
+    }
+    xf->xfCurve[i] = constrain(xf->xfCurve[i], 0, cMaxSegmentLevel);  //Keeps the interpolation in 16 bits
+  }
+  return true;
+}
+
+void LEDSegs::ClearLevelTransform(byte iTransform) {
+  if ((iTransform < 1) || (iTransform > cMaxLevelTransforms)) {return;}
+  NoteHeapPeak(0);
+  delete levelTransforms[iTransform - 1];
+  levelTransforms[iTransform - 1] = NULL;
+  masksDirty = true;
+}
+
+/*_____________________
+LEDSegs::BuildMaskTable
+Collect the distinct band masks (and channels) used by the defined segments into maskTable[], and
+point each segment at its mask's slot. Also picks up the segments' level transforms.
+*/
+
+void LEDSegs::BuildMaskTable() {
+  short iSegment, iMask, segBands;
+  byte segChannel;
+  const stripSegment *segptr;
+  stripSegment segBuf;
+
+  //There can't be more distinct masks than segments (or than the 128 possible masks on each channel)
+  iMask = min(segMaxDefinedIndex + 1, cSpectrumNumChannels << cSegNumBands);
+  if (iMask > nMasksAlloc) {
+    delete[] maskTable;
+    maskTable = new bandMask[iMask];
+    nMasksAlloc = iMask;
+  }
+
+  nMasks = 0;
+  anyTransforms = false;
+  spectrumChannels = 0;
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    segptr = Layout(iSegment, &segBuf);
+    SegmentState[iSegment].segTransform = segptr->segTransform;
+    if ((segptr->segTransform > 0) && (levelTransforms[segptr->segTransform - 1] != NULL)) {anyTransforms = true;}
+
+    segBands = segptr->segBands & ((1 << cSegNumBands) - 1);
+    segChannel = SegmentChannel(segptr->segOptions);
+    spectrumChannels |= (1 << segChannel);
+    for (iMask = 0; (iMask < nMasks) && ((maskTable[iMask].maskBands != segBands) || (maskTable[iMask].maskChannel != segChannel)); iMask++) {;}
+    if (iMask == nMasks) {
+      maskTable[iMask].maskBands = segBands;
+      maskTable[iMask].maskChannel = segChannel;
+      nMasks++;
+    }
+    SegmentState[iSegment].segMaskSlot = iMask;
+  }
+  masksDirty = false;
+}
+
+/*__________________
+LEDSegs::SetSpectrum
+Show Spectrum's samples from now on (NULL: a spectrum of the strip's own)
+*/
+
+void LEDSegs::SetSpectrum(LEDSpectrum *Spectrum) {
+  if ((Spectrum == NULL) ? ownSpectrum : (Spectrum == spectrum)) {return;}
+  if (ownSpectrum) {NoteHeapPeak(0); delete spectrum;}
+  ownSpectrum = (Spectrum == NULL);
+  spectrum = ownSpectrum ? new LEDSpectrum() : Spectrum;
+  spectrumSeen = 0;
+}
+
 /*___________________
 LEDSegs::ReadSpectrum
-Read the spectrum band samples into class array SpectrumLevel[].
+Bring the strip's spectrum up to date. With a spectrum shared between strips, only the first strip
+to read it each cycle actually samples it (see LEDSpectrum::Acquire).
 "Channels" tells whether to read left, right, or average both channels.
 */
 void LEDSegs::ReadSpectrum(bool doLeft, bool doRight) {
-  short iBand, thisLevel, bandMax;  //Band 0 is lowest frequencies, Band 6 is the highest.
-
-  //This loop happens nBands times per sample, so keep it quick. It just records the
-  //current and max sample values into the band value arrays.
-  for(iBand=0; iBand < cSegNumBands; iBand++) {
-    
-    //Decay the max a little on each sample
-    bandMax = maxBandValue[iBand] - cMaxBandValueDecay;
-    if (bandMax < cInitialMaxBandValue) bandMax = cInitialMaxBandValue;
-    
-    //Read the spectrum for this band
-    thisLevel = 0;
-    if (doLeft) {thisLevel += analogRead(cSegSpectrumAnalogLeft);}
-    if (doRight) {thisLevel += analogRead(cSegSpectrumAnalogRight);}
-    if (doLeft && doRight) {thisLevel = thisLevel >> 1;} //If both channels, then take average
-
-    //Process out assumed noise floor for this band
-    thisLevel -= nNoiseFloor[iBand];
-    if (thisLevel < 0) {thisLevel = 0;}
-
-    //Set current and max values for this into their respective segment object array slots
-    SpectrumLevel[iBand] = thisLevel;
-    if (bandMax < thisLevel) {bandMax = thisLevel;}
-    maxBandValue[iBand] = bandMax;
-    
-    //Toggle to ready for next band
-    digitalWrite(cSpectrumStrobe,HIGH);
-    digitalWrite(cSpectrumStrobe,LOW);     
-  }
+  PROFILE_SCOPE(cProfileRead);
+
+  if (masksDirty) {BuildMaskTable();}  //For the channels the segments follow
+  spectrum->Acquire(&spectrumSeen, spectrumChannels, doLeft, doRight);
 }
 
 /*_________________
@@ -180,152 +476,788 @@ void LEDSegs::ResetStrip() {
   short i;
   
   //Reset segment array
-  for (i = 0; i < cMaxSegments; i++) {SegmentData[i].segAction = cSegActionNone;}
+  flashProgram = NULL;
+  for (i = 0; i < nLayoutsAlloc; i++) {
+    SegmentData[i].segAction = cSegActionNone;
+    SegmentData[i].segFirstLED = 0;
+    SegmentData[i].segNumLEDs = 0;
+    SegmentData[i].segModRecip = 0;
+    SegmentData[i].segOptions = 0;
+    SegmentData[i].segSpacing = 0;
+    SegmentData[i].segBands = 0;
+    SegmentData[i].segTransform = 0;
+    SegmentData[i].segBackColor = RGBOff;
+  }
+  for (i = 0; i < nSegmentsAlloc; i++) {
+    SegmentLevels[i] = 0;
+    SegmentState[i].segBackColorChanged = false;
+  }
   
   objPxlStrip->begin();  //Clear and init the strip
   objPxlStrip->show();  //Update the LED strip display to show off to start
   segCurrentIndex = 0;
   segMaxDefinedIndex = -1;
+  layoutDirty = true;
+  masksDirty = true;
 
-  //Init the random permutation array (for cSegActionRandom)
+  //Init the random permutation array (for cSegActionRandom). This also marks the whole strip for repainting.
   ResetRandom();
 }
 
 /*__________________
 LEDSegs::ResetRandom
-Init the cSegActionRandom levels array
+Key the cSegActionRandom cutoffs to a new seed. The composite map's random layers are rehashed to
+it (see RekeyRandomLayers); a frame painted from the plans hashes each LED as it is painted.
 */
 
-void LEDSegs::ResetRandom() {
-  unsigned short i, imax;
+void LEDSegs::ResetRandom(unsigned long Seed) {
+  unsigned short oldKey = randomKey;
 
-  randomSeed(micros());
-  imax = SIZEOF_ARRAY(segRandomLevels);
-  
-  //Init the random permutation array (Knuth shuffle)
-  for (i=0; i < imax; i++) {segRandomLevels[i] = random(cMaxSegmentLevel);}
+  //0 picks a seed, so it can't be one
+  if (Seed == 0) {Seed = micros();}
+  if (Seed == 0) {Seed = 1;}
+  randomSeedUsed = Seed;
+  randomKey = RandomHash(RandomHash(Seed & 0xFFFF) ^ (Seed >> 16));
+  reshuffleCount = 0;
+
+  //A map out of date with the layout is dropped before it is painted again, so it is left alone
+  if (!layoutDirty) {RekeyRandomLayers(oldKey);}
+
+  //Any random segment may now look different
+  RefreshAll();
+}
+
+/*________________________
+LEDSegs::RekeyRandomLayers
+Carry the cutoff hashes kept in the composite map's random layers over from OldKey to randomKey. A
+layer's visit order is what is left of its hash once it is undone and the segment's old key taken
+off, so nothing more needs keeping for it.
+*/
+
+void LEDSegs::RekeyRandomLayers(unsigned short OldKey) {
+  compSpan *span, *spanEnd;
+  compLayer *layer;
+  short k;
+  unsigned short iSegment, lastSegment = cLayerLast, oldSegKey = 0, newSegKey = 0;
+  bool random = false;
+
+  spanEnd = compSpans + nCompSpans;
+  for (span = compSpans; span < spanEnd; span++) {
+    if (span->spanOwner != cSpanContested) {continue;}
+    layer = &compLayers[span->spanFirstLayer];
+    for (k = 0; k < span->spanCount; k++) {
+      do {
+        iSegment = layer->layerSegment & ~cLayerLast;
+        if (iSegment != lastSegment) {
+          random = (GetSegment_Action(iSegment) == cSegActionRandom);
+          oldSegKey = RandomHash(OldKey + iSegment * cRandomKeyStep);
+          newSegKey = RandomHash(randomKey + iSegment * cRandomKeyStep);
+          lastSegment = iSegment;
+        }
+        if (random) {layer->layerVisit = RandomHash(newSegKey + (RandomUnhash(layer->layerVisit) - oldSegKey));}
+      } while (!((layer++)->layerSegment & cLayerLast));
+    }
+  }
+}
+
+/*___________________
+LEDSegs::BlendChannel
+A color channel alpha/255 of the way from b to f, rounded. An alpha of 255 gives exactly f.
+*/
+
+byte LEDSegs::BlendChannel(byte b, byte f, short alpha) {
+  return b + (((((short) f) - b) * alpha + 128) >> 8);
+}
+
+/*____________________
+LEDSegs::SetColorCurve
+Build the output color curve table. See the class definition.
+*/
+
+//Gamma 2.2, 7-bit channel to 8-bit
+const byte cGammaCurve[128] PROGMEM = {
+    0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   2,   2,   2,
+    3,   3,   3,   4,   4,   5,   5,   6,   7,   7,   8,   8,   9,  10,  11,  11,
+   12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  24,  25,  26,  27,  29,
+   30,  31,  33,  34,  36,  37,  39,  40,  42,  44,  45,  47,  49,  51,  53,  55,
+   56,  58,  60,  62,  65,  67,  69,  71,  73,  75,  78,  80,  82,  85,  87,  90,
+   92,  95,  97, 100, 103, 105, 108, 111, 114, 117, 120, 122, 125, 128, 132, 135,
+  138, 141, 144, 147, 151, 154, 157, 161, 164, 168, 171, 175, 179, 182, 186, 190,
+  193, 197, 201, 205, 209, 213, 217, 221, 225, 229, 233, 238, 242, 246, 251, 255,
+};
+
+void LEDSegs::SetColorCurve(byte Brightness, bool Gamma) {
+  short i, value;
+
+  if (colorCurve == NULL) {colorCurve = new byte[cColorCurveSize];}
+  for (i = 0; i < cColorCurveSize; i++) {
+    value = Gamma ? pgm_read_byte(&cGammaCurve[i]) : ((i << 1) | (i >> 6));
+    value = (value * (Brightness + 1)) >> 8;
+    if ((i > 0) && (value == 0)) {value = 1;}
+    colorCurve[i] = value;
+  }
+  RefreshAll();
+}
+
+void LEDSegs::ClearColorCurve() {
+  NoteHeapPeak(0);
+  delete[] colorCurve;
+  colorCurve = NULL;
+  RefreshAll();
 }
 
 /*___________________
 LEDSegs::ShowSegments
-Display the segment values on the LED strip
+Display the segment values on the LED strip.
+
+The strip's pixel buffer persists between frames, so we only repaint what changed. A first pass
+resolves each segment's level and colors for this frame and compares them with what was drawn last
+frame. The second pass walks the composite map (see BuildComposite) and repaints the spans of the
+segments that changed, so every LED is written at most once. If nothing changed we skip show()
+altogether.
+
+A frame whose layout changed is painted whole, straight from the render plans (see PaintDirect), and
+the map is only rebuilt on the first frame after the layout has held still for one. So a layout
+that a sketch moves every frame never pays for building the map.
+
+The passes are PrepareFrame(), PaintSpans() and FinishFrame(), which a multithreaded renderer can
+call separately.
 */
 
 void LEDSegs::ShowSegments() {
-  short    iSegment, iLEDinSegment, iLED, LEDIncrement, segval, ledval;
-  short    FirstLED, NumberLEDs, Action, Options, segSpacing1, SpacingCount;
-  bool     optOffOverwrite, optModulate, notSpacingLED, doled;
-  uint32_t thisColor, backColor, foreColor;
+  PROFILE_BEGIN(compositeStart);
+
+  if (!PrepareFrame()) {
+    PROFILE_END(compositeStart, cProfileComposite, -1);
+    return;
+  }
+  PaintSpans(0, nCompSpans);
+  PROFILE_END(compositeStart, cProfileComposite, -1);
+  FinishFrame();
+}
+
+/*___________________
+LEDSegs::PrepareFrame
+First pass of ShowSegments(). Returns false, and counts a skipped frame, if nothing changed. On a
+frame whose layout changed it paints the whole strip itself, and leaves no spans for PaintSpans().
+*/
+
+bool LEDSegs::PrepareFrame() {
+  short    iSegment, segval, levelKey;
+  unsigned short oldKey;
+  short    NumberLEDs, Action, Options, alpha;
+  bool     anyChanged, reshuffled, direct;
+  uint32_t backColor, foreColor;
   byte     bcRGB[3], fcRGB[3]; //extra byte for long align
-  stripSegment *segptr;
+  const stripSegment *segptr;
+  stripSegment segBuf;
+  segmentState *stateptr;
 
-  //First, init all LEDs in the strip to off
-  for (iLED = 0; iLED < nLEDsInStrip; iLED++) {objPxlStrip->setPixelColor(iLED, RGBOff);}
-  
-  //Write each defined segment
+  //Bring the render plans up to date if the layout changed, and drop the composite map until it holds
+  //still. A map out of date with a layout that held still for a frame is built now: the strip
+  //already shows the last frame, so only what changes needs painting.
+  if ((physLayout != NULL) && (physLayout->GetVersion() != physLayoutVersion)) {layoutDirty = true;}
+  direct = layoutDirty;
+  if (direct) {
+    BuildPlans();
+    nCompSpans = 0;
+    compositeDirty = true;
+    repaintAll = true;
+  }
+  else if (compositeDirty) {
+    BuildComposite();
+    compositeDirty = false;
+  }
+  anyChanged = repaintAll;
+
+  //A reshuffle moves every random segment's cutoffs on to the next key in the seed's sequence
+  reshuffled = (reshuffleFrames > 0) && (++reshuffleCount >= reshuffleFrames);
+  if (reshuffled) {
+    reshuffleCount = 0;
+    oldKey = randomKey;
+    randomKey = RandomHash(randomKey + cRandomKeyStep);
+    RekeyRandomLayers(oldKey);
+  }
+
+  //Resolve this frame's level and colors for each segment, and see what changed since the last frame
   for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
       
-    segptr = &SegmentData[iSegment];
+    segptr = Layout(iSegment, &segBuf);
+    stateptr = &SegmentState[iSegment];
     Action = segptr->segAction;
+    if (Action == cSegActionNone) {continue;}
 
-    //Process segment if it does something
-
-    if (Action != cSegActionNone) {
- 
-      /* Set some local vars for fast reference that we'll need */
-      FirstLED = segptr->segFirstLED;
-      NumberLEDs = segptr->segNumLEDs;
-      backColor = segptr->segBackColor;
-      foreColor = segptr->segForeColor;
-      segSpacing1 = segptr->segSpacing + 1;
-
-      Options = segptr->segOptions;
-      optOffOverwrite = (Options & cSegOptNoOffOverwrite) == 0;
-      optModulate = (Options & cSegOptModulateSegment) != 0;
+    NumberLEDs = segptr->segNumLEDs;
+    backColor = segptr->segBackColor;
+    foreColor = segptr->segForeColor;
+    Options = segptr->segOptions;
       
-      //The level coming out of MapBandsToSegments() is normalized to 0..1023. Here we
-      //scale to the number of LEDs that means for this segment.
+    //The level coming out of MapBandsToSegments() is normalized to 0..1023. Here we
+    //scale to the number of LEDs that means for this segment (the 1024 levels are a shift). The
+    //shift falls short of the last LEDs of a segment longer than 1023, so full level is all of them.
       
-      if (Options & cSegOptInvertLevel) {segptr->segLevel = cMaxSegmentLevel - segptr->segLevel;}
-      segval = segptr->segLevel;
-      segval = (((long) segval) * ((long) (NumberLEDs + 1))) / ((long) (cMaxSegmentLevel + 1));
-      segval = constrain(segval, 0, NumberLEDs); //Insure within expected range
-      ledval = segval;
-      if ((Action == cSegActionStatic) || (Action == cSegActionRandom)) {ledval = NumberLEDs;}
-
-      //If this is a ModulateSegment option segment, then figure the foreground color scaled between
-      //backcolor and forecolor according to the segment's spectrum level.
-      if (optModulate) {
-        Colorvals(backColor, bcRGB);
-        Colorvals(foreColor, fcRGB);
-        foreColor = LEDSegs::Color(
-            bcRGB[0] + (((fcRGB[0] - bcRGB[0]) * segval) / NumberLEDs)
-          , bcRGB[1] + (((fcRGB[1] - bcRGB[1]) * segval) / NumberLEDs)
-          , bcRGB[2] + (((fcRGB[2] - bcRGB[2]) * segval) / NumberLEDs));
-      }
-  
-      //Get the starting LED index for this segment and an initial increment to get to the next LED
-      switch (Action) {
-        case cSegActionFromBottom: //bottom, static and random start iLED the same
+    if (Options & cSegOptInvertLevel) {SegmentLevels[iSegment] = cMaxSegmentLevel - SegmentLevels[iSegment];}
+    segval = SegmentLevels[iSegment];
+    segval = (segval >= cMaxSegmentLevel) ? NumberLEDs : ((((long) segval) * ((long) (NumberLEDs + 1))) >> 10);
+    segval = constrain(segval, 0, NumberLEDs); //Insure within expected range
+
+    //If this is a ModulateSegment option segment, then figure the foreground color scaled between
+    //backcolor and forecolor according to the segment's spectrum level. The lit fraction of the
+    //segment comes from its precomputed reciprocal as an 8-bit alpha (0..255). segval is at most
+    //segNumLEDs, so the product stays under 256 << 16, and as the reciprocal is rounded up a fully
+    //lit segment comes out at exactly 255.
+    if (Options & cSegOptModulateSegment) {
+      alpha = (((uint32_t) segval) * segptr->segModRecip) >> 16;
+      Colorvals(backColor, bcRGB);
+      Colorvals(foreColor, fcRGB);
+      foreColor = LEDSegs::Color(
+          BlendChannel(bcRGB[0], fcRGB[0], alpha)
+        , BlendChannel(bcRGB[1], fcRGB[1], alpha)
+        , BlendChannel(bcRGB[2], fcRGB[2], alpha));
+    }
+
+    //What the level means for the segment's LEDs: the lit count for the fill actions, the raw level
+    //for random (compared against the random cutoffs), nothing for static.
+    switch (Action) {
+      case cSegActionRandom: levelKey = SegmentLevels[iSegment]; break;
+      case cSegActionStatic: levelKey = 0; break;
+      default:               levelKey = segval; break;
+    }
+
+    stateptr->segChanged = (levelKey != stateptr->segLastLevel) || (foreColor != stateptr->segLastForeColor) || stateptr->segBackColorChanged ||
+      (reshuffled && (Action == cSegActionRandom));
+    if (stateptr->segChanged) {
+      stateptr->segLastLevel = levelKey;
+      stateptr->segLastForeColor = foreColor;
+      stateptr->segBackColorChanged = false;
+      if (stateptr->segPlanRuns > 0) {anyChanged = true;} //Segments with no LEDs on the strip can't change it
+    }
+  }
+
+  //Nothing changed: the strip already shows this frame
+  if (!anyChanged) {
+    nSkippedFrames++;
+    if (frameSink != NULL) {frameSink->WriteFrame(objPxlStrip->getPixels(), nLEDsInStrip, stripLedType, false);}
+    return false;
+  }
+  if (direct) {PaintDirect();}
+  return true;
+}
+
+/*__________________
+LEDSegs::PaintDirect
+Paint the whole strip from the render plans, for a frame with no composite map: off, then every
+segment's runs bottom up, so the topmost segment that writes an LED has the last word, as it does
+on the map.
+*/
+
+void LEDSegs::PaintDirect() {
+  short iSegment;
+  ledRun *run, *runEnd;
+  segmentState *stateptr;
+
+  memset(objPxlStrip->getPixels(), 0, ((long) nLEDsInStrip) * bytesPerPixel);
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    stateptr = &SegmentState[iSegment];
+    run = &planRuns[stateptr->segPlanFirst];
+    for (runEnd = run + stateptr->segPlanRuns; run < runEnd; run++) {
+      PaintRun(iSegment, run->runFirstLED, run->runStride, run->runCount, run->runFirstVisit, run->runVisitStep);
+    }
+  }
+}
+
+/*_________________
+LEDSegs::PaintSpans
+Second pass of ShowSegments(): repaint the spans, of Count starting at First, whose segments changed
+*/
+
+void LEDSegs::PaintSpans(short First, short Count) {
+  compSpan *span, *spanEnd;
+
+  spanEnd = compSpans + First + Count;
+  for (span = compSpans + First; span < spanEnd; span++) {
+    switch (span->spanOwner) {
+      case cSpanContested: PaintContested(span); break;
+      case cSpanUncovered: if (repaintAll) {PaintSpan(span);}; break;
+      default:             if (repaintAll || SegmentState[span->spanOwner].segChanged) {PaintSpan(span);}; break;
+    }
+  }
+}
+
+/*__________________
+LEDSegs::FinishFrame
+Last pass of ShowSegments()
+*/
+
+void LEDSegs::FinishFrame() {
+  repaintAll = false;
+
+  //Finally, refresh the strip.
+  PROFILE_BEGIN(showStart);
+  if (showStrip) {objPxlStrip->show();}
+  PROFILE_END(showStart, cProfileShow, -1);
+  if (frameSink != NULL) {frameSink->WriteFrame(objPxlStrip->getPixels(), nLEDsInStrip, stripLedType, true);}
+}
+
+/*_________________
+LEDSegs::BuildPlans
+Rebuild the render plan (the runs of physical LEDs, in visit order) for every defined segment.
+
+The visit order is the order the action lights the segment's LEDs as the level rises: up from the
+first LED, down from the last, or alternating outward from the middle (middle, +1, -1, +2, -2...).
+With a spacing of s only every (s+1)th LED is addressed; for from-middle that is every (s+1)th LED
+on each side of the middle, so interleaved segments line up.
+*/
+
+void LEDSegs::BuildPlans() {
+  short iSegment, nRuns, FirstLED, NumberLEDs, segSpacing1, MiddleLED;
+  const stripSegment *segptr;
+  stripSegment segBuf;
+  segmentState *stateptr;
+
+  //One run per segment, or three for from-middle (the middle LED plus one run each way), unless a
+  //physical layout splits them (AddPhysicalRun then makes room)
+  for (nRuns = 0, iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    segptr = Layout(iSegment, &segBuf);
+    if (segptr->segNumLEDs > 0) {nRuns += (segptr->segAction == cSegActionFromMiddle) ? 3 : 1;}
+  }
+  if (nRuns > nPlanRunsAlloc) {
+    delete[] planRuns;
+    planRuns = new ledRun[nRuns];
+    nPlanRunsAlloc = nRuns;
+  }
+
+  nRuns = 0;
+  for (iSegment = 0; iSegment <= segMaxDefinedIndex; iSegment++) {
+    segptr = Layout(iSegment, &segBuf);
+    stateptr = &SegmentState[iSegment];
+    FirstLED = segptr->segFirstLED;
+    NumberLEDs = segptr->segNumLEDs;
+    segSpacing1 = segptr->segSpacing + 1;
+    stateptr->segPlanFirst = nRuns;
+
+    if (NumberLEDs > 0) {
+      switch (segptr->segAction) {
+        case cSegActionFromBottom: //bottom, static and random all run up from the first LED
         case cSegActionRandom:
-        case cSegActionStatic:     LEDIncrement = 1;  iLED = FirstLED; break;
+        case cSegActionStatic:
+          nRuns = AddPlanRun(nRuns, FirstLED, segSpacing1, (NumberLEDs + segSpacing1 - 1) / segSpacing1, 0, segSpacing1);
+          break;
 
-        case cSegActionFromTop:    LEDIncrement = -1; iLED = FirstLED + NumberLEDs - 1; break;
+        case cSegActionFromTop:
+          nRuns = AddPlanRun(nRuns, FirstLED + NumberLEDs - 1, -segSpacing1, (NumberLEDs + segSpacing1 - 1) / segSpacing1, 0, segSpacing1);
+          break;
 
-        case cSegActionFromMiddle: LEDIncrement = 0;  iLED = FirstLED + ((NumberLEDs - 1) >> 1); break;
+        case cSegActionFromMiddle:
+          //LED (middle + d) is visited (2d - 1)th, (middle - d) is visited (2d)th
+          MiddleLED = FirstLED + ((NumberLEDs - 1) >> 1);
+          nRuns = AddPlanRun(nRuns, MiddleLED, 1, 1, 0, 0);
+          nRuns = AddPlanRun(nRuns, MiddleLED + segSpacing1, segSpacing1, (NumberLEDs >> 1) / segSpacing1, (2 * segSpacing1) - 1, 2 * segSpacing1);
+          nRuns = AddPlanRun(nRuns, MiddleLED - segSpacing1, -segSpacing1, ((NumberLEDs - 1) >> 1) / segSpacing1, 2 * segSpacing1, 2 * segSpacing1);
+          break;
       }
+    }
+    stateptr->segPlanRuns = nRuns - stateptr->segPlanFirst;
+  }
+  if (physLayout != NULL) {physLayoutVersion = physLayout->GetVersion();}
+  layoutDirty = false;
+}
 
-      //Init the spacing counter. This counts down from spacing-1 each time it hits 0 (an illuminated LED).
-      //The first LED is always a non-spacer, which is why we init to zero.
+/*_________________
+LEDSegs::AddPlanRun
+Append a run of logical LEDs to planRuns[] at index iRun. Returns the new number of runs. Without a
+physical layout logical LEDs are physical ones; with one, the run is cut where the map's runs
+start and end, and each piece is carried over to the physical LEDs its run maps to (reversed if
+the map's run is). Logical LEDs past the end of the map are dropped.
+*/
 
-      SpacingCount = 0;
-      
-      //Loop across the LEDs in the segment being illuminated.
-      //NOTE: Keep this loop TIGHT! It is run for every LED in every defined segment
-
-      for (iLEDinSegment = 0; iLEDinSegment < NumberLEDs; iLEDinSegment++) {
-
-        //Figure the color we want this LED to be and write it to the LED
-        thisColor = backColor;
-        if (ledval > iLEDinSegment) {thisColor = foreColor;}
-
-        //Determine if this LED is blanked out because of spacing > 1
-        notSpacingLED = (SpacingCount == 0);
-
-        //Write the color value to the strip, but not if...
-        //  1) This is a spacing LED (when segment's spacing value is > 1), or...
-        //  2) The color value is RGBOff and this is a no-off-overwrite-option segment
-        //  3) This is an ActionRandom segment and the level is too low based on the randomizer
-        
-        doled = (notSpacingLED & ((thisColor != RGBOff) | optOffOverwrite));
-        if (doled & (Action == cSegActionRandom)) {
-          if (segRandomLevels[iLEDinSegment & 0x3F] > segptr->segLevel) {doled = false;}
+short LEDSegs::AddPlanRun(short iRun, short FirstLED, short Stride, short Count, short FirstVisit, short VisitStep) {
+  const LEDLayout::layoutRun *mapRun;
+  short iMapRun, nPiece, nSkip, nMapped;
+
+  if (physLayout == NULL) {return AddPhysicalRun(iRun, FirstLED, Stride, Count, FirstVisit, VisitStep);}
+
+  //A run down the strip that starts past the end of the map starts again where the map ends
+  nMapped = physLayout->GetNumLEDs();
+  if ((Stride < 0) && (FirstLED >= nMapped)) {
+    nSkip = (FirstLED - nMapped - Stride) / -Stride;
+    FirstLED += nSkip * Stride;
+    FirstVisit += nSkip * VisitStep;
+    Count -= nSkip;
+  }
+
+  while (Count > 0) {
+    iMapRun = physLayout->FindRun(FirstLED);
+    if (iMapRun < 0) {break;}  //Past the end of the map, as are the rest
+    mapRun = physLayout->GetRun(iMapRun);
+
+    //The LEDs of the run up to the end of the map's run, in the direction the run goes
+    if (Stride > 0) {nPiece = ((mapRun->runLogical + mapRun->runCount - 1 - FirstLED) / Stride) + 1;}
+    else {nPiece = ((FirstLED - mapRun->runLogical) / -Stride) + 1;}
+    nPiece = min(nPiece, Count);
+
+    iRun = AddPhysicalRun(iRun, mapRun->runPhysical + (FirstLED - mapRun->runLogical) * mapRun->runStride,
+      Stride * mapRun->runStride, nPiece, FirstVisit, VisitStep);
+    FirstLED += nPiece * Stride;
+    FirstVisit += nPiece * VisitStep;
+    Count -= nPiece;
+  }
+  return iRun;
+}
+
+/*_____________________
+LEDSegs::AddPhysicalRun
+Append a run of physical LEDs to planRuns[] at index iRun, making room if need be, and dropping any
+LEDs past the end of the strip (runs never go below LED 0). Returns the new number of runs. There
+are at most cMaxPlanRuns; a layout split into more than that has the runs past them left out.
+*/
+
+short LEDSegs::AddPhysicalRun(short iRun, short FirstLED, short Stride, short Count, short FirstVisit, short VisitStep) {
+  ledRun *newRuns;
+  short nSkip, nAlloc;
+
+  if (Stride > 0) {
+    if (FirstLED >= nLEDsInStrip) {Count = 0;}
+    else {Count = min(Count, ((nLEDsInStrip - 1 - FirstLED) / Stride) + 1);}
+  }
+  else if (FirstLED >= nLEDsInStrip) {
+    nSkip = (FirstLED - nLEDsInStrip - Stride) / -Stride;
+    FirstLED += nSkip * Stride;
+    FirstVisit += nSkip * VisitStep;
+    Count -= nSkip;
+  }
+  if (Count <= 0) {return iRun;}
+
+  if (iRun >= nPlanRunsAlloc) {
+    if (iRun >= cMaxPlanRuns) {return iRun;}
+    nAlloc = constrain(2L * nPlanRunsAlloc, 16L, (long) cMaxPlanRuns);  //Doubled in long, so it can't wrap
+    NoteHeapPeak(nAlloc * (long) sizeof(ledRun));   //Old and new runs, while copying
+    nPlanRunsAlloc = nAlloc;
+    newRuns = new ledRun[nPlanRunsAlloc];
+    if (iRun > 0) {memcpy(newRuns, planRuns, iRun * sizeof(ledRun));}
+    delete[] planRuns;
+    planRuns = newRuns;
+  }
+  planRuns[iRun].runFirstLED = FirstLED;
+  planRuns[iRun].runStride = Stride;
+  planRuns[iRun].runCount = Count;
+  planRuns[iRun].runFirstVisit = FirstVisit;
+  planRuns[iRun].runVisitStep = VisitStep;
+  return iRun + 1;
+}
+
+/*_____________________
+LEDSegs::BuildComposite
+Build the composite map (see the class definition) from the render plans.
+
+Segments are walked top down (highest index first), as the top segment is the one that wins an LED.
+ledState[] counts the layers stacked on each LED so far and whether an always-writing (opaque)
+segment has closed it to the segments below. A first pass sizes each LED's stack; the second pass
+emits the owned spans and fills in the contested LEDs' layers; a last scan over the strip emits the
+contested and uncovered spans. The spans are then sorted by LED.
+*/
+
+const unsigned short cStateClosed = 0x8000;   //An opaque segment above hides the LED from the segments below
+const unsigned short cStateFilled = 0x4000;   //Second pass: as cStateClosed
+const unsigned short cStateDepth = 0x3FFF;    //Number of layers on the LED
+
+//qsort() comparison: order spans by their lowest LED
+int LEDSegs::CompareSpans(const void *a, const void *b) {
+  const compSpan *spanA = (const compSpan *) a, *spanB = (const compSpan *) b;
+  long lowA = spanA->spanFirstLED + ((spanA->spanStride < 0) ? ((long) spanA->spanStride) * (spanA->spanCount - 1) : 0);
+  long lowB = spanB->spanFirstLED + ((spanB->spanStride < 0) ? ((long) spanB->spanStride) * (spanB->spanCount - 1) : 0);
+  return (lowA > lowB) - (lowA < lowB);
+}
+
+void LEDSegs::BuildComposite() {
+  unsigned short *ledState;
+  long     *ledLayer;
+  short    iSegment, iLED, k, kRun, iNext, visit;
+  unsigned short segKey;
+  long     nLayers;
+  bool     opaque, random;
+  ledRun   *run, *runEnd;
+  segmentState *stateptr;
+
+  nCompSpans = 0;
+  ledState = new unsigned short[nLEDsInStrip];
+  ledLayer = new long[nLEDsInStrip];
+  heapScratch = nLEDsInStrip * (long) (sizeof(ledState[0]) + sizeof(ledLayer[0]));
+  memset(ledState, 0, nLEDsInStrip * sizeof(ledState[0]));
+
+  //First pass: stack depth of each LED
+  for (iSegment = segMaxDefinedIndex; iSegment >= 0; iSegment--) {
+    stateptr = &SegmentState[iSegment];
+    opaque = SegmentIsOpaque(iSegment);
+    run = &planRuns[stateptr->segPlanFirst];
+    for (runEnd = run + stateptr->segPlanRuns; run < runEnd; run++) {
+      for (k = 0, iLED = run->runFirstLED; k < run->runCount; k++, iLED += run->runStride) {
+        if (ledState[iLED] & cStateClosed) {continue;}
+        ledState[iLED]++;
+        if (opaque) {ledState[iLED] |= cStateClosed;}
+      }
+    }
+  }
+
+  //Lay out the layers of the contested LEDs (anything covered that isn't a single opaque layer)
+  nLayers = 0;
+  for (iLED = 0; iLED < nLEDsInStrip; iLED++) {
+    ledLayer[iLED] = nLayers;
+    if (ledState[iLED] != (cStateClosed | 1)) {nLayers += ledState[iLED] & cStateDepth;}
+  }
+  if (nLayers > nCompLayersAlloc) {
+    delete[] compLayers;
+    compLayers = new compLayer[nLayers];
+    nCompLayersAlloc = nLayers;
+  }
+
+  //Second pass: owned spans, and the layers of the contested LEDs. A random segment's layers keep
+  //the hash of its LEDs' cutoffs, rather than their visit order.
+  for (iSegment = segMaxDefinedIndex; iSegment >= 0; iSegment--) {
+    stateptr = &SegmentState[iSegment];
+    opaque = SegmentIsOpaque(iSegment);
+    random = (GetSegment_Action(iSegment) == cSegActionRandom);
+    segKey = RandomHash(randomKey + iSegment * cRandomKeyStep);
+    run = &planRuns[stateptr->segPlanFirst];
+    for (runEnd = run + stateptr->segPlanRuns; run < runEnd; run++) {
+      kRun = -1; //Start of the owned stretch of this run being collected, if any
+      for (k = 0, iLED = run->runFirstLED; k <= run->runCount; k++, iLED += run->runStride) {
+        if ((k < run->runCount) && !(ledState[iLED] & cStateFilled) && (ledState[iLED] == (cStateClosed | 1))) {
+          //Owned by this segment
+          if (kRun < 0) {kRun = k;}
+          ledState[iLED] |= cStateFilled;
+          continue;
         }
+        if (kRun >= 0) {
+          AddCompSpan(run->runFirstLED + (kRun * run->runStride), run->runStride, k - kRun,
+            run->runFirstVisit + (kRun * run->runVisitStep), run->runVisitStep, iSegment, 0);
+          kRun = -1;
+        }
+        if ((k == run->runCount) || (ledState[iLED] & cStateFilled)) {continue;}
+
+        //Contested: add this segment's layer to the LED's stack
+        visit = run->runFirstVisit + (k * run->runVisitStep);
+        compLayers[ledLayer[iLED]].layerSegment = iSegment;
+        compLayers[ledLayer[iLED]].layerVisit = random ? (short) RandomHash(segKey + visit) : visit;
+        ledLayer[iLED]++;
+        if (opaque) {ledState[iLED] |= cStateFilled;}
+      }
+    }
+  }
+
+  //Contested and uncovered spans. Contested LEDs' layers are consecutive in compLayers[], so a
+  //contested span just records where its first LED's layers start.
+  for (iLED = 0; iLED < nLEDsInStrip; iLED = iNext) {
+    iNext = iLED;
+    if (ledState[iLED] == 0) {
+      while ((iNext < nLEDsInStrip) && (ledState[iNext] == 0)) {iNext++;}
+      AddCompSpan(iLED, 1, iNext - iLED, 0, 0, cSpanUncovered, 0);
+    }
+    else if ((ledState[iLED] & cStateDepth) != 1 || !(ledState[iLED] & cStateClosed)) {
+      nLayers = ledLayer[iLED] - (ledState[iLED] & cStateDepth);
+      while ((iNext < nLEDsInStrip) && (ledState[iNext] != 0) &&
+             (((ledState[iNext] & cStateDepth) != 1) || !(ledState[iNext] & cStateClosed))) {
+        compLayers[ledLayer[iNext] - 1].layerSegment |= cLayerLast;
+        iNext++;
+      }
+      AddCompSpan(iLED, 1, iNext - iLED, 0, 0, cSpanContested, nLayers);
+    }
+    else {iNext++;}
+  }
+
+  NoteHeapPeak(heapScratch);
+  heapScratch = 0;
+  delete[] ledState;
+  delete[] ledLayer;
+  qsort(compSpans, nCompSpans, sizeof(compSpan), CompareSpans);
+}
+
+/*__________________
+LEDSegs::AddCompSpan
+Append a span to the composite map, growing it as needed. Spans never share an LED, so there are
+no more of them than LEDs, and the map never needs to grow past that.
+*/
+
+void LEDSegs::AddCompSpan(short FirstLED, short Stride, short Count, short FirstVisit, short VisitStep, short Owner, long FirstLayer) {
+  compSpan *newSpans;
+  short nAlloc;
+
+  if (nCompSpans >= nCompSpansAlloc) {
+    nAlloc = constrain(2L * nCompSpansAlloc, 16L, (long) nLEDsInStrip);  //Doubled in long, so it can't wrap
+    NoteHeapPeak(heapScratch + nAlloc * (long) sizeof(compSpan));
+    nCompSpansAlloc = nAlloc;
+    newSpans = new compSpan[nCompSpansAlloc];
+    if (nCompSpans > 0) {memcpy(newSpans, compSpans, nCompSpans * sizeof(compSpan));}
+    delete[] compSpans;
+    compSpans = newSpans;
+  }
+  compSpans[nCompSpans].spanFirstLED = FirstLED;
+  compSpans[nCompSpans].spanStride = Stride;
+  compSpans[nCompSpans].spanCount = Count;
+  compSpans[nCompSpans].spanFirstVisit = FirstVisit;
+  compSpans[nCompSpans].spanVisitStep = VisitStep;
+  compSpans[nCompSpans].spanOwner = Owner;
+  compSpans[nCompSpans].spanFirstLayer = FirstLayer;
+  nCompSpans++;
+}
+
+/*________________
+LEDSegs::PaintSpan
+Write an owned or uncovered span
+*/
 
-        if (doled) {objPxlStrip->setPixelColor(iLED, thisColor);}
-   
-        //Move to next LED. For from-middle, we jump back and forth around the center of the segment, increasing
-        //the increment's absolute value by one more each jump.
-
-        if (Action == cSegActionFromMiddle) {
-          if (LEDIncrement <= 0) {
-            LEDIncrement--;
-            if (notSpacingLED) {SpacingCount = segSpacing1;}
-            SpacingCount--;
-          }
-          else {LEDIncrement++;}
-          LEDIncrement = -LEDIncrement;
+void LEDSegs::PaintSpan(const compSpan *span) {
+  if (span->spanOwner == cSpanUncovered) {FillLEDs(span->spanFirstLED, span->spanStride, span->spanCount, RGBOff);}
+  else {PaintRun(span->spanOwner, span->spanFirstLED, span->spanStride, span->spanCount, span->spanFirstVisit, span->spanVisitStep);}
+}
+
+/*_______________
+LEDSegs::PaintRun
+Write the LEDs of a run of a segment's plan (or of an owned span, which is part of one) as the
+segment alone would: LEDs visited before its level cutoff get its foreground color and the rest its
+background; a random segment's LEDs get the foreground where their cutoff is under the level, and
+are left alone elsewhere. Off isn't written by a no-off-overwrite segment.
+*/
+
+void LEDSegs::PaintRun(short iSegment, short FirstLED, short Stride, short Count, short FirstVisit, short VisitStep) {
+  const stripSegment *segptr;
+  stripSegment segBuf;
+  segmentState *stateptr;
+  short    ledval, nLit, k, iLED, visit;
+  unsigned short segKey;
+  uint32_t foreColor, backColor;
+  bool     writeOff;
+
+  segptr = Layout(iSegment, &segBuf);
+  stateptr = &SegmentState[iSegment];
+  writeOff = !(segptr->segOptions & cSegOptNoOffOverwrite);
+  foreColor = stateptr->segLastForeColor;
+  backColor = segptr->segBackColor;
+
+  if (segptr->segAction == cSegActionRandom) {
+    if ((foreColor == RGBOff) && !writeOff) {return;}
+    foreColor = CurveColor(foreColor);
+    segKey = RandomHash(randomKey + iSegment * cRandomKeyStep);
+    for (k = 0, iLED = FirstLED, visit = FirstVisit; k < Count; k++, iLED += Stride, visit += VisitStep) {
+      if (RandomCutoff(segKey, visit) <= stateptr->segLastLevel) {objPxlStrip->setPixelColor(iLED, foreColor);}
+    }
+    return;
+  }
+  ledval = (segptr->segAction == cSegActionStatic) ? segptr->segNumLEDs : stateptr->segLastLevel;
+
+  //Number of the run's LEDs that are visited before the cutoff
+  if (ledval <= FirstVisit) {nLit = 0;}
+  else if (VisitStep == 0) {nLit = Count;}
+  else {nLit = min(Count, ((ledval - FirstVisit - 1) / VisitStep) + 1);}
+
+  if ((foreColor != RGBOff) || writeOff) {FillLEDs(FirstLED, Stride, nLit, CurveColor(foreColor));}
+  if ((backColor != RGBOff) || writeOff) {FillLEDs(FirstLED + nLit * Stride, Stride, Count - nLit, CurveColor(backColor));}
+}
+
+/*_______________
+LEDSegs::FillLEDs
+Write a run of one color straight into the strip's buffer. The strip encodes the color once, into
+the first LED (so its color order and brightness apply as they would to any LED), and the rest are
+copies of those bytes: doubling memcpy()s for a long contiguous run, and a copy per LED for a short
+or spaced one. Off is all zero bytes in any order and at any brightness, so it needs no encoding at
+all.
+*/
+
+void LEDSegs::FillLEDs(short FirstLED, short Stride, short Count, uint32_t Color) {
+  byte *first, *dest;
+  long nDone, nBytes, nCopy, step;
+  short k;
+
+  if (Count <= 1) {  //Nothing to copy
+    if (Count == 1) {objPxlStrip->setPixelColor(FirstLED, Color);}
+    return;
+  }
+  if (Stride < 0) {  //The same LEDs, the other way round
+    FirstLED += (Count - 1) * Stride;
+    Stride = -Stride;
+  }
+  first = objPxlStrip->getPixels() + ((long) FirstLED) * bytesPerPixel;
+
+  //A long contiguous run: memset(), or doubling memcpy()s
+  nBytes = ((long) Count) * bytesPerPixel;
+  if ((Stride == 1) && (nBytes > cFillCopyBytes)) {
+    if (Color == RGBOff) {
+      memset(first, 0, nBytes);
+      return;
+    }
+    objPxlStrip->setPixelColor(FirstLED, Color);
+    for (nDone = bytesPerPixel; nDone < nBytes; nDone += nCopy) {
+      nCopy = min(nDone, nBytes - nDone);
+      memcpy(first + nDone, first, nCopy);
+    }
+    return;
+  }
+
+  //A short or spaced run: a copy per LED
+  step = ((long) Stride) * bytesPerPixel;
+  if (Color == RGBOff) {
+    for (k = 0, dest = first; k < Count; k++, dest += step) {
+      dest[0] = dest[1] = dest[2] = 0;
+      if (bytesPerPixel == 4) {dest[3] = 0;}
+    }
+    return;
+  }
+  objPxlStrip->setPixelColor(FirstLED, Color);
+  for (k = 1, dest = first + step; k < Count; k++, dest += step) {
+    dest[0] = first[0];
+    dest[1] = first[1];
+    dest[2] = first[2];
+    if (bytesPerPixel == 4) {dest[3] = first[3];}
+  }
+}
+
+/*_____________________
+LEDSegs::PaintContested
+Resolve and write the LEDs of a contested span. Each LED's layers are tried top down; the first
+segment that writes the LED this frame decides its color, and an LED no layer writes is off.
+Only LEDs where a layer that was looked at changed are written.
+*/
+
+void LEDSegs::PaintContested(const compSpan *span) {
+  const compLayer *layer;
+  const stripSegment *segptr = NULL;
+  stripSegment segBuf;
+  segmentState *stateptr;
+  short    k, iLED, ledval;
+  unsigned short iSegment, lastSegment = cLayerLast;
+  uint32_t thisColor;
+  bool     changed, written;
+
+  layer = &compLayers[span->spanFirstLayer];
+  for (k = 0, iLED = span->spanFirstLED; k < span->spanCount; k++, iLED++) {
+    changed = repaintAll;
+    written = false;
+    thisColor = RGBOff;
+    do {
+      iSegment = layer->layerSegment & ~cLayerLast;
+      if (!written) {
+        if (iSegment != lastSegment) {  //Neighbouring LEDs mostly have the same layers
+          segptr = Layout(iSegment, &segBuf);
+          lastSegment = iSegment;
+        }
+        stateptr = &SegmentState[iSegment];
+        changed |= stateptr->segChanged;
+        if (segptr->segAction == cSegActionRandom) {
+          //All LEDs are foreground, but only those whose random cutoff is under the level are written
+          thisColor = stateptr->segLastForeColor;
+          written = ((((unsigned short) layer->layerVisit) >> 6) <= stateptr->segLastLevel);  //The layer keeps the hash
         }
         else {
-          if (notSpacingLED) {SpacingCount = segSpacing1;}
-          SpacingCount--;
+          ledval = (segptr->segAction == cSegActionStatic) ? segptr->segNumLEDs : stateptr->segLastLevel;
+          thisColor = (layer->layerVisit < ledval) ? stateptr->segLastForeColor : segptr->segBackColor;
+          written = true;
         }
+        //An RGBOff LED is not written in a no-off-overwrite segment
+        if ((thisColor == RGBOff) && (segptr->segOptions & cSegOptNoOffOverwrite)) {written = false;}
+        if (!written) {thisColor = RGBOff;}
+      }
+    } while (!((layer++)->layerSegment & cLayerLast));
 
-        iLED += LEDIncrement;
-      } //LED-in-segment loop
-    } //If an action defined
-  }  //Segment loop
-
-  //Finally, refresh the strip.
-  objPxlStrip->show();
+    if (changed) {objPxlStrip->setPixelColor(iLED, CurveColor(thisColor));}
+  }
 }
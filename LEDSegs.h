@@ -8,10 +8,16 @@
  #include "WProgram.h"
 #endif
 
-#include "Adafruit_NeoPixel.h"
+//Uncomment (or define on the compiler command line) to time each stage of a frame. See LEDProfile.h.
+//#define LEDSEGS_PROFILE
 
-//Total spectrum analyzer shield bands and max value for a band read. Do not change this.
-const short cSegNumBands=7;
+#include "Adafruit_NeoPixel.h"
+#include "LEDSpectrum.h"
+#include "LEDFrameSink.h"
+#include "LEDLayout.h"
+#ifdef LEDSEGS_PROFILE
+ #include "LEDProfile.h"
+#endif
 
 //Frequency band index values bit values. Bit 0 (0x1) is the lowest freq., bit 7 (0x40) is highest.
 //These are fixed by the spectrum analyzer chip used on the shield, and the number of bands cannot be changed.
@@ -25,16 +31,7 @@ const short cSegBand5 = 0x10;  //2.5KHz
 const short cSegBand6 = 0x20;  //6.25KHz - Think about omitting this (6KHz is a pretty high "audible" freq.)
 const short cSegBand7 = 0x40;  //16KHz - I REALLY recommend omitting this one, just noise energy.
 
-//Software gain control constants. This provides a simple 'fast attack'/'slow decay' AGC for the input.
-//InitialMax is the lowest spectrum band value to which AGC processing will apply. (AGC is applied
-//separately to each of the seven spectrum bands.) As each sample is read, a fixed, assumed noise
-//value is subtracted, then the max value seen for that channel is updated, but only when it is above MaxBandValue.
-//Then the sampled value is scaled to the range (0..MaxSegmentLevel) using the actual max seen for that channel
-//so far. The decay constant is subtracted from each channel's max on each display cycle. This sample normalization
-//is applied before any custom display routine is called.
-
-const static short cInitialMaxBandValue = 200; //Lowest max value allowed (0..1023) Normalized, after noise deduction.
-const static short cMaxBandValueDecay = 2;     //Subtracted from detected max on each sample cycle
+//The AGC (see LEDSpectrum.h) scales each band to the range 0..cMaxSegmentLevel
 const short cMaxSegmentLevel = 1023;           //Normalized max sample value coming out of MapBandsToSegments()
 
 //LEDSegs Segment actions. See DefineSegment and SetSegment_Action.
@@ -51,9 +48,18 @@ const short cSegActionRandom = 5;      //Illuminate foreground color randomly th
 const short cSegOptNoOffOverwrite = 0x01;
 const short cSegOptModulateSegment = 0x02;
 const short cSegOptInvertLevel = 0x04;
+const short cSegOptLeftChannel = 0x08;   //Follow the left channel only, rather than the mix DisplaySpectrum() asks for
+const short cSegOptRightChannel = 0x10;  //Follow the right channel only (with cSegOptLeftChannel: the mix)
+
+//Segment programs live in flash. On AVR flash is its own address space, so the library copies each
+//segment out of it as it is used.
+#if defined(__AVR__) && !defined(LEDSEGS_FLASH_COPY)
+  #define LEDSEGS_FLASH_COPY
+#endif
 
 //Max # of segments that can be defined for a strip. Segments are "written" to the strip in index order.
 //So higher-index segments can overwrite part or all of an lower-index segment.
+//This is the capacity of a plain LEDSegs object. Use LEDSegsN<n> (below) to size a strip for n segments.
 
 #ifndef cMaxSegments
   #define cMaxSegments 100
@@ -64,57 +70,194 @@ const short cSegOptInvertLevel = 0x04;
 
 typedef void (*SegmentDisplayRoutine) (short iSegment);
 
+//The prototype for a routine that gets every segment's level at once, each frame (see SetLevelRoutine).
+//Levels[i] is segment i's level, 0..cMaxSegmentLevel, and can be changed in place.
+
+typedef void (*LevelBatchRoutine) (short *Levels, short nSegments);
+
+//Level transforms (see SetLevelTransform). A transform's curve is sampled every 16 levels, from 0 to
+//1024, and interpolated in between. Segments refer to transforms by number, 1..cMaxLevelTransforms;
+//0 is none.
+
+const short cLevelCurvePoints = 65;
+const byte cMaxLevelTransforms = 4;
+const short cMaxLevelSteps = cLevelCurvePoints / 2;   //Points of a transform that steps (kept in its curve)
+
 //Our LED strip class.
 
 class LEDSegs {
   
   public:
 
-    //Constructor and destructor
-    LEDSegs(short nLEDs, short ledType) {LEDSegsInit(nLEDs, 6, ledType);}  //Constructor with default data
-    LEDSegs(short nLEDs, short pinData, short ledType) {LEDSegsInit(nLEDs, pinData, ledType);}  //Constructor with explicit data
-    ~LEDSegs() {delete[] objPxlStrip;}
+    //Constructor and destructor. These make room for up to cMaxSegments segments, a few at a time as
+    //they are defined.
+    LEDSegs(short nLEDs, short ledType) {SetSegmentStorage(NULL, NULL, NULL, cMaxSegments, cMaxSegments); LEDSegsInit(nLEDs, 6, ledType);}  //Constructor with default data
+    LEDSegs(short nLEDs, short pinData, short ledType) {SetSegmentStorage(NULL, NULL, NULL, cMaxSegments, cMaxSegments); LEDSegsInit(nLEDs, pinData, ledType);}  //Constructor with explicit data
+    ~LEDSegs();
     void LEDSegsInit(short, short, short);  //Common constructor code
     
     void DisplaySpectrum(bool, bool);
     void ResetStrip();
-    void ResetRandom();
+
+    //Reshuffle the cSegActionRandom LEDs from Seed (0 for a seed from micros()). Each LED's cutoff
+    //level is a hash of the seed, its segment and its place in the segment, so the pattern doesn't
+    //repeat along a segment of any length, and there is nothing to store per LED. GetRandomSeed()
+    //is the seed last used, so a replay (see LEDSpectrumTrace.h) can repeat it.
+    void ResetRandom(unsigned long Seed = 0);
+    unsigned long GetRandomSeed() {return randomSeedUsed;}
+
+    //Reshuffle the random LEDs by themselves every nFrames frames (1 for every frame), for a sparkle
+    //that moves even while the level holds. 0 (the default) keeps them until ResetRandom(). The
+    //reshuffles follow from the seed, so a replay repeats them too.
+    void SetRandomReshuffle(unsigned short nFrames) {reshuffleFrames = nFrames; reshuffleCount = 0;}
+    unsigned short GetRandomReshuffle() {return reshuffleFrames;}
+
+    //The three stages DisplaySpectrum() runs, in order. Exposed so they can be driven (and timed) separately.
+    void ReadSpectrum(bool, bool);
+    void MapBandsToSegments();
+    void ShowSegments();
+
+    //The sampled spectrum the strip displays. Each strip starts with one of its own; give several
+    //strips the same one to have them all follow one read of the shield (see LEDSpectrum.h). NULL
+    //goes back to a spectrum of the strip's own.
+    void SetSpectrum(LEDSpectrum *Spectrum);
+    LEDSpectrum *GetSpectrum() {return spectrum;}
+
+    //Asynchronous spectrum acquisition. When on, ReadSpectrum() hands over the sample read in the
+    //background and starts reading the next one from the ADC-complete interrupt, so the sampling
+    //overlaps the rendering and show() of the frame. Only AVR boards built with LEDSEGS_ADC_ISR (see
+    //LEDSpectrum.h), and the host build, have it; elsewhere SetAsyncSpectrum() returns false and
+    //reads stay synchronous. It also returns false while another spectrum has it on, as only one
+    //can at a time. Don't use analogRead() while it is on.
+    bool SetAsyncSpectrum(bool enable) {return spectrum->SetAsync(enable);}
+    bool GetAsyncSpectrum() {return spectrum->GetAsync();}
+
+    //Where ReadSpectrum() gets the band levels. NULL (the default) is the spectrum analyzer shield;
+    //otherwise the source is read instead, e.g. an LEDPCMAnalyzer working on PCM audio.
+    //The source's noise floors replace the shield's. This sets the source of the strip's spectrum,
+    //so it applies to every strip sharing it.
+    void SetSpectrumSource(LEDSpectrumSource *Source) {spectrum->SetSource(Source);}
+    LEDSpectrumSource *GetSpectrumSource() {return spectrum->GetSource();}
+
+#ifdef LEDSEGS_PROFILE
+    //Stage timings for this strip (LEDProfile.h): GetProfiler().Dump(Serial) prints them
+    LEDProfiler &GetProfiler() {return profiler;}
+#endif
+
+    //ShowSegments() only repaints LEDs whose segments changed since the last frame, and skips show()
+    //entirely when nothing changed. GetSkippedFrames() counts the frames that were skipped.
+    //Call RefreshAll() if you write to the NeoPixel strip yourself, to force a full repaint.
+    unsigned long GetSkippedFrames() {return nSkippedFrames;}
+    void RefreshAll() {repaintAll = true;}
+
+    //ShowSegments() in its three steps, for renderers that paint a strip from several threads (see
+    //extras/host/HostEngine.h). PrepareFrame() resolves this frame's segments, and returns false if
+    //there is nothing to paint. PaintSpans() paints a range of the strip's spans (runs of LEDs in LED
+    //order, GetNumSpans() of them, GetSpanLEDs() LEDs each). Spans never share an LED, so different
+    //ranges can be painted at the same time. FinishFrame() then shows the strip. On a frame whose
+    //layout changed PrepareFrame() paints the whole strip itself, and there are no spans.
+    bool PrepareFrame();
+    void PaintSpans(short First, short Count);
+    void FinishFrame();
+    short GetNumSpans() {return nCompSpans;}
+    short GetSpanLEDs(short iSpan) {return compSpans[iSpan].spanCount;}
+
+    //Output color curve. Segment colors are 7 bits per channel (0..127). With a curve set, each channel
+    //is mapped through a table to the strip's 8-bit range as LEDs are written: gamma corrected if Gamma
+    //is true (so perceived brightness follows the level), then scaled by Brightness (0..255). A channel
+    //that isn't 0 never maps to fully off. ClearColorCurve() writes the colors as they are again.
+    void SetColorCurve(byte Brightness, bool Gamma);
+    void ClearColorCurve();
+
+    //Frame sink. Each frame, including those where nothing changed, is also handed to Sink
+    //(LEDFrameSink.h), e.g. an LEDFrameStream sending it to a host for preview. With ShowStrip false
+    //the strip itself isn't shown, to preview a layout with no strip attached. NULL for none.
+    void SetFrameSink(LEDFrameSink *Sink, bool ShowStrip = true) {frameSink = Sink; showStrip = ShowStrip;}
+    LEDFrameSink *GetFrameSink() {return frameSink;}
+
+    //Physical layout. With a layout set, segments are placed on its logical LEDs, which it maps to
+    //the strip's (see LEDLayout.h); logical LEDs past the end of the map aren't shown. The map is
+    //folded into the render plans, which are rebuilt when it changes. It belongs to the strip and
+    //is kept by ResetStrip(). NULL (the default) places segments on the strip's LEDs as they are.
+    void SetPhysicalLayout(LEDLayout *Layout) {if (Layout != physLayout) {physLayout = Layout; layoutDirty = true;}}
+    LEDLayout *GetPhysicalLayout() {return physLayout;}
+
+    //The underlying NeoPixel strip object
+    Adafruit_NeoPixel *GetPixelStrip() {return objPxlStrip;}
+    short GetNumLEDs() {return nLEDsInStrip;}
+
+    //Segment capacity
+    short GetMaxSegments() {return nSegmentsMax;}
+
+    //SRAM this strip holds on the heap now: the NeoPixel strip and its pixels, segment storage it
+    //allocated, its own spectrum, the render plans, composite map, band masks, color curve and level
+    //transforms. GetPeakHeapBytes() is the most it has held at once, including the scratch used
+    //while the composite map is built (6 bytes an LED on AVR) and arrays being grown. Neither counts
+    //the object itself (sizeof) or the allocator's few bytes of overhead per block.
+    long GetHeapBytes();
+    long GetPeakHeapBytes() {return max(heapPeak, GetHeapBytes());}
     
-    void SetSegmentIndex(short Idx) {segCurrentIndex = constrain(Idx, 0, cMaxSegments - 1);}
+    void SetSegmentIndex(short Idx) {segCurrentIndex = constrain(Idx, 0, nSegmentsMax - 1);}
     short GetSegmentIndex() {return segCurrentIndex;}
 
-    //The SetSegment_xxx routines are overloaded. The segment # parameter can be omitted and defaults to the current index
+    //The SetSegment_xxx routines are overloaded. The segment # parameter can be omitted and defaults to the current index.
+    //Changing a segment of a program loaded with LoadProgram() first copies the program to SRAM (see below).
+    //A value out of the range its field holds (see stripSegment) is ignored, like a negative one.
+
+    const static short cMaxSegmentBands = 0xFF;    //segBands, a byte (only the cSegBandN bits are used)
+    const static short cMaxSegmentOptions = 0x1F;  //All the cSegOpt bits
+    const static short cMaxSegmentSpacing = 0xFF;  //segSpacing, a byte
     
-    void SetSegment_Action(short nSegment, short Action) {if (Action >= 0) {SegmentData[nSegment].segAction = Action;};}
+    void SetSegment_Action(short nSegment, short Action) {if ((Action >= 0) && (Action <= cSegActionRandom) && (Action != GetSegment_Action(nSegment)) && WritableSegment(nSegment)) {layoutDirty = true; SegmentData[nSegment].segAction = Action;};}
     void SetSegment_Action(short Action) {SetSegment_Action(segCurrentIndex, Action);}
-    void SetSegment_BackColor(short nSegment, uint32_t BackColor) {if (BackColor != 0xFFFFFFFF) {SegmentData[nSegment].segBackColor = BackColor;};}
+    void SetSegment_BackColor(short nSegment, uint32_t BackColor) {if ((BackColor != 0xFFFFFFFF) && (BackColor != GetSegment_BackColor(nSegment)) && WritableSegment(nSegment)) {SegmentState[nSegment].segBackColorChanged = true; SegmentData[nSegment].segBackColor = BackColor;};}
     void SetSegment_BackColor(uint32_t BackColor) {SetSegment_BackColor(segCurrentIndex, BackColor);}
-    void SetSegment_Bands(short nSegment, short Bands) {if (Bands >= 0) {SegmentData[nSegment].segBands = Bands;};}
+    void SetSegment_Bands(short nSegment, short Bands) {if ((Bands >= 0) && (Bands <= cMaxSegmentBands) && (Bands != GetSegment_Bands(nSegment)) && WritableSegment(nSegment)) {masksDirty = true; SegmentData[nSegment].segBands = Bands;};}
     void SetSegment_Bands(short Bands) {SetSegment_Bands(segCurrentIndex, Bands);}
-    void SetSegment_DisplayRoutine(short nSegment, SegmentDisplayRoutine Routine) {SegmentData[nSegment].segDisplayRoutine = *Routine;}
+    void SetSegment_DisplayRoutine(short nSegment, SegmentDisplayRoutine Routine) {if ((Routine != GetSegment_DisplayRoutine(nSegment)) && WritableSegment(nSegment)) {SegmentData[nSegment].segDisplayRoutine = Routine;};}
     void SetSegment_DisplayRoutine(SegmentDisplayRoutine Routine) {SetSegment_DisplayRoutine(segCurrentIndex, Routine);}
-    void SetSegment_FirstLED(short nSegment, short FirstLED) {if (FirstLED >= 0) {SegmentData[nSegment].segFirstLED = FirstLED;};}
+    void SetSegment_FirstLED(short nSegment, short FirstLED) {if ((FirstLED >= 0) && (FirstLED != GetSegment_FirstLED(nSegment)) && WritableSegment(nSegment)) {layoutDirty = true; SegmentData[nSegment].segFirstLED = FirstLED;};}
     void SetSegment_FirstLED(short FirstLED) {SetSegment_FirstLED(segCurrentIndex, FirstLED);}
-    void SetSegment_ForeColor(short nSegment, uint32_t ForeColor) {if (ForeColor != 0xFFFFFFFF) {SegmentData[nSegment].segForeColor = ForeColor;};}
+    void SetSegment_ForeColor(short nSegment, uint32_t ForeColor) {if ((ForeColor != 0xFFFFFFFF) && (ForeColor != GetSegment_ForeColor(nSegment)) && WritableSegment(nSegment)) {SegmentData[nSegment].segForeColor = ForeColor;};}
     void SetSegment_ForeColor(uint32_t ForeColor) {SetSegment_ForeColor(segCurrentIndex, ForeColor);}
-    void SetSegment_Level(short nSegment, short level) {SegmentData[nSegment].segLevel = level;}
+    void SetSegment_Level(short nSegment, short level) {if ((level >= 0) && (level <= cMaxSegmentLevel) && (nSegment >= 0) && (nSegment < nSegmentsAlloc)) {SegmentLevels[nSegment] = level;};}
     void SetSegment_Level(short level) {SetSegment_Level(segCurrentIndex, level);}
-    void SetSegment_NumLEDs(short nSegment, short nLEDs) {if (nLEDs >= 0) {SegmentData[nSegment].segNumLEDs = nLEDs;};}
+    void SetSegment_NumLEDs(short nSegment, short nLEDs) {if ((nLEDs >= 0) && (nLEDs != GetSegment_NumLEDs(nSegment)) && WritableSegment(nSegment)) {layoutDirty = true; SegmentData[nSegment].segNumLEDs = nLEDs; SegmentData[nSegment].segModRecip = ModRecip(nLEDs);};}
     void SetSegment_NumLEDs(short nLEDs) {SetSegment_NumLEDs(segCurrentIndex, nLEDs);}
-    void SetSegment_Options(short nSegment, short Options) {if (Options >= 0) {SegmentData[nSegment].segOptions = Options;};}
+    void SetSegment_Options(short nSegment, short Options) {if ((Options >= 0) && (Options <= cMaxSegmentOptions) && (Options != GetSegment_Options(nSegment)) && WritableSegment(nSegment)) {layoutDirty = masksDirty = true; SegmentData[nSegment].segOptions = Options;};}
     void SetSegment_Options(short Options) {SetSegment_Options(segCurrentIndex, Options);}
-    void SetSegment_Spacing(short nSegment, short Spacing) {if (Spacing >= 0) {SegmentData[nSegment].segSpacing = Spacing;};}
+    void SetSegment_Spacing(short nSegment, short Spacing) {if ((Spacing >= 0) && (Spacing <= cMaxSegmentSpacing) && (Spacing != GetSegment_Spacing(nSegment)) && WritableSegment(nSegment)) {layoutDirty = true; SegmentData[nSegment].segSpacing = Spacing;};}
     void SetSegment_Spacing(short Spacing) {SetSegment_Spacing(segCurrentIndex, Spacing);}
-
-    short    GetSegment_Action(short nSegment)    {return SegmentData[nSegment].segAction;}
-    uint32_t GetSegment_BackColor(short nSegment) {return SegmentData[nSegment].segBackColor;}
-    short    GetSegment_Bands(short nSegment)     {return SegmentData[nSegment].segBands;}
-    short    GetSegment_FirstLED(short nSegment)  {return SegmentData[nSegment].segFirstLED;}
-    uint32_t GetSegment_ForeColor(short nSegment) {return SegmentData[nSegment].segForeColor;}
-    short    GetSegment_Level(short nSegment)     {return SegmentData[nSegment].segLevel;}
-    short    GetSegment_NumLEDs(short nSegment)   {return SegmentData[nSegment].segNumLEDs;}
-    short    GetSegment_Options(short nSegment)   {return SegmentData[nSegment].segOptions;}
-    short    GetSegment_Spacing(short nSegment)   {return SegmentData[nSegment].segSpacing;}
+    void SetSegment_Transform(short nSegment, short Transform) {if ((Transform >= 0) && (Transform <= cMaxLevelTransforms) && (Transform != GetSegment_Transform(nSegment)) && WritableSegment(nSegment)) {masksDirty = true; SegmentData[nSegment].segTransform = Transform;};}
+    void SetSegment_Transform(short Transform) {SetSegment_Transform(segCurrentIndex, Transform);}
+
+    short    GetSegment_Action(short nSegment)    {stripSegment seg; return Layout(nSegment, &seg)->segAction;}
+    uint32_t GetSegment_BackColor(short nSegment) {stripSegment seg; return Layout(nSegment, &seg)->segBackColor;}
+    short    GetSegment_Bands(short nSegment)     {stripSegment seg; return Layout(nSegment, &seg)->segBands;}
+    SegmentDisplayRoutine GetSegment_DisplayRoutine(short nSegment) {stripSegment seg; return Layout(nSegment, &seg)->segDisplayRoutine;}
+    short    GetSegment_FirstLED(short nSegment)  {stripSegment seg; return Layout(nSegment, &seg)->segFirstLED;}
+    uint32_t GetSegment_ForeColor(short nSegment) {stripSegment seg; return Layout(nSegment, &seg)->segForeColor;}
+    short    GetSegment_Level(short nSegment)     {return ((nSegment >= 0) && (nSegment < nSegmentsAlloc)) ? SegmentLevels[nSegment] : 0;}
+    short    GetSegment_NumLEDs(short nSegment)   {stripSegment seg; return Layout(nSegment, &seg)->segNumLEDs;}
+    short    GetSegment_Options(short nSegment)   {stripSegment seg; return Layout(nSegment, &seg)->segOptions;}
+    short    GetSegment_Spacing(short nSegment)   {stripSegment seg; return Layout(nSegment, &seg)->segSpacing;}
+    short    GetSegment_Transform(short nSegment) {stripSegment seg; return Layout(nSegment, &seg)->segTransform;}
+
+    //Level transforms. MapBandsToSegments() passes the level of each segment with a transform (see
+    //SetSegment_Transform) through it, all in one pass, before any display routine is called:
+    //inverted first if Invert, then mapped through the piecewise-linear curve that goes through the
+    //points (CurveIn[i], CurveOut[i]) (CurveIn ascending, flat beyond the ends, a straight line if
+    //nPoints is 0), then clamped to Min..Max. With Steps the level doesn't slide between the points
+    //but steps: it is CurveOut[i] from CurveIn[i - 1] up to just below CurveIn[i] (up to
+    //cMaxLevelSteps points). Returns false if iTransform isn't 1..cMaxLevelTransforms, or there are
+    //too many steps. Transforms belong to the strip and are kept by ResetStrip().
+    bool SetLevelTransform(byte iTransform, const short *CurveIn, const short *CurveOut, short nPoints,
+      short Min = 0, short Max = cMaxSegmentLevel, bool Invert = false, bool Steps = false);
+    void ClearLevelTransform(byte iTransform);
+
+    //A routine called with all the segments' levels each frame, after the transforms and before the
+    //display routines, for level logic that is easier over the whole strip at once. NULL for none.
+    void SetLevelRoutine(LevelBatchRoutine Routine) {levelRoutine = Routine;}
 
     //Initialize a new segment and return the index # of the segment defined.
     //You can set spectrum bands to -1 to include all bands, or 0 to not modulate according to audio level at all
@@ -126,8 +269,49 @@ class LEDSegs {
       , short     /* Bitmask of cSegBandN spectrum band specs, to be averaged together to make this segment's value */
     );
  
+    //Segment layout. What defines a segment (which rarely changes) is kept apart from the levels and
+    //change tracking that are rewritten every frame. Fields are as small as their ranges allow, as
+    //there is one of each per segment and SRAM is tight on the smaller boards.
+    struct stripSegment {
+      uint32_t segForeColor;     //The base color of the segment's LEDs
+      uint32_t segBackColor;     //Background color
+      uint32_t segModRecip;      //(255 << 16) / segNumLEDs, rounded up, for the cSegOptModulateSegment blend (see PrepareFrame)
+      SegmentDisplayRoutine segDisplayRoutine;  //Optional routine to call just before each display cycle
+      short segFirstLED;         //The first LED in the segment from the beginning (0-origin)
+      short segNumLEDs;          //The number of LEDs in the segment
+      byte  segBands;            //The spectrum bands that are averaged together to make up the value for the segment
+      byte  segAction : 3;       //The way the LEDs in the segment are populated (cSegAction...)
+      byte  segOptions : 5;      //Options for the segment (cSegOpt...)
+      byte  segSpacing;          //Spacing between LEDs that are illuminated in the segment (0 default = no spacing)
+      byte  segTransform;        //Level transform applied to the segment's level (see SetLevelTransform), 0 for none
+    };
+
+    //Segment programs. A layout that never changes can be declared as a table of ProgramSegment()s,
+    //built at compile time and kept in flash (PROGMEM) on AVR, and rendered from there:
+    //
+    //  const LEDSegs::stripSegment Interleaved[] PROGMEM = {
+    //    LEDSegs::ProgramSegment(0, 30, cSegActionFromBottom, RGBRed, cSegBand2 | cSegBand3, RGBOff, 0, 1),
+    //    LEDSegs::ProgramSegment(1, 29, cSegActionFromTop, RGBGreen, cSegBand4 | cSegBand5, RGBOff, 0, 1),
+    //  };
+    //  strip->LoadProgram(Interleaved);
+    //
+    //Loading a program takes the place of ResetStrip() and DefineSegment(): no segment is copied, the
+    //segments' SRAM layout storage isn't used (and can be left out, see LEDSegsN), and the new layout
+    //shows on the next frame. The first SetSegment_xxx() or DefineSegment() that changes the layout
+    //copies the program into the SRAM storage and carries on from there; without room for it the
+    //change is ignored. ResetStrip() unloads the program. The render plans and composite map are
+    //still built on the heap from the new layout, as for any other (see ShowSegments).
+    static constexpr stripSegment ProgramSegment(short FirstLED, short nLEDs, short Action, uint32_t ForeColor, short Bands,
+        uint32_t BackColor = 0, short Options = 0, short Spacing = 0, SegmentDisplayRoutine Routine = NULL, byte Transform = 0) {
+      return {ForeColor, BackColor, ModRecip(nLEDs), Routine, FirstLED, nLEDs, (byte) Bands, (byte) Action, (byte) Options, (byte) Spacing, Transform};
+    }
+    void LoadProgram(const stripSegment *Program, short nSegments);
+    template <size_t nSegments> void LoadProgram(const stripSegment (&Program)[nSegments]) {LoadProgram(Program, nSegments);}
+    const stripSegment *GetProgram() {return flashProgram;}  //The loaded program, or NULL if the layout is in SRAM
+ 
     //Methods that match Adafruit_NeoPixel member functions, except declared static and does not set the high bit.  Return value is packed RGB value in long int.
-    static uint32_t Color(byte r, byte g, byte b) {
+    //constexpr, so the colors below can go in segment programs stored in flash
+    static constexpr uint32_t Color(byte r, byte g, byte b) {
       //return ((uint32_t)(g) << 16) | ((uint32_t)(r) <<  8) | b;
       return ((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | b;
     }
@@ -140,51 +324,240 @@ class LEDSegs {
       rgbvals[2] = (Color & 0x7F);
     }
 
-  private:
-    const static short cSpectrumReset=5;
-    const static short cSpectrumStrobe=4;
-    
-    struct stripSegment {
-      short segFirstLED;    //The first LED in the segment from the beginning (0-origin)
-      short segNumLEDs;  //The number of LEDs in the segment
-      uint32_t segForeColor;     //The base color of the segment's LEDs
-      uint32_t segBackColor;     //Background color
-      short segBands;       //The spectrum bands that are averaged together to make up the value for the segment
-      short segAction;      //The way the LEDs in the segment are populated
-      short segSpacing;     //Spacing between LEDs that are illuminated in the segment (0 default = no spacing)
-      short segOptions;     //Options for the segment (cSegOpt...)
-      SegmentDisplayRoutine segDisplayRoutine;  //Optional routine to call just before each display cycle
-      short segLevel, segMaxLevel;       //Normalized & max level -- output from MapBandsToSegments
+    //The 16-bit hash the random cutoffs come from (see cSegActionRandom). It is one-to-one.
+    static unsigned short RandomHash(unsigned short x) {
+      x ^= x >> 8; x *= 0x88B5U;
+      x ^= x >> 7; x *= 0xDB2DU;
+      return x ^ (x >> 9);
+    }
+
+  protected:
+    //Per-frame segment state, and what is derived from the layout when it changes. The levels, which
+    //the level stages work through in one pass, are an array of their own.
+    struct segmentState {
+      uint32_t segLastForeColor; //Resolved (modulated) foreground color on the last frame drawn
+      short segLastLevel;        //What the level resolved to on the last frame drawn (see ShowSegments)
+      short segPlanFirst;        //First of this segment's runs in planRuns[] (see BuildPlans)
+      short segPlanRuns;         //Number of runs in the segment's render plan
+      byte  segMaskSlot;         //Index of the segment's band mask in maskTable[] (see BuildMaskTable)
+      byte  segTransform;        //The layout's segTransform (see BuildMaskTable)
+      bool  segChanged : 1;      //Level or colors differ from the last frame drawn
+      bool  segBackColorChanged : 1; //Background color set since the last frame drawn
     };
 
+    //For LEDSegsN: the segment storage lives in the derived object
+    LEDSegs(short nLEDs, short pinData, short ledType, stripSegment *Layout, segmentState *State, short *Levels, short nSegments, short nLayouts) {
+      SetSegmentStorage(Layout, State, Levels, nSegments, nLayouts);
+      LEDSegsInit(nLEDs, pinData, ledType);
+    }
+
+  private:
     short segCurrentIndex;    //The "current" (default) index that will be modified
     short segMaxDefinedIndex; //Tracks the highest index defined
-    stripSegment SegmentData[cMaxSegments];  //The segment array
-    
-    //The per-band level from the spectrum analyzer for the current sample (see ReadSpectrum)
-    short SpectrumLevel[cSegNumBands];
+    stripSegment *SegmentData;  //The segment arrays (layout, per-frame state)
+    segmentState *SegmentState;
+    short *SegmentLevels;       //Normalized level of each segment -- output from MapBandsToSegments
+    short nSegmentsMax;         //Capacity of the segment arrays
+    short nLayoutsMax;          //Capacity of SegmentData[]: nSegmentsMax, or 0 for a strip that only plays programs
+    short nSegmentsAlloc;       //Segments the arrays have room for now: up to nSegmentsMax, grown as they are
+    short nLayoutsAlloc;        //defined when we allocated them (see GrowSegments), else their capacity
+    bool ownSegmentStorage;     //The arrays were allocated by us, rather than supplied by LEDSegsN
+    const static short cSegmentsGrowStep = 8;
+    void SetSegmentStorage(stripSegment *, segmentState *, short *, short, short);
+    bool GrowSegments(short);
+
+    //Heap high-water mark (see GetPeakHeapBytes). NoteHeapPeak() is called where the heap is about
+    //to hold Transient bytes more than GetHeapBytes() counts, and before anything is freed.
+    long heapPeak;
+    long heapScratch;           //BuildComposite()'s scratch arrays, while they are allocated
+    void NoteHeapPeak(long Transient) {heapPeak = max(heapPeak, GetHeapBytes() + Transient);}
+
+    //The loaded segment program, or NULL. Where flash is a separate address space (AVR) each
+    //segment is copied out as it is needed; elsewhere the program is read in place.
+    const stripSegment *flashProgram;
+    const stripSegment *Layout(short nSegment, stripSegment *Buffer) {
+#ifdef LEDSEGS_FLASH_COPY
+      if (flashProgram != NULL) {memcpy_P(Buffer, &flashProgram[nSegment], sizeof(stripSegment)); return Buffer;}
+#endif
+      if (flashProgram != NULL) {return &flashProgram[nSegment];}
+      if ((nSegment < 0) || (nSegment >= nLayoutsAlloc)) {   //Not defined, and no room made for it yet
+        *Buffer = ProgramSegment(0, 0, cSegActionNone, 0, 0);
+        return Buffer;
+      }
+      return &SegmentData[nSegment];
+    }
+    stripSegment *WritableSegment(short);
+    static constexpr uint32_t ModRecip(short nLEDs) {return (nLEDs > 0) ? (((255UL << 16) + nLEDs - 1) / nLEDs) : 0;}
     
-    //Max value seen for each spectrum band so far. Used to implement a simple adaptive AGC.
-    short maxBandValue[cSegNumBands];
+    //The spectrum (see SetSpectrum). MapBandsToSegments() uses its current sample.
+    LEDSpectrum *spectrum;
+    bool ownSpectrum;               //spectrum was made by (and is deleted with) this strip
+    unsigned long spectrumSeen;     //The spectrum's sample count when this strip last read it
+    byte spectrumChannels;          //Channels the segments follow (1 << cSpectrumXxx), see BuildMaskTable
+#ifdef LEDSEGS_PROFILE
+    LEDProfiler profiler;
+#endif
 
-    //Maximum noise values for each band. A band spectrum value of this or lower cause no illumination
-    //These were determined by experimentation.
-    short nNoiseFloor[cSegNumBands];
-    
-    //Spectrum analyzer left/right channels
-    const static short cSegSpectrumAnalogLeft=0;  //Left channel
-    const static short cSegSpectrumAnalogRight=1; //Right channel
+    //Band mask table. One entry per distinct segBands value and channel in use, so MapBandsToSegments()
+    //averages and normalizes each combination of bands once per frame however many segments share it.
+    //Rebuilt when a segment's bands or channel change.
+    struct bandMask {
+      byte  maskBands;      //The cSegBandN bits
+      byte  maskChannel;    //cSpectrumMix, cSpectrumLeft or cSpectrumRight
+      short maskLevel;      //This frame's normalized level for the mask
+    };
+    bandMask *maskTable;
+    short nMasks, nMasksAlloc;
+    bool masksDirty;
+    void BuildMaskTable();
+    static byte SegmentChannel(byte Options) {  //Both channel options, like neither, is the mix
+      switch (Options & (cSegOptLeftChannel | cSegOptRightChannel)) {
+        case cSegOptLeftChannel:  return cSpectrumLeft;
+        case cSegOptRightChannel: return cSpectrumRight;
+        default:                  return cSpectrumMix;
+      }
+    }
+
+    //Level stages run by MapBandsToSegments() (see SetLevelTransform and SetLevelRoutine). Each
+    //transform's curve is in levels, and is allocated when the transform is first set.
+    struct levelTransform {
+      short xfCurve[cLevelCurvePoints];  //Output for levels 0, 16, 32... 1024. For steps, the points'
+                                         //CurveIn and then, from cMaxLevelSteps on, their CurveOut
+      short xfMin, xfMax;                //Clamp
+      bool  xfInvert;                    //Invert the level first
+      byte  xfSteps;                     //Number of steps, or 0 for a curve
+    };
+    levelTransform *levelTransforms[cMaxLevelTransforms];
+    bool anyTransforms;                  //Some defined segment has a transform that is set
+    LevelBatchRoutine levelRoutine;
+    void ApplyLevelTransforms();
+
+    unsigned long nSkippedFrames;  //Frames where nothing changed and show() was skipped
+    bool repaintAll;               //Repaint every LED on the next frame, changed or not
+
+    //Render plans. Each defined segment's LEDs are described as a few strided runs of physical LED
+    //indices, in the order the segment's action visits them. The plans only depend on a segment's
+    //first LED, # LEDs, action and spacing, and on the physical layout, so they are rebuilt (lazily,
+    //all at once) only after one of those changes, and each frame just walks the runs up to the
+    //level cutoff. A physical layout splits a run wherever the map's runs do.
+    struct ledRun {
+      short runFirstLED;    //Physical index of the first LED in the run
+      short runStride;      //Step between the run's LEDs (negative runs down the strip)
+      short runCount;       //Number of LEDs in the run
+      short runFirstVisit;  //Visit order (0..segNumLEDs-1) of the first LED, compared against the lit LED count
+      short runVisitStep;   //Visit order step between the run's LEDs
+    };
+    ledRun *planRuns;       //All segments' runs
+    short nPlanRunsAlloc;   //Allocated size of planRuns[]
+    const static short cMaxPlanRuns = 0x7FFF;
+    bool layoutDirty;       //Segment layout changed: rebuild plans and the composite map before the next frame
+    LEDLayout *physLayout;  //Logical to physical LED map, or NULL (see SetPhysicalLayout)
+    unsigned short physLayoutVersion;  //Its version when the plans were built
+    void BuildPlans();
+    short AddPlanRun(short, short, short, short, short, short);
+    short AddPhysicalRun(short, short, short, short, short, short);
+
+    //The composite map. Resolves segment overlap once per layout change, so each frame writes every
+    //LED at most once. It is a list of spans sorted by LED, covering the whole strip:
+    //  - Owned spans: LEDs whose topmost segment always writes them (any action but random, without
+    //    cSegOptNoOffOverwrite) and that no other segment above reaches. Painted like a plan run.
+    //  - Contested spans: LEDs where a random or no-off-overwrite segment is on top, so who writes
+    //    the LED depends on the frame. Each LED keeps its stack of (segment, visit order) layers,
+    //    top down to the first segment that always writes, resolved per frame.
+    //  - Uncovered spans: LEDs no segment reaches. Always off.
+    struct compSpan {
+      short spanFirstLED;   //As ledRun. Contested and uncovered spans always have a stride of 1
+      short spanStride;
+      short spanCount;
+      short spanFirstVisit; //Owned spans: as ledRun
+      short spanVisitStep;
+      short spanOwner;      //Owning segment, or cSpanContested/cSpanUncovered
+      long  spanFirstLayer; //Contested spans: index of the first LED's first layer in compLayers[]
+    };
+    const static short cSpanContested = -1;
+    const static short cSpanUncovered = -2;
+    struct compLayer {
+      unsigned short layerSegment;  //Segment index, with cLayerLast set on the bottom layer of an LED's stack
+      short layerVisit;             //Visit order of the LED within that segment, or for a random segment
+                                    //the hash its cutoff is the top of (see RekeyRandomLayers)
+    };
+    const static unsigned short cLayerLast = 0x8000;
+    compSpan *compSpans;
+    short nCompSpans, nCompSpansAlloc;  //No spans on a frame painted with PaintDirect()
+    bool compositeDirty;                //Build the map once the layout holds still (see ShowSegments)
+    compLayer *compLayers;
+    long nCompLayersAlloc;
+    void BuildComposite();
+    void AddCompSpan(short, short, short, short, short, short, long);
+    static int CompareSpans(const void *, const void *);
+    void PaintSpan(const compSpan *);
+    void PaintContested(const compSpan *);
+    void PaintRun(short, short, short, short, short, short);
+    void PaintDirect();
+    bool SegmentIsOpaque(short nSegment) {
+      stripSegment segBuf;
+      const stripSegment *segptr = Layout(nSegment, &segBuf);
+      return (segptr->segAction != cSegActionRandom) && ((segptr->segOptions & cSegOptNoOffOverwrite) == 0);
+    }
+
+    //Channel table for the output color curve (cColorCurveSize entries), or NULL for none
+    byte *colorCurve;
+    const static short cColorCurveSize = 128;
+    static byte BlendChannel(byte, byte, short);
+    uint32_t CurveColor(uint32_t Color) {
+      if (colorCurve == NULL) {return Color;}
+      return ((uint32_t) colorCurve[(Color >> 16) & 0x7F] << 16) | ((uint32_t) colorCurve[(Color >> 8) & 0x7F] << 8) | colorCurve[Color & 0x7F];
+    }
 
-    void MapBandsToSegments();
-    void ReadSpectrum(bool, bool);
-    void ShowSegments();
-    
     //A pointer to the low-level I/O LBD8806 strip object we talk to
     Adafruit_NeoPixel * objPxlStrip;
     short nLEDsInStrip;
+    short stripLedType;
+    byte bytesPerPixel;         //In the strip's buffer: 3, or 4 with a white channel
+
+    //Write Count LEDs, Stride apart, of one color straight into the strip's buffer
+    void FillLEDs(short FirstLED, short Stride, short Count, uint32_t Color);
+    const static short cFillCopyBytes = 48;   //Longest contiguous run copied an LED at a time
+
+    LEDFrameSink *frameSink;    //Also gets each frame (see SetFrameSink)
+    bool showStrip;             //Show the strip as well
     
-    //Array of random cutoff levels (for cSegActionRandom)
-    unsigned short segRandomLevels[64];  //Changing this requires code changes
+    //Random cutoff levels (for cSegActionRandom, see ResetRandom). An LED's cutoff is the top 10 bits
+    //of a hash of its segment's key (a hash of randomKey and the segment) and its place in the
+    //segment. The hash is one-to-one on 16 bits, so the places of a segment all hash differently
+    //and its pattern has no period, however long it is. Hashing costs more than painting an LED, so
+    //the map keeps the hash in each random layer, and a new key rehashes them all at once.
+    unsigned short randomKey;            //Hash of the seed and the reshuffles since
+    unsigned long randomSeedUsed;
+    unsigned short reshuffleFrames, reshuffleCount;  //See SetRandomReshuffle
+    const static unsigned short cRandomKeyStep = 0x9E37;  //65536 / golden ratio: keys of segments and reshuffles far apart
+    static unsigned short RandomCutoff(unsigned short segKey, unsigned short Place) {return RandomHash(segKey + Place) >> 6;}
+    static unsigned short RandomUnhash(unsigned short x) {   //RandomHash's inverse
+      x ^= x >> 9; x *= 0x2CA5U;                 //The inverse of 0xDB2D, mod 65536
+      x ^= (x >> 7) ^ (x >> 14); x *= 0x259DU;   //and of 0x88B5
+      return x ^ (x >> 8);
+    }
+    void RekeyRandomLayers(unsigned short);
+};
+
+//An LEDSegs with room for exactly nSegments segments, held in the object itself. Size this to the
+//segments your sketch defines to save SRAM on the smaller boards:
+//
+//  LEDSegsN<12> strip(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+//
+//A sketch that only plays segment programs (LoadProgram) can leave out the layout storage too:
+//
+//  LEDSegsN<12, 0> strip(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+
+template <short nSegments, short nLayouts = nSegments> class LEDSegsN : public LEDSegs {
+  public:
+    LEDSegsN(short nLEDs, short ledType) : LEDSegs(nLEDs, 6, ledType, layoutStore, stateStore, levelStore, nSegments, nLayouts) {}
+    LEDSegsN(short nLEDs, short pinData, short ledType) : LEDSegs(nLEDs, pinData, ledType, layoutStore, stateStore, levelStore, nSegments, nLayouts) {}
+
+  private:
+    stripSegment layoutStore[(nLayouts > 0) ? nLayouts : 1];
+    segmentState stateStore[nSegments];
+    short levelStore[nSegments];
 };
 
 //Various colors. The bit format of these is defined by the LPD8806 library.
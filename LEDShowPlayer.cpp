@@ -0,0 +1,275 @@
+/*
+LEDShowPlayer
+Plays precomputed show files. The format is described in LEDShowPlayer.h.
+*/
+
+#include "LEDShowPlayer.h"
+#include <string.h>
+
+/*__________________________
+LEDShowPlayer::LEDShowPlayer
+*/
+
+LEDShowPlayer::LEDShowPlayer(Adafruit_NeoPixel *Strip, uint16_t LedType) {
+  pxlStrip = Strip;
+  stripType = LedType;
+  reorder = false;
+  showReader = NULL;
+  readerContext = NULL;
+  showData = NULL;
+  showBytes = showPos = 0;
+  nShowLEDs = 0;
+  nShowFrames = nFramesRead = 0;
+  frameMicros = 0;
+  frameChanged = false;
+  playing = false;
+}
+
+/*_________________
+LEDShowPlayer::Open
+*/
+
+bool LEDShowPlayer::Open(const byte *Data, unsigned long nBytes) {
+  showReader = NULL;
+  showData = Data;
+  showBytes = nBytes;
+  showPos = 0;
+  return ReadHeader();
+}
+
+bool LEDShowPlayer::Open(ShowReadRoutine Reader, void *Context) {
+  showReader = Reader;
+  readerContext = Context;
+  showData = chunkBuffer;
+  showBytes = showPos = 0;
+  return ReadHeader();
+}
+
+/*_______________________
+LEDShowPlayer::ReadHeader
+Check the header against the strip, and clear the strip for the first frame. A NeoPixel type has
+the offsets of white, red, green and blue in a pixel in its bits 7..6, 5..4, 3..2 and 1..0 (white
+the same as red when there is none).
+*/
+
+bool LEDShowPlayer::ReadHeader() {
+  byte header[cShowHeaderBytes];
+  uint16_t showType;
+  byte placed;
+  short i;
+
+  nShowFrames = nFramesRead = 0;
+  playing = false;
+  if (!ReadBytes(header, cShowHeaderBytes)) {return false;}
+  if ((memcmp(header, "LSHW", 4) != 0) || (header[4] != cShowVersion)) {return false;}
+
+  bytesPerLED = header[5];
+  nShowLEDs = header[6] | (header[7] << 8);
+  showType = header[8] | (header[9] << 8);
+  if ((nShowLEDs != pxlStrip->numPixels()) || (bytesPerLED != ShowBytesPerLED(showType)) || (bytesPerLED != ShowBytesPerLED(stripType))) {return false;}
+
+  //Where each channel of a show pixel goes in the strip's. Every byte of a show pixel has to be one.
+  reorder = false;
+  placed = 0;
+  for (i = (bytesPerLED == 4) ? 6 : 4; i >= 0; i -= 2) {
+    pixelOrder[(showType >> i) & 3] = (stripType >> i) & 3;
+    placed |= 1 << ((showType >> i) & 3);
+    reorder |= (((showType ^ stripType) >> i) & 3) != 0;
+  }
+  if (placed != (1 << bytesPerLED) - 1) {return false;}
+  nShowFrames = header[12] | ((unsigned long) header[13] << 8) | ((unsigned long) header[14] << 16) | ((unsigned long) header[15] << 24);
+
+  memset(pxlStrip->getPixels(), 0, ((long) nShowLEDs) * bytesPerLED);
+  return true;
+}
+
+/*_______________________
+LEDShowPlayer::Rewind
+*/
+
+bool LEDShowPlayer::Rewind() {
+  if (showReader != NULL) {return false;}
+  showPos = 0;
+  return ReadHeader();
+}
+
+/*______________________
+LEDShowPlayer::ReadBytes
+Copy the next nBytes of the show, refilling the chunk buffer as it runs out if the show is streamed.
+*/
+
+bool LEDShowPlayer::ReadBytes(byte *Buffer, unsigned long nBytes) {
+  unsigned long nCopy;
+
+  while (nBytes > 0) {
+    if (showPos == showBytes) {
+      if (showReader == NULL) {return false;}
+      showBytes = max(showReader(readerContext, chunkBuffer, cShowChunkBytes), (short) 0);
+      showPos = 0;
+      if (showBytes == 0) {return false;}
+    }
+    nCopy = min(nBytes, showBytes - showPos);
+    memcpy(Buffer, showData + showPos, nCopy);
+    showPos += nCopy;
+    Buffer += nCopy;
+    nBytes -= nCopy;
+  }
+  return true;
+}
+
+/*__________________________
+LEDShowPlayer::ReorderPixels
+Put pixels decoded in the show's color order in the strip's
+*/
+
+void LEDShowPlayer::ReorderPixels(byte *Pixels, unsigned long nLEDs) {
+  byte pixel[4];
+  short i;
+
+  for (; nLEDs > 0; nLEDs--, Pixels += bytesPerLED) {
+    memcpy(pixel, Pixels, bytesPerLED);
+    for (i = 0; i < bytesPerLED; i++) {Pixels[pixelOrder[i]] = pixel[i];}
+  }
+}
+
+bool LEDShowPlayer::ReadLong(unsigned long *Value) {
+  byte bytes[4];
+
+  if (!ReadBytes(bytes, 4)) {return false;}
+  *Value = bytes[0] | ((unsigned long) bytes[1] << 8) | ((unsigned long) bytes[2] << 16) | ((unsigned long) bytes[3] << 24);
+  return true;
+}
+
+/*______________________
+LEDShowPlayer::NextFrame
+*/
+
+bool LEDShowPlayer::NextFrame() {
+  unsigned long frameBytes, iLED, nRun, nLEDs;
+  byte op, *pixels, *fill;
+  short i;
+
+  if (nFramesRead >= nShowFrames) {return false;}
+  if (!ReadLong(&frameMicros) || !ReadLong(&frameBytes)) {return false;}
+
+  pixels = pxlStrip->getPixels();
+  nLEDs = nShowLEDs;
+  iLED = 0;
+  frameChanged = (frameBytes > 0);
+  while (frameBytes > 0) {
+    if (!ReadBytes(&op, 1)) {return false;}
+    frameBytes--;
+    nRun = (op & 0x3F) + 1;
+    if ((op & 0xC0) == cShowOpLongSkip) {nRun *= cShowMaxRun;}
+    if (iLED + nRun > nLEDs) {return false;}
+
+    switch (op & 0xC0) {
+      case cShowOpFill:
+        if (frameBytes < bytesPerLED) {return false;}
+        fill = pixels + iLED * bytesPerLED;
+        if (!ReadBytes(fill, bytesPerLED)) {return false;}
+        if (reorder) {ReorderPixels(fill, 1);}
+        for (i = 1; i < (short) nRun; i++) {memcpy(fill + i * bytesPerLED, fill, bytesPerLED);}
+        frameBytes -= bytesPerLED;
+        break;
+
+      case cShowOpLiteral:
+        if (frameBytes < nRun * bytesPerLED) {return false;}
+        if (!ReadBytes(pixels + iLED * bytesPerLED, nRun * bytesPerLED)) {return false;}
+        if (reorder) {ReorderPixels(pixels + iLED * bytesPerLED, nRun);}
+        frameBytes -= nRun * bytesPerLED;
+        break;
+    }
+    iLED += nRun;
+  }
+  nFramesRead++;
+  return true;
+}
+
+/*______________________
+LEDShowPlayer::PlayFrame
+*/
+
+bool LEDShowPlayer::PlayFrame() {
+  unsigned long elapsed;
+
+  if (!NextFrame()) {return false;}
+  if (!playing) {
+    playing = true;
+    playStart = micros() - frameMicros;
+  }
+  while ((elapsed = micros() - playStart) < frameMicros) {delayMicroseconds(min(frameMicros - elapsed, cShowWaitMicros));}
+  if (frameChanged) {pxlStrip->show();}
+  return true;
+}
+
+static bool ShowSamePixel(const byte *a, short iA, const byte *b, short iB, byte BytesPerLED) {
+  return memcmp(a + ((long) iA) * BytesPerLED, b + ((long) iB) * BytesPerLED, BytesPerLED) == 0;
+}
+
+/*____________
+ShowEncodeRun
+nLEDs of one kind of run, split into as many opcodes as it takes
+*/
+
+static void ShowEncodeRun(byte Op, short nLEDs, const byte *Pixels, byte BytesPerLED, ShowWriteRoutine Write, void *Context) {
+  short nRun, iByte;
+
+  while (nLEDs > 0) {
+    if ((Op == cShowOpSkip) && (nLEDs >= cShowMaxRun * 2)) {
+      nRun = min(nLEDs / cShowMaxRun, cShowMaxRun);
+      Write(Context, cShowOpLongSkip | (nRun - 1));
+      nRun *= cShowMaxRun;
+    }
+    else {
+      nRun = min(nLEDs, cShowMaxRun);
+      Write(Context, Op | (nRun - 1));
+      if (Op == cShowOpFill) {
+        for (iByte = 0; iByte < BytesPerLED; iByte++) {Write(Context, Pixels[iByte]);}
+      }
+      else if (Op == cShowOpLiteral) {
+        for (iByte = 0; iByte < nRun * BytesPerLED; iByte++) {Write(Context, Pixels[iByte]);}
+        Pixels += nRun * BytesPerLED;
+      }
+    }
+    nLEDs -= nRun;
+  }
+}
+
+/*_____________
+ShowEncodeRuns
+See LEDShowPlayer.h
+*/
+
+void ShowEncodeRuns(const byte *Pixels, byte *Last, short nLEDs, byte BytesPerLED, bool CoverAll, ShowWriteRoutine Write, void *Context) {
+  short iLED, jLED, nSame;
+
+  iLED = 0;
+  while (iLED < nLEDs) {
+    //Unchanged, up to the next LED that changed
+    for (jLED = iLED; (jLED < nLEDs) && ShowSamePixel(Pixels, jLED, Last, jLED, BytesPerLED); jLED++) {}
+    if ((jLED == nLEDs) && !CoverAll) {break;}
+    if (jLED > iLED) {
+      ShowEncodeRun(cShowOpSkip, jLED - iLED, NULL, BytesPerLED, Write, Context);
+      iLED = jLED;
+      continue;
+    }
+
+    //A fill, if the next LED is the same color
+    for (nSame = 1; (iLED + nSame < nLEDs) && ShowSamePixel(Pixels, iLED + nSame, Pixels, iLED, BytesPerLED); nSame++) {}
+    if (nSame >= 2) {
+      ShowEncodeRun(cShowOpFill, nSame, Pixels + ((long) iLED) * BytesPerLED, BytesPerLED, Write, Context);
+      iLED += nSame;
+      continue;
+    }
+
+    //Literal, up to the next unchanged LED or pair of the same color
+    for (jLED = iLED + 1; jLED < nLEDs; jLED++) {
+      if (ShowSamePixel(Pixels, jLED, Last, jLED, BytesPerLED)) {break;}
+      if ((jLED + 1 < nLEDs) && ShowSamePixel(Pixels, jLED, Pixels, jLED + 1, BytesPerLED)) {break;}
+    }
+    ShowEncodeRun(cShowOpLiteral, jLED - iLED, Pixels + ((long) iLED) * BytesPerLED, BytesPerLED, Write, Context);
+    iLED = jLED;
+  }
+  memcpy(Last, Pixels, ((long) nLEDs) * BytesPerLED);
+}
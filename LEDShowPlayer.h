@@ -0,0 +1,135 @@
+#ifndef _LEDSHOWPLAYER_H
+#define _LEDSHOWPLAYER_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+#include "Adafruit_NeoPixel.h"
+#include "LEDFrameSink.h"
+
+/*
+Precomputed show files
+
+A show is rendered ahead of time on the host (extras/host, lightorgan_render) by running the whole
+LEDSegs pipeline over an audio file, and played back here with no analysis at all: each frame is a
+decode straight into the NeoPixel buffer and a show().
+
+All numbers are little endian. The file starts with a 16 byte header:
+  0  'L' 'S' 'H' 'W'
+  4  byte    version (cShowVersion)
+  5  byte    bytes per LED in the strip buffer (3, or 4 for RGBW)
+  6  uint16  number of LEDs
+  8  uint16  NeoPixel type the show was rendered for (NEO_GRB + NEO_KHZ800 etc.)
+  10 uint16  0
+  12 uint32  number of frames
+Then, for each frame:
+  uint32  time to show it, in microseconds from the start of the show
+  uint32  length of the frame's data in bytes
+  data    runs that take the previous frame's pixels (all off, for the first) to this one's
+Each run is an opcode byte, with the run type in the top two bits and the LED count less one (so
+1..64) in the rest:
+  00 skip     count LEDs are unchanged
+  01 fill     count LEDs are all set to the one pixel that follows
+  10 literal  count LEDs are set to the count pixels that follow
+  11 skip     count*64 LEDs are unchanged
+Pixels are as they are stored in the strip's buffer, in the color order of the NeoPixel type in the
+header. LEDs past the last run are unchanged, so a frame with no data is the same as the one before.
+*/
+
+const byte cShowVersion = 1;
+const short cShowHeaderBytes = 16;
+const short cShowFrameHeaderBytes = 8;
+const byte cShowOpSkip = 0x00;
+const byte cShowOpFill = 0x40;
+const byte cShowOpLiteral = 0x80;
+const byte cShowOpLongSkip = 0xC0;
+const short cShowMaxRun = 64;          //LEDs per run (times 64 for a long skip)
+
+//Bytes per LED for a NeoPixel type: 4 when it has a white channel
+inline byte ShowBytesPerLED(uint16_t ledType) {return NeoPixelBytesPerLED(ledType);}
+
+//Reads up to nBytes of a streamed show into Buffer (e.g. from an SD card File). Returns the number
+//of bytes read; 0 at the end.
+typedef short (*ShowReadRoutine) (void *Context, byte *Buffer, short nBytes);
+
+//Takes the encoded runs a byte at a time (see ShowEncodeRuns)
+typedef void (*ShowWriteRoutine) (void *Context, byte Value);
+
+//Encode the runs that take Last (nLEDs pixels of BytesPerLED bytes) to Pixels, writing them out
+//through Write, and copy Pixels to Last. Unchanged LEDs are skipped, two or more LEDs of one color
+//are a fill, and anything else changed goes out literally. Unchanged LEDs at the end are left off,
+//unless CoverAll. Show files (extras/host, HostShowWriter) and frame streams (LEDFrameStream.h)
+//are both coded with it.
+void ShowEncodeRuns(const byte *Pixels, byte *Last, short nLEDs, byte BytesPerLED, bool CoverAll, ShowWriteRoutine Write, void *Context);
+
+/*___________
+LEDShowPlayer
+Plays a show file onto a strip created with the show's LED count, and LedType, the NeoPixel type it
+was created with (Adafruit_NeoPixel doesn't say). A show rendered for another color order is put in
+the strip's order as it is decoded; one with a white channel the strip doesn't have, or the other
+way around, is rejected. The show is either in memory (a memory-mapped file on the host, flash on
+boards that map it) or read through a routine a small chunk at a time.
+
+  LEDShowPlayer player(pixelStrip, NEO_GRB + NEO_KHZ800);
+  player.Open(showData, showBytes);
+  while (player.PlayFrame()) {}
+*/
+
+class LEDShowPlayer {
+
+  public:
+    LEDShowPlayer(Adafruit_NeoPixel *Strip, uint16_t LedType);
+
+    //Start a show. Both return false if the header is bad or doesn't fit the strip.
+    bool Open(const byte *Data, unsigned long nBytes);
+    bool Open(ShowReadRoutine Reader, void *Context);
+
+    //Decode the next frame into the strip's buffer, without showing it. Returns false at the end of
+    //the show or if the data is bad.
+    bool NextFrame();
+
+    //Wait for the next frame's time (counted from the first PlayFrame()), decode it and show it. A
+    //frame that changes nothing isn't shown. Returns false at the end of the show.
+    bool PlayFrame();
+
+    //Back to the first frame. Only for shows in memory.
+    bool Rewind();
+
+    unsigned long GetNumFrames() {return nShowFrames;}
+    unsigned long GetFrameIndex() {return nFramesRead;}   //Frames decoded so far
+    unsigned long GetFrameMicros() {return frameMicros;}  //Time of the last frame decoded
+    bool GetFrameChanged() {return frameChanged;}         //Whether it changed any LEDs
+    short GetNumLEDs() {return nShowLEDs;}
+
+  private:
+    const static short cShowChunkBytes = 64;       //Read buffer for streamed shows
+    const static unsigned long cShowWaitMicros = 1000;
+
+    Adafruit_NeoPixel *pxlStrip;
+    uint16_t stripType;
+    ShowReadRoutine showReader;
+    void *readerContext;
+    const byte *showData;                //In memory: the whole show. Streamed: chunkBuffer.
+    unsigned long showBytes, showPos;    //Size of showData, and the read position in it
+    byte chunkBuffer[cShowChunkBytes];
+
+    byte bytesPerLED;
+    byte pixelOrder[4];                  //Where each byte of a show pixel goes in the strip's
+    bool reorder;                        //Not all in the same place
+    short nShowLEDs;
+    unsigned long nShowFrames, nFramesRead;
+    unsigned long frameMicros;
+    bool frameChanged;
+    bool playing;
+    unsigned long playStart;
+
+    bool ReadHeader();
+    bool ReadBytes(byte *Buffer, unsigned long nBytes);
+    bool ReadLong(unsigned long *Value);
+    void ReorderPixels(byte *Pixels, unsigned long nLEDs);
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+LEDSpectrum
+The sampled spectrum, shared by LEDSegs strips. See LEDSpectrum.h.
+*/
+
+#include "LEDSpectrum.h"
+#include "LEDSpectrumTrace.h"
+
+//The ADC, driven by its conversion-complete interrupt, for asynchronous spectrum acquisition (see
+//LEDSegs::SetAsyncSpectrum). On AVR only if the sketch lets the library have the interrupt (see
+//LEDSEGS_ADC_ISR). The host build supplies a simulated one.
+#if defined(__AVR__) && defined(LEDSEGS_ADC_ISR)
+  #include <avr/interrupt.h>
+  #define LEDSEGS_ASYNC_ADC
+
+  static void AdcStart(uint8_t pin) {
+  #if defined(analogPinToChannel)
+    pin = analogPinToChannel(pin);
+  #endif
+    ADMUX = _BV(REFS0) | (pin & 0x07);  //AVcc reference, as analogRead() uses by default
+    ADCSRA |= _BV(ADSC) | _BV(ADIE);
+  }
+  static void AdcStop() {ADCSRA &= ~_BV(ADIE);}
+  static short AdcResult() {return ADC;}
+  static void AdcAttach() {}
+#elif defined(HOST_SIM_ADC)
+  #define LEDSEGS_ASYNC_ADC
+
+  static void AdcStart(uint8_t pin) {hostAdcStart(pin);}
+  static void AdcStop() {hostAdcStop();}
+  static short AdcResult() {return hostAdcResult();}
+  static void AdcInterrupt();
+  static void AdcAttach() {hostAdcAttachInterrupt(AdcInterrupt);}
+#endif
+
+#ifdef LEDSEGS_ASYNC_ADC
+  static LEDSpectrum *asyncSampler = NULL;  //The spectrum being read asynchronously
+
+  #if defined(__AVR__)
+    ISR(ADC_vect) {if (asyncSampler != NULL) {asyncSampler->Service();}}
+  #else
+    static void AdcInterrupt() {if (asyncSampler != NULL) {asyncSampler->Service();}}
+  #endif
+#endif
+
+/*________________________
+LEDSpectrum::LEDSpectrum
+*/
+
+LEDSpectrum::LEDSpectrum() {
+  byte iChannel;
+  short iBand;
+
+  //Read the spectrum shield until told otherwise
+  SetSource(NULL);
+
+  //Initialize the max level seen for each band.
+  for (iChannel = 0; iChannel < cSpectrumNumChannels; iChannel++) {
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      spectrumBufs[0].sampleLevel[iChannel][iBand] = spectrumBufs[1].sampleLevel[iChannel][iBand] = 0;
+      spectrumBufs[0].sampleMax[iChannel][iBand] = spectrumBufs[1].sampleMax[iChannel][iBand] = cInitialMaxBandValue;
+    }
+  }
+  SpectrumFront = &spectrumBufs[0];
+  SpectrumBack = &spectrumBufs[1];
+  nSamples = 0;
+  recorder = NULL;
+  wantChannels = 0;
+  readChannels = 0;
+  readLeft = readRight = mixLeft = mixRight = false;
+  asyncSpectrum = asyncBusy = asyncReady = false;
+  asyncBand = 0;
+
+  //Setup pins to drive the spectrum analyzer.
+  pinMode(cSpectrumReset, OUTPUT);
+  pinMode(cSpectrumStrobe, OUTPUT);
+
+  //Init spectrum analyzer to start reading from lowest band
+  digitalWrite(cSpectrumStrobe,LOW);
+    delay(1);
+  digitalWrite(cSpectrumReset,HIGH);
+    delay(1);
+  digitalWrite(cSpectrumStrobe,HIGH);
+    delay(1);
+  digitalWrite(cSpectrumStrobe,LOW);
+    delay(1);
+  digitalWrite(cSpectrumReset,LOW);
+    delay(5);
+}
+
+LEDSpectrum::~LEDSpectrum() {
+  SetAsync(false);
+}
+
+/*_____________________
+LEDSpectrum::SetSource
+Take the band levels from Source instead of the spectrum shield (NULL goes back to the shield), and
+use the source's noise floors.
+*/
+
+void LEDSpectrum::SetSource(LEDSpectrumSource *Source) {
+  //Noise values for each spectrum band (0..1023) on the shield. Determined by experimentation. YMMV
+  static const short cShieldNoiseFloor[cSegNumBands] = {90, 90, 90, 100, 100, 110, 120};
+  short iBand;
+
+  spectrumSource = Source;
+  for (iBand = 0; iBand < cSegNumBands; iBand++) {
+    nNoiseFloor[iBand] = (Source != NULL) ? Source->GetNoiseFloor(iBand) : cShieldNoiseFloor[iBand];
+  }
+}
+
+/*___________________
+LEDSpectrum::Acquire
+*/
+
+void LEDSpectrum::Acquire(unsigned long *LastSample, byte Channels, bool doLeft, bool doRight) {
+  wantChannels |= Channels;
+  if (*LastSample == nSamples) {Read(doLeft, doRight);}
+  *LastSample = nSamples;
+}
+
+/*________________
+LEDSpectrum::Read
+Read the spectrum band samples into SpectrumFront.
+"Channels" tells whether the mix reads left, right, or averages both channels.
+*/
+
+void LEDSpectrum::Read(bool doLeft, bool doRight) {
+  short iBand;  //Band 0 is lowest frequencies, Band 6 is the highest.
+  short leftLevel, rightLevel;
+  byte iChannel;
+  short sourceLevels[cSegNumBands];
+
+  //A spectrum source other than the shield does its own reading, a channel at a time
+  if (spectrumSource != NULL) {
+    SetReadChannels(doLeft, doRight);
+    spectrumSource->StartSample();
+    for (iChannel = 0; iChannel < cSpectrumNumChannels; iChannel++) {
+      if ((readChannels & (1 << iChannel)) == 0) {continue;}
+      spectrumSource->ReadChannel(sourceLevels, cSegNumBands, iChannel, doLeft, doRight);
+      for (iBand = 0; iBand < cSegNumBands; iBand++) {StoreBand(iChannel, iBand, sourceLevels[iBand]);}
+    }
+    FinishSample();
+    return;
+  }
+
+  //Asynchronous: take the sample read in the background (waiting for it to finish if need be), and
+  //start on the next one while this one is displayed
+  if (asyncSpectrum) {
+    if (!asyncBusy && !asyncReady) {StartAcquisition(doLeft, doRight);}
+    while (!asyncReady) {delayMicroseconds(cAsyncPollMicros);}
+    FinishSample();
+    StartAcquisition(doLeft, doRight);
+    return;
+  }
+
+  //This loop happens nBands times per sample, so keep it quick. Each ADC channel is read once per
+  //band, whichever channels want it.
+  SetReadChannels(doLeft, doRight);
+  for(iBand=0; iBand < cSegNumBands; iBand++) {
+
+    //Read the spectrum for this band
+    leftLevel = readLeft ? analogRead(cSegSpectrumAnalogLeft) : 0;
+    rightLevel = readRight ? analogRead(cSegSpectrumAnalogRight) : 0;
+    StoreBands(iBand, leftLevel, rightLevel);
+
+    //Toggle to ready for next band
+    digitalWrite(cSpectrumStrobe,HIGH);
+    digitalWrite(cSpectrumStrobe,LOW);
+  }
+  FinishSample();
+}
+
+/*________________________
+LEDSpectrum::FinishSample
+Make the sample just read the current one, and record it
+*/
+
+void LEDSpectrum::FinishSample() {
+  spectrumSample *t = SpectrumFront;
+
+  SpectrumFront = SpectrumBack;
+  SpectrumBack = t;
+  nSamples++;
+  if (recorder != NULL) {recorder->EndSample(readChannels);}
+}
+
+/*___________________________
+LEDSpectrum::SetReadChannels
+Work out what the next sample reads: the channels strips follow (the mix if none have said), and the
+ADC channels those need.
+*/
+
+void LEDSpectrum::SetReadChannels(bool doLeft, bool doRight) {
+  readChannels = (wantChannels != 0) ? wantChannels : (1 << cSpectrumMix);
+  mixLeft = doLeft;
+  mixRight = doRight;
+  readLeft = (readChannels & (1 << cSpectrumLeft)) || ((readChannels & (1 << cSpectrumMix)) && doLeft);
+  readRight = (readChannels & (1 << cSpectrumRight)) || ((readChannels & (1 << cSpectrumMix)) && doRight);
+}
+
+/*______________________
+LEDSpectrum::StoreBands
+Record a band's left and right readings into each channel being read
+*/
+
+void LEDSpectrum::StoreBands(short iBand, short leftLevel, short rightLevel) {
+  short mixLevel;
+
+  if (readChannels & (1 << cSpectrumLeft)) {StoreBand(cSpectrumLeft, iBand, leftLevel);}
+  if (readChannels & (1 << cSpectrumRight)) {StoreBand(cSpectrumRight, iBand, rightLevel);}
+  if (readChannels & (1 << cSpectrumMix)) {
+    mixLevel = (mixLeft ? leftLevel : 0) + (mixRight ? rightLevel : 0);
+    if (mixLeft && mixRight) {mixLevel = mixLevel >> 1;} //If both channels, then take average
+    StoreBand(cSpectrumMix, iBand, mixLevel);
+  }
+}
+
+/*_____________________
+LEDSpectrum::StoreBand
+Record a band's reading into SpectrumBack: take out the noise floor and update the band's max.
+*/
+
+void LEDSpectrum::StoreBand(byte iChannel, short iBand, short thisLevel) {
+  short bandMax;
+
+  if (recorder != NULL) {recorder->StoreBand(iChannel, iBand, thisLevel);}
+
+  //Decay the max a little on each sample
+  bandMax = SpectrumFront->sampleMax[iChannel][iBand] - cMaxBandValueDecay;
+  if (bandMax < cInitialMaxBandValue) bandMax = cInitialMaxBandValue;
+
+  //Process out assumed noise floor for this band
+  thisLevel -= nNoiseFloor[iBand];
+  if (thisLevel < 0) {thisLevel = 0;}
+
+  //Set current and max values for this into their respective array slots
+  SpectrumBack->sampleLevel[iChannel][iBand] = thisLevel;
+  if (bandMax < thisLevel) {bandMax = thisLevel;}
+  SpectrumBack->sampleMax[iChannel][iBand] = bandMax;
+}
+
+/*____________________
+LEDSpectrum::SetAsync
+Turn asynchronous spectrum acquisition on or off. Returns whether it is on.
+*/
+
+bool LEDSpectrum::SetAsync(bool enable) {
+#ifdef LEDSEGS_ASYNC_ADC
+  if (enable == asyncSpectrum) {return asyncSpectrum;}
+  if (enable) {
+    if (asyncSampler != NULL) {return false;}  //Another spectrum has the interrupt
+    asyncSampler = this;
+    AdcAttach();
+  }
+  else {
+    AdcStop();
+    asyncSampler = NULL;
+    asyncBusy = false;
+    asyncReady = false;
+    //Put the shield back on the lowest band, where the synchronous reads expect it
+    while (asyncBand > 0) {
+      digitalWrite(cSpectrumStrobe,HIGH);
+      digitalWrite(cSpectrumStrobe,LOW);
+      asyncBand = (asyncBand + 1) % cSegNumBands;
+    }
+  }
+  asyncSpectrum = enable;
+#endif
+  return asyncSpectrum;
+}
+
+/*____________________________
+LEDSpectrum::StartAcquisition
+Start reading a sample into SpectrumBack in the background
+*/
+
+void LEDSpectrum::StartAcquisition(bool doLeft, bool doRight) {
+  SetReadChannels(doLeft, doRight);
+  asyncBand = 0;
+  asyncReady = false;
+
+  //No channels: nothing to convert, every band reads 0
+  if (!readLeft && !readRight) {
+    for (asyncBand = 0; asyncBand < cSegNumBands; asyncBand++) {
+      StoreBands(asyncBand, 0, 0);
+      digitalWrite(cSpectrumStrobe,HIGH);
+      digitalWrite(cSpectrumStrobe,LOW);
+    }
+    asyncBand = 0;
+    asyncReady = true;
+    return;
+  }
+
+  asyncBusy = true;
+  asyncOnRight = !readLeft;
+  AdcStart(asyncOnRight ? cSegSpectrumAnalogRight : cSegSpectrumAnalogLeft);
+}
+
+/*___________________
+LEDSpectrum::Service
+Step the acquisition state machine when an ADC conversion completes. Each band takes a conversion
+per ADC channel read; then the shield is strobed on to the next band. After the last band the
+sample is complete and the machine stops until Read() takes it.
+*/
+
+void LEDSpectrum::Service() {
+#ifdef LEDSEGS_ASYNC_ADC
+  if (!asyncBusy) {return;}
+
+  //Both channels: the right one next
+  if (!asyncOnRight) {
+    asyncLeftLevel = AdcResult();
+    if (readRight) {
+      asyncOnRight = true;
+      AdcStart(cSegSpectrumAnalogRight);
+      return;
+    }
+    StoreBands(asyncBand, asyncLeftLevel, 0);
+  }
+  else {StoreBands(asyncBand, readLeft ? asyncLeftLevel : 0, AdcResult());}
+  digitalWrite(cSpectrumStrobe,HIGH);
+  digitalWrite(cSpectrumStrobe,LOW);
+
+  asyncBand++;
+  if (asyncBand >= cSegNumBands) {
+    asyncBand = 0;
+    asyncBusy = false;
+    asyncReady = true;
+    return;
+  }
+  asyncOnRight = !readLeft;
+  AdcStart(asyncOnRight ? cSegSpectrumAnalogRight : cSegSpectrumAnalogLeft);
+#endif
+}
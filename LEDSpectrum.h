@@ -0,0 +1,127 @@
+#ifndef _LEDSPECTRUM_H
+#define _LEDSPECTRUM_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+#include "LEDSpectrumSource.h"
+
+//Uncomment (or define on the compiler command line) to have the library take the ADC-complete
+//interrupt, ISR(ADC_vect), on AVR boards. Asynchronous acquisition (LEDSegs::SetAsyncSpectrum) needs
+//it; without it the interrupt is left to the sketch, and reads stay synchronous.
+//#define LEDSEGS_ADC_ISR
+
+//Total spectrum analyzer shield bands and max value for a band read. Do not change this.
+const short cSegNumBands=7;
+
+//Software gain control constants. This provides a simple 'fast attack'/'slow decay' AGC for the input.
+//InitialMax is the lowest spectrum band value to which AGC processing will apply. (AGC is applied
+//separately to each of the seven spectrum bands.) As each sample is read, a fixed, assumed noise
+//value is subtracted, then the max value seen for that channel is updated, but only when it is above MaxBandValue.
+//Then the sampled value is scaled to the range (0..MaxSegmentLevel) using the actual max seen for that channel
+//so far. The decay constant is subtracted from each channel's max on each display cycle. This sample normalization
+//is applied before any custom display routine is called.
+
+const static short cInitialMaxBandValue = 200; //Lowest max value allowed (0..1023) Normalized, after noise deduction.
+const static short cMaxBandValueDecay = 2;     //Subtracted from detected max on each sample cycle
+
+class LEDTraceRecorder;
+
+/*__________
+LEDSpectrum
+The sampled spectrum: reads the shield (or an LEDSpectrumSource), takes out the noise floors and runs
+the AGC, for the mix, left and right channels from the one pass over the bands. Each strip starts
+with one of its own; to have several strips on one board follow the same sample, make one and give
+it to all of them:
+
+  LEDSpectrum *spectrum = new LEDSpectrum();
+  strip1->SetSpectrum(spectrum);
+  strip2->SetSpectrum(spectrum);
+  ...
+  strip1->DisplaySpectrum(true, true);  //Reads the shield
+  strip2->DisplaySpectrum(true, true);  //Shows the same sample
+
+A strip's ReadSpectrum() only reads a new sample when that strip has already seen the current one,
+so the first strip displayed each cycle does the reading and the others just take its sample.
+Channels are only read once some strip has a segment following them (see cSegOptLeftChannel).
+*/
+
+class LEDSpectrum {
+
+  public:
+    LEDSpectrum();
+    ~LEDSpectrum();
+
+    //Read a new sample now. Most sketches leave this to the strips (see Acquire).
+    void Read(bool doLeft, bool doRight);
+
+    //For a strip's ReadSpectrum(): read a new sample unless *LastSample says this strip hasn't seen the
+    //current one, and note the channels (a mask of 1 << cSpectrumXxx) the strip's segments follow
+    void Acquire(unsigned long *LastSample, byte Channels, bool doLeft, bool doRight);
+    unsigned long GetSampleCount() {return nSamples;}
+
+    //The current sample of a channel: each band's level after the noise floor, and its AGC max
+    const short *GetLevels(byte Channel) {return SpectrumFront->sampleLevel[Channel];}
+    const short *GetMaxes(byte Channel) {return SpectrumFront->sampleMax[Channel];}
+
+    //See LEDSegs::SetAsyncSpectrum() and LEDSegs::SetSpectrumSource(). SetAsync(true) returns false
+    //while another spectrum has async acquisition on, as there is only the one ADC interrupt.
+    bool SetAsync(bool enable);
+    bool GetAsync() {return asyncSpectrum;}
+    void Service();  //Called by the ADC interrupt when a conversion completes
+    void SetSource(LEDSpectrumSource *Source);
+    LEDSpectrumSource *GetSource() {return spectrumSource;}
+    short GetNoiseFloor(short iBand) {return nNoiseFloor[iBand];}
+
+    //Record each sample's readings (see LEDSpectrumTrace.h); NULL to stop. LEDTraceRecorder::Begin()
+    //sets this.
+    void SetRecorder(LEDTraceRecorder *Recorder) {recorder = Recorder;}
+
+  private:
+    const static short cSpectrumReset=5;
+    const static short cSpectrumStrobe=4;
+
+    //Spectrum analyzer left/right channels
+    const static short cSegSpectrumAnalogLeft=0;  //Left channel
+    const static short cSegSpectrumAnalogRight=1; //Right channel
+
+    //Spectrum samples. Strips use the front one while the back one is read, then Read() swaps them.
+    struct spectrumSample {
+      short sampleLevel[cSpectrumNumChannels][cSegNumBands];  //The per-band level from the spectrum analyzer (see Read)
+      short sampleMax[cSpectrumNumChannels][cSegNumBands];    //Max value seen for each band so far. Used to implement a simple adaptive AGC.
+    };
+    spectrumSample spectrumBufs[2];
+    spectrumSample *SpectrumFront, *SpectrumBack;
+    unsigned long nSamples;         //Samples read so far
+    byte wantChannels;              //Channels some strip follows (1 << cSpectrumXxx)
+    void StoreBand(byte, short, short);
+    void StoreBands(short, short, short);
+    void FinishSample();
+    LEDTraceRecorder *recorder;
+
+    //What the sample being read stores, the ADC channels it needs, and how the mix is made
+    byte readChannels;
+    bool readLeft, readRight;
+    bool mixLeft, mixRight;
+    void SetReadChannels(bool, bool);
+
+    //Asynchronous acquisition state (see Service)
+    bool asyncSpectrum;             //Async mode is on
+    volatile bool asyncBusy;        //A sample is being read into SpectrumBack
+    volatile bool asyncReady;       //SpectrumBack holds a complete sample
+    bool asyncOnRight;              //The conversion in progress is the right channel
+    byte asyncBand;                 //Band being read
+    short asyncLeftLevel;           //The band's left reading, while the right one is converted
+    const static unsigned int cAsyncPollMicros = 10;  //Poll interval while waiting for a sample
+    void StartAcquisition(bool, bool);
+
+    //Maximum noise values for each band. A band spectrum value of this or lower cause no illumination
+    //For the shield these were determined by experimentation; other sources supply their own.
+    short nNoiseFloor[cSegNumBands];
+    LEDSpectrumSource *spectrumSource;
+};
+
+#endif
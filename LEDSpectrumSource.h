@@ -0,0 +1,45 @@
+#ifndef _LEDSPECTRUMSOURCE_H
+#define _LEDSPECTRUMSOURCE_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+#else
+ #include "WProgram.h"
+#endif
+
+//Spectrum channels. The mix is whatever the reading strip's DisplaySpectrum(doLeft, doRight) asked
+//for: the left channel, the right, or the average of both.
+const byte cSpectrumMix = 0;
+const byte cSpectrumLeft = 1;
+const byte cSpectrumRight = 2;
+const byte cSpectrumNumChannels = 3;
+
+/*_______________
+LEDSpectrumSource
+Where LEDSegs::ReadSpectrum() gets its band levels when it is not reading the spectrum analyzer
+shield. See LEDSegs::SetSpectrumSource(). Band 0 is the lowest frequency band.
+*/
+
+class LEDSpectrumSource {
+
+  public:
+    virtual ~LEDSpectrumSource() {}
+
+    //Called once as each new sample starts, before its ReadChannel() calls (one per channel read)
+    virtual void StartSample() {}
+
+    //Current level (0..1023) of bands 0..nBands-1, for the left channel, the right, or the average of both
+    virtual void ReadBands(short *Levels, short nBands, bool doLeft, bool doRight) = 0;
+
+    //The same for a channel (cSpectrumMix etc.), the mix being of the channels doLeft and doRight say.
+    //This is what the spectrum calls; a source that keeps its channels apart can answer it directly.
+    virtual void ReadChannel(short *Levels, short nBands, byte Channel, bool doLeft, bool doRight) {
+      ReadBands(Levels, nBands, (Channel == cSpectrumMix) ? doLeft : (Channel == cSpectrumLeft),
+        (Channel == cSpectrumMix) ? doRight : (Channel == cSpectrumRight));
+    }
+
+    //Level (0..1023) at or below which a band is taken to be noise
+    virtual short GetNoiseFloor(short iBand) = 0;
+};
+
+#endif
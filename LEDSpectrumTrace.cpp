@@ -0,0 +1,179 @@
+/*
+LEDSpectrumTrace
+Recording and replay of spectrum traces. The format is described in LEDSpectrumTrace.h.
+*/
+
+#include "LEDSpectrumTrace.h"
+#include <string.h>
+
+/*________________________________
+LEDTraceRecorder::LEDTraceRecorder
+*/
+
+LEDTraceRecorder::LEDTraceRecorder() {
+  out = NULL;
+  spectrum = NULL;
+  nFrames = nBytes = 0;
+}
+
+/*_____________________
+LEDTraceRecorder::Begin
+*/
+
+void LEDTraceRecorder::Begin(Print &Out, LEDSpectrum *Spectrum, unsigned long RandomSeed) {
+  short iBand;
+
+  End();
+  out = &Out;
+  nFrames = nBytes = 0;
+  memset(sampleLevel, 0, sizeof(sampleLevel));
+  memset(lastLevel, 0, sizeof(lastLevel));
+
+  WriteByte('L');
+  WriteByte('S');
+  WriteByte('T');
+  WriteByte('R');
+  WriteByte(cTraceVersion);
+  WriteByte(cSegNumBands);
+  WriteWord(0);
+  WriteWord(RandomSeed & 0xFFFF);
+  WriteWord(RandomSeed >> 16);
+  for (iBand = 0; iBand < cSegNumBands; iBand++) {WriteWord(Spectrum->GetNoiseFloor(iBand));}
+
+  spectrum = Spectrum;
+  spectrum->SetRecorder(this);
+}
+
+void LEDTraceRecorder::End() {
+  if (spectrum != NULL) {spectrum->SetRecorder(NULL);}
+  spectrum = NULL;
+}
+
+/*_________________________
+LEDTraceRecorder::EndSample
+Write the sample just read: its flags, then each channel's band differences
+*/
+
+void LEDTraceRecorder::EndSample(byte Channels) {
+  byte iChannel;
+  short iBand, delta;
+  uint16_t zigzag;
+  bool changed = false;
+
+  Channels &= cTraceChannelMask;
+  for (iChannel = 0; iChannel < cSpectrumNumChannels; iChannel++) {
+    if ((Channels & (1 << iChannel)) && (memcmp(sampleLevel[iChannel], lastLevel[iChannel], sizeof(lastLevel[iChannel])) != 0)) {changed = true;}
+  }
+  nFrames++;
+  if (!changed) {
+    WriteByte(Channels | cTraceUnchanged);
+    return;
+  }
+
+  WriteByte(Channels);
+  for (iChannel = 0; iChannel < cSpectrumNumChannels; iChannel++) {
+    if ((Channels & (1 << iChannel)) == 0) {continue;}
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      delta = sampleLevel[iChannel][iBand] - lastLevel[iChannel][iBand];
+      lastLevel[iChannel][iBand] = sampleLevel[iChannel][iBand];
+      zigzag = (delta >= 0) ? (((uint16_t) delta) << 1) : ((((uint16_t) -delta) << 1) - 1);
+      if (zigzag < 0x80) {WriteByte(zigzag);}
+      else {
+        WriteByte(0x80 | (zigzag >> 8));
+        WriteByte(zigzag & 0xFF);
+      }
+    }
+  }
+}
+
+/*____________________________
+LEDTracePlayer::LEDTracePlayer
+*/
+
+LEDTracePlayer::LEDTracePlayer() {
+  traceData = NULL;
+  traceBytes = tracePos = 0;
+  randomSeed = 0;
+  memset(noiseFloor, 0, sizeof(noiseFloor));
+  memset(frameLevel, 0, sizeof(frameLevel));
+  frameChannels = 0;
+  nFramesRead = 0;
+}
+
+/*__________________
+LEDTracePlayer::Open
+*/
+
+bool LEDTracePlayer::Open(const byte *Data, unsigned long nBytes) {
+  short iBand;
+
+  traceData = Data;
+  traceBytes = nBytes;
+  tracePos = nBytes;  //At the end, unless the header is good
+  memset(frameLevel, 0, sizeof(frameLevel));
+  frameChannels = 0;
+  nFramesRead = 0;
+
+  if ((Data == NULL) || (nBytes < (unsigned long) cTraceHeaderBytes)) {return false;}
+  if ((memcmp(Data, "LSTR", 4) != 0) || (Data[4] != cTraceVersion) || (Data[5] != cSegNumBands)) {return false;}
+  randomSeed = Data[8] | ((unsigned long) Data[9] << 8) | ((unsigned long) Data[10] << 16) | ((unsigned long) Data[11] << 24);
+  for (iBand = 0; iBand < cSegNumBands; iBand++) {noiseFloor[iBand] = Data[12 + 2 * iBand] | (Data[13 + 2 * iBand] << 8);}
+  tracePos = cTraceHeaderBytes;
+  return true;
+}
+
+/*_______________________
+LEDTracePlayer::NextFrame
+*/
+
+bool LEDTracePlayer::NextFrame() {
+  byte flags, iChannel;
+  short iBand;
+  uint16_t zigzag;
+
+  if (AtEnd()) {return false;}
+  flags = traceData[tracePos++];
+  frameChannels = flags & cTraceChannelMask;
+  nFramesRead++;
+  if (flags & cTraceUnchanged) {return true;}
+
+  for (iChannel = 0; iChannel < cSpectrumNumChannels; iChannel++) {
+    if ((frameChannels & (1 << iChannel)) == 0) {continue;}
+    for (iBand = 0; iBand < cSegNumBands; iBand++) {
+      if (AtEnd()) {return false;}
+      zigzag = traceData[tracePos++];
+      if (zigzag & 0x80) {
+        if (AtEnd()) {return false;}
+        zigzag = ((zigzag & 0x7F) << 8) | traceData[tracePos++];
+      }
+      frameLevel[iChannel][iBand] += (zigzag & 1) ? -(short) ((zigzag + 1) >> 1) : (short) (zigzag >> 1);
+    }
+  }
+  return true;
+}
+
+/*_________________________
+LEDTracePlayer::ReadChannel
+The channel as it was recorded, whatever doLeft and doRight say now: an asynchronous spectrum's mix
+is of the channels asked for the frame before.
+*/
+
+void LEDTracePlayer::ReadChannel(short *Levels, short nBands, byte Channel, bool doLeft, bool doRight) {
+  short iBand;
+
+  for (iBand = 0; iBand < nBands; iBand++) {Levels[iBand] = (iBand < cSegNumBands) ? frameLevel[Channel][iBand] : 0;}
+}
+
+/*_______________________
+LEDTracePlayer::ReadBands
+For callers other than a spectrum. Left only or right only is the mix when that channel wasn't
+recorded on its own, as the mix of one channel reads the same.
+*/
+
+void LEDTracePlayer::ReadBands(short *Levels, short nBands, bool doLeft, bool doRight) {
+  byte iChannel = cSpectrumMix;
+
+  if (doLeft && !doRight && (frameChannels & (1 << cSpectrumLeft))) {iChannel = cSpectrumLeft;}
+  else if (doRight && !doLeft && (frameChannels & (1 << cSpectrumRight))) {iChannel = cSpectrumRight;}
+  ReadChannel(Levels, nBands, iChannel, doLeft, doRight);
+}
@@ -0,0 +1,129 @@
+#ifndef _LEDSPECTRUMTRACE_H
+#define _LEDSPECTRUMTRACE_H
+
+#if ARDUINO >= 100
+ #include "Arduino.h"
+ #include "Print.h"
+#else
+ #include "WProgram.h"
+#endif
+
+#include "LEDSpectrum.h"
+
+/*
+Spectrum traces
+
+A trace is the band readings an LEDSpectrum took, sample by sample, before the noise floors and the
+AGC. Played back as the spectrum source of a freshly made strip with the same layout and random seed,
+it gives the same frames, bit for bit, as the strip that recorded it: live audio becomes repeatable
+input for chasing a glitch, or for timing and checking one build of the renderer against another
+(extras/host, lightorgan_trace).
+
+All numbers are little endian. The file starts with a 26 byte header:
+  0  'L' 'S' 'T' 'R'
+  4  byte    version (cTraceVersion)
+  5  byte    number of bands (cSegNumBands)
+  6  uint16  0
+  8  uint32  the recording strip's random seed (LEDSegs::GetRandomSeed())
+  12 uint16  noise floor of each band, 7 of them
+Then, for each sample:
+  byte    flags: the channels read (1 << cSpectrumXxx) in the low three bits, and cTraceUnchanged
+  data    unless cTraceUnchanged: for each channel read, in channel order, each band's reading
+          (0..1023) as the difference from that channel's last recorded reading (0 at the start)
+Differences are zigzag coded (0, -1, 1, -2... as 0, 1, 2, 3...) into z, then stored as one byte z
+for z < 128, or two bytes 0x80 | (z >> 8), z & 0xFF. A sample where every channel read the same as
+its last reading is just the flags byte with cTraceUnchanged set.
+*/
+
+const byte cTraceVersion = 1;
+const short cTraceHeaderBytes = 26;
+const byte cTraceChannelMask = 0x07;
+const byte cTraceUnchanged = 0x08;
+
+/*______________
+LEDTraceRecorder
+Writes a spectrum's samples as a trace to any Print (Serial, an SD card File):
+
+  LEDTraceRecorder recorder;
+  recorder.Begin(Serial, strip->GetSpectrum(), strip->GetRandomSeed());
+  ...
+  strip->DisplaySpectrum(true, true);  //Each sample read is recorded
+
+For an exact replay, begin before the strip's first frame: the strip and the AGC carry over what
+they have seen, and the trace doesn't.
+*/
+
+class LEDTraceRecorder {
+
+  public:
+    LEDTraceRecorder();
+    ~LEDTraceRecorder() {End();}
+
+    //Write the header and record Spectrum's samples from now on
+    void Begin(Print &Out, LEDSpectrum *Spectrum, unsigned long RandomSeed);
+    void End();
+
+    unsigned long GetNumFrames() {return nFrames;}
+    unsigned long GetNumBytes() {return nBytes;}
+
+    //Called by the spectrum as it reads each band, and when the sample is complete
+    void StoreBand(byte iChannel, short iBand, short Level) {sampleLevel[iChannel][iBand] = constrain(Level, 0, 1023);}
+    void EndSample(byte Channels);
+
+  private:
+    Print *out;
+    LEDSpectrum *spectrum;
+    short sampleLevel[cSpectrumNumChannels][cSegNumBands];  //This sample's readings
+    short lastLevel[cSpectrumNumChannels][cSegNumBands];    //Each channel's last recorded readings
+    unsigned long nFrames, nBytes;
+
+    void WriteByte(byte Value) {out->write(Value); nBytes++;}
+    void WriteWord(uint16_t Value) {WriteByte(Value & 0xFF); WriteByte(Value >> 8);}
+};
+
+/*____________
+LEDTracePlayer
+A spectrum source that plays a trace back, a sample at a time, from memory (a memory-mapped file on
+the host). Open it before making it the source, as the source's noise floors are taken then:
+
+  player.Open(traceData, traceBytes);
+  strip->SetSpectrumSource(&player);
+  strip->ResetRandom(player.GetRandomSeed());
+  while (!player.AtEnd()) {strip->DisplaySpectrum(true, true);}
+
+A sample past the end of the trace reads the same as the last one.
+*/
+
+class LEDTracePlayer : public LEDSpectrumSource {
+
+  public:
+    LEDTracePlayer();
+
+    //Start a trace. Returns false if the header is bad.
+    bool Open(const byte *Data, unsigned long nBytes);
+    bool Rewind() {return Open(traceData, traceBytes);}
+
+    //Decode the next sample. Returns false at the end of the trace or if the data is bad.
+    bool NextFrame();
+    bool AtEnd() {return tracePos >= traceBytes;}
+
+    unsigned long GetRandomSeed() {return randomSeed;}
+    unsigned long GetFrameIndex() {return nFramesRead;}  //Samples decoded so far
+
+    //LEDSpectrumSource
+    void StartSample() {NextFrame();}
+    void ReadBands(short *Levels, short nBands, bool doLeft, bool doRight);
+    void ReadChannel(short *Levels, short nBands, byte Channel, bool doLeft, bool doRight);
+    short GetNoiseFloor(short iBand) {return noiseFloor[iBand];}
+
+  private:
+    const byte *traceData;
+    unsigned long traceBytes, tracePos;
+    unsigned long randomSeed;
+    short noiseFloor[cSegNumBands];
+    short frameLevel[cSpectrumNumChannels][cSegNumBands];  //Each channel's last decoded readings
+    byte frameChannels;                                    //Channels in the last decoded sample
+    unsigned long nFramesRead;
+};
+
+#endif
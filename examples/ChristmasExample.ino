@@ -1,16 +1,18 @@
 //An exmaple of using LEDSegs to drive a Christmas display
 
 #include <LEDSegs.h>
+#include <LEDFrameScheduler.h>
 
-//Our LED strip instance pointer
+//Our LED strip instance pointer, and the scheduler that runs its display cycles
 LEDSegs* strip;
+LEDFrameScheduler* scheduler;
 
 const short nTotalLEDs = 30; //Total number of LEDs in the strip (160 for a 5-meter 32/meter strip uncut)
 const short nFirstLED = 0; //First LED to turn on (0-origin)
 const short nLastLED = nTotalLEDs - 1; //Max LED index to illuminate. Must be < nTotalLEDs
-const unsigned long refreshDelayMS = 35UL; //Min time between strip update cycles (in milliseconds)
+const unsigned long refreshDelayMS = 35UL; //Time between strip update cycles (in milliseconds)
 const unsigned long segmentSetDisplayTimeMS = 20000UL; //Amount of time to display each segment set
-unsigned static long waitforSegmentTimeMS, thisSegmentSet; //Keeps track of which segment set we're doing and how long
+unsigned static long thisSegmentSet; //Keeps track of which segment set we're doing
 
 //This is an array of segment display setup subroutines that are selected by the
 //four toggle switches. When the state of the switches changes, the current strip setup
@@ -47,115 +49,103 @@ void SegmentProgram1StaticColor() {
 */
 
 /*
-SegmentProgramChristmas1: 5 simple segments
+SegmentProgramChristmas1: 5 simple segments. The layout never changes, so it is a segment program
+kept in flash.
 */
 
-void SegmentProgramChristmas1() {
-  short nLEDsPerSegment, iSegment;
-  const short nSegments = 5;
-  const short bands[nSegments] = {cSegBand2, cSegBand3, cSegBand4, cSegBand5, cSegBand6};
-  uint32_t Colors5[nSegments] = {RGBRed, RGBGold, RGBPurple, RGBGreen, RGBBlue};
-
-  //segments of equal # of LEDs.
-  nLEDsPerSegment = (nLastLED - nFirstLED + 1) / nSegments;
+const short nLEDsChristmas1 = (nLastLED - nFirstLED + 1) / 5;  //segments of equal # of LEDs.
+const LEDSegs::stripSegment ProgramChristmas1[] PROGMEM = {
+  LEDSegs::ProgramSegment(nFirstLED,                       nLEDsChristmas1, cSegActionRandom, RGBRed,    cSegBand2),
+  LEDSegs::ProgramSegment(nFirstLED + nLEDsChristmas1,     nLEDsChristmas1, cSegActionRandom, RGBGold,   cSegBand3),
+  LEDSegs::ProgramSegment(nFirstLED + 2 * nLEDsChristmas1, nLEDsChristmas1, cSegActionRandom, RGBPurple, cSegBand4),
+  LEDSegs::ProgramSegment(nFirstLED + 3 * nLEDsChristmas1, nLEDsChristmas1, cSegActionRandom, RGBGreen,  cSegBand5),
+  LEDSegs::ProgramSegment(nFirstLED + 4 * nLEDsChristmas1, nLEDsChristmas1, cSegActionRandom, RGBBlue,   cSegBand6),
+};
 
-  //Define the active segments
-   for (iSegment = 0; iSegment < nSegments; iSegment++) {
-    strip->DefineSegment((iSegment*nLEDsPerSegment)+nFirstLED, nLEDsPerSegment, cSegActionRandom, Colors5[iSegment], bands[iSegment]);
-  }
+void SegmentProgramChristmas1() {
+  strip->LoadProgram(ProgramChristmas1);
 }
 
 /*
 SegmentProgramChristmas2: Pulsing solid color all spectra -- Choose a new color each call
 */
 
+short C2ColorIndex = 0;
+
+//The LED intensity isn't linear with level, so these level steps give segments that are defined
+//as static/modulate better "action"
+const byte C2Transform = 1;
+const short nC2Cuts = 9;
+const short C2CutLevels[nC2Cuts] = { 40, 150, 225, 400, 500, 600, 700, 800, 950};
+const short C2MapLevels[nC2Cuts] = {  0,   1,  10,  30,  60, 200, 400, 700, cMaxSegmentLevel};
+
 void SegmentProgramChristmas2() {
   short nLEDs;
   const short nColors = 6;
   uint32_t foreColors[nColors] = {RGBRed, RGBGreen, RGBBlue, RGBGold, RGBPurple, RGBWhiteDim};
-  static short thisColor = -1;
 
-  thisColor = (thisColor + 1) % nColors;  
+  if (C2ColorIndex >= nColors) {C2ColorIndex = 0;}
   nLEDs = nLastLED - nFirstLED + 1;
 
-  strip->DefineSegment(nFirstLED, nLEDs, cSegActionStatic, foreColors[thisColor], 0x0E);
+  strip->SetLevelTransform(C2Transform, C2CutLevels, C2MapLevels, nC2Cuts, 0, cMaxSegmentLevel, false, true);  //Steps
+  strip->DefineSegment(nFirstLED, nLEDs, cSegActionStatic, foreColors[C2ColorIndex], 0x0E);
   strip->SetSegment_Options(cSegOptModulateSegment);
-  strip->SetSegment_DisplayRoutine(&DisplayRoutineModulateHelper);
-}
-
-//The LED intensity isn't linear with level, so this display routine provides segments that are
-//defined as static/modulate with better "action"
-void DisplayRoutineModulateHelper(short iSegment) {
-  const short nCuts = 9;
-  const short C2CutLevels[nCuts] = { 40, 150, 225, 400, 500, 600, 700, 800, 950};
-  const short C2MapLevels[nCuts] = {  0,   1,  10,  30,  60, 200, 400, 700, cMaxSegmentLevel};
-  short iLevel, thisLevel;
-  thisLevel = strip->GetSegment_Level(iSegment);
-  for (iLevel = 0; iLevel < (nCuts-1); iLevel++) {
-    if (thisLevel < C2CutLevels[iLevel]) {break;}
-  }
-  strip->SetSegment_Level(C2MapLevels[iLevel]);
+  strip->SetSegment_Transform(C2Transform);
+  C2ColorIndex++;
 }
 
 /*
 SegmentProgramChristmas3: Two interleaved red/green solid segments for all spectra, green one inverted
 */
 
-void SegmentProgramChristmas3() {
-  short nLEDs = nLastLED - nFirstLED + 1;
-
-  strip->DefineSegment(nFirstLED, nLEDs, cSegActionFromBottom, RGBRed, cSegBand2 | cSegBand3);
-  strip->SetSegment_Spacing(1);
+const short nLEDsChristmas3 = nLastLED - nFirstLED + 1;
+const LEDSegs::stripSegment ProgramChristmas3[] PROGMEM = {
+  //First LED, # LEDs, action, color, bands, back color, options, spacing
+  LEDSegs::ProgramSegment(nFirstLED,     nLEDsChristmas3,     cSegActionFromBottom, RGBRed,   cSegBand2 | cSegBand3,             RGBOff, 0, 1),
+  LEDSegs::ProgramSegment(nFirstLED + 1, nLEDsChristmas3 - 1, cSegActionFromTop,    RGBGreen, cSegBand4 | cSegBand5 | cSegBand6, RGBOff, 0, 1),
+};
 
-  strip->DefineSegment(nFirstLED + 1, nLEDs - 1, cSegActionFromTop, RGBGreen, cSegBand4 | cSegBand5 | cSegBand6);
-  strip->SetSegment_Spacing(1);
+void SegmentProgramChristmas3() {
+  strip->LoadProgram(ProgramChristmas3);
 }
 
 /*
 SegmentProgramChristmas4: Three segments
 */
 
-void SegmentProgramChristmas4() {
-  short nLEDs = nLastLED - nFirstLED + 1;
-  short nLEDsPerSegment = nLEDs / 3;
-
-  strip->DefineSegment(nFirstLED, nLEDsPerSegment, cSegActionFromTop, RGBRed, 0x02);
-  strip->SetSegment_BackColor(RGBBlueVeryDim);
-  strip->SetSegment_Options(cSegOptModulateSegment);
-
-  strip->DefineSegment(nFirstLED + nLEDsPerSegment + 1, nLEDsPerSegment, cSegActionFromMiddle, RGBGold, 0x0C);
-  strip->SetSegment_BackColor(RGBBlueVeryDim);
-  strip->SetSegment_Options(cSegOptModulateSegment);
+const short nLEDsChristmas4 = (nLastLED - nFirstLED + 1) / 3;
+const LEDSegs::stripSegment ProgramChristmas4[] PROGMEM = {
+  LEDSegs::ProgramSegment(nFirstLED,                           nLEDsChristmas4, cSegActionFromTop,    RGBRed,   0x02, RGBBlueVeryDim, cSegOptModulateSegment),
+  LEDSegs::ProgramSegment(nFirstLED + nLEDsChristmas4 + 1,     nLEDsChristmas4, cSegActionFromMiddle, RGBGold,  0x0C, RGBBlueVeryDim, cSegOptModulateSegment),
+  LEDSegs::ProgramSegment(nFirstLED + 2 * nLEDsChristmas4 + 1, nLEDsChristmas4, cSegActionFromBottom, RGBGreen, 0x30, RGBBlueVeryDim, cSegOptModulateSegment),
+};
 
-  strip->DefineSegment(nFirstLED + (2*nLEDsPerSegment) + 1, nLEDsPerSegment, cSegActionFromBottom, RGBGreen, 0x30);
-  strip->SetSegment_BackColor(RGBBlueVeryDim);
-  strip->SetSegment_Options(cSegOptModulateSegment);
+void SegmentProgramChristmas4() {
+  strip->LoadProgram(ProgramChristmas4);
 }
 
 /*
 SegmentProgramChristmas5: 5 interleaved segments of different colors (my favorite - this is really awesome)
 */
 
-void SegmentProgramChristmas5() {
-  short nLEDsPerSegment, iSegment;
-  const short nSegments = 5;
-  const short bands[] = {cSegBand2, cSegBand3, cSegBand4, cSegBand5, cSegBand6};
-  uint32_t Colors5[] = {RGBRed, RGBYellow, RGBPurple, RGBBlue, RGBGreen};
-
-  nLEDsPerSegment = (nLastLED - nFirstLED + 1);
+const short nLEDsChristmas5 = nLastLED - nFirstLED + 1;
+const LEDSegs::stripSegment ProgramChristmas5[] PROGMEM = {
+  LEDSegs::ProgramSegment(nFirstLED,     nLEDsChristmas5, cSegActionRandom, RGBRed,    cSegBand2, RGBOff, 0, 4),
+  LEDSegs::ProgramSegment(nFirstLED + 1, nLEDsChristmas5, cSegActionRandom, RGBYellow, cSegBand3, RGBOff, 0, 4),
+  LEDSegs::ProgramSegment(nFirstLED + 2, nLEDsChristmas5, cSegActionRandom, RGBPurple, cSegBand4, RGBOff, 0, 4),
+  LEDSegs::ProgramSegment(nFirstLED + 3, nLEDsChristmas5, cSegActionRandom, RGBBlue,   cSegBand5, RGBOff, 0, 4),
+  LEDSegs::ProgramSegment(nFirstLED + 4, nLEDsChristmas5, cSegActionRandom, RGBGreen,  cSegBand6, RGBOff, 0, 4),
+};
 
-  //Define the active segments
-   for (iSegment = 0; iSegment < nSegments; iSegment++) {
-    strip->DefineSegment(nFirstLED + iSegment, nLEDsPerSegment, cSegActionRandom, Colors5[iSegment], bands[iSegment]);
-    strip->SetSegment_Spacing(nSegments-1);
-  }
+void SegmentProgramChristmas5() {
+  strip->LoadProgram(ProgramChristmas5);
 }
 
 /*
 SegmentProgramChristmas6: Adjacent segments with a custom display routine
 */
 
-const short nSegmentsChristmas6 = 40;
+const short nSegmentsChristmas6 = 10;  //3 LEDs each. Also sizes the strip (see setup), so keep it small on an Uno
 short levelsChristmas6[nSegmentsChristmas6 + 1];
 short C6ColorIndex = 0;
 uint32_t C6SegColors[] = {RGBBlue, RGBGold, RGBYellow, RGBPurple, RGBOrange, RGBSilver};  //Colors to cycle
@@ -294,40 +284,62 @@ The Arduino boot setup routine
 
 void setup() {
 
-  //Create the strip class instance we will use
-  strip = new LEDSegs(nTotalLEDs, 6, NEO_GRB + NEO_KHZ800);
+  //Create the strip class instance we will use, with room for the most segments any program defines (Christmas6)
+  strip = new LEDSegsN<nSegmentsChristmas6>(nTotalLEDs, 6, NEO_GRB + NEO_KHZ800);
   
-  //Make sure we see a "change" to start the segment sets cycling
+  //Display cycles every refreshDelayMS, and a new segment set every segmentSetDisplayTimeMS (starting now)
   thisSegmentSet = -1;
-  waitforSegmentTimeMS = 0;
+  scheduler = new LEDFrameScheduler(strip, 1000UL / refreshDelayMS);
+  scheduler->AddTask(NextSegmentSet, segmentSetDisplayTimeMS);
 #if defined DIAGINITSERIAL
   Serial.begin(9600);
   Serial.println(""); Serial.println("----- Starting Sketch -----");
+  ReportSRAM();
 #endif
 }
 
+#if defined DIAGINITSERIAL
 /*
-The Arduino main loop. Just sample and display with a wait
+Report the strip's heap now and at its peak, and (on AVR) the SRAM still free between the heap and
+the stack. The peak includes the map built on each program's second display cycle, so it is
+reported for the programs shown so far.
 */
 
-void loop() {
-  uint32_t startRefreshMS;       //MS time at the start of this refresh cycle;
-
-  //Get the current time
-  startRefreshMS = millis();
-
-  //If time for this segment set has run out, reset thetimer and move to the next segment set (cyclic)
-  if (waitforSegmentTimeMS <= startRefreshMS) {
-    waitforSegmentTimeMS = startRefreshMS + segmentSetDisplayTimeMS; //Set the time for the upcoming segment set
-    thisSegmentSet++; //Move to the next segment set (cycling)
-    if (thisSegmentSet >= nSegmentSets) {thisSegmentSet = 0;};
-    strip->ResetStrip();
-    SegmentSetups[thisSegmentSet]();
-  }  
-  
-  //Do the deed
-  strip->DisplaySpectrum(true, true);
+#if defined(__AVR__)
+extern char *__brkval;
+extern char __heap_start;
+#endif
+
+void ReportSRAM() {
+  Serial.print("Strip heap "); Serial.print(strip->GetHeapBytes());
+  Serial.print(" peak "); Serial.print(strip->GetPeakHeapBytes());
+#if defined(__AVR__)
+  char stackTop;
+  Serial.print(" free "); Serial.print(&stackTop - ((__brkval == NULL) ? &__heap_start : __brkval));
+#endif
+  Serial.println("");
+}
+#endif
+
+/*
+Move to the next segment set (cyclic). Run by the scheduler every segmentSetDisplayTimeMS.
+*/
+
+void NextSegmentSet() {
+  thisSegmentSet++;
+  if (thisSegmentSet >= nSegmentSets) {thisSegmentSet = 0;};
+  strip->ResetStrip();
+  SegmentSetups[thisSegmentSet]();
+#if defined DIAGINITSERIAL
+  ReportSRAM();
+#endif
+}
+
+/*
+The Arduino main loop. The scheduler samples and displays when each cycle is due, and switches
+segment sets; the time in between is free for anything else.
+*/
 
-  //Wait for the minimum refresh time;
-  while (millis() < (startRefreshMS + refreshDelayMS)) {;}
+void loop() {
+  scheduler->Service();
 }
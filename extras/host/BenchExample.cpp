@@ -0,0 +1,50 @@
+//Builds examples/ChristmasExample.ino as plain C++ so the benchmark can run its segment programs.
+//The Arduino IDE generates these prototypes for a sketch; a plain compiler needs them up front.
+
+#include <LEDSegs.h>
+
+void SegmentProgramChristmas1();
+void SegmentProgramChristmas2();
+void SegmentProgramChristmas3();
+void SegmentProgramChristmas4();
+void SegmentProgramChristmas5();
+void SegmentProgramChristmas6();
+void SegmentProgramChristmas7();
+void SegmentProgramChristmas8();
+void SegmentProgramChristmas9();
+void SegmentDisplayChristmas6(short iSegment);
+void SegmentDisplayChristmas7(short iSegment);
+void SegmentDisplayChristmas8(short iSegment);
+void NextSegmentSet();
+
+#include "../../examples/ChristmasExample.ino"
+
+#include "BenchExample.h"
+
+static const SegmentSetupRoutine ExamplePrograms[] = {
+  SegmentProgramChristmas1,
+  SegmentProgramChristmas2,
+  SegmentProgramChristmas3,
+  SegmentProgramChristmas4,
+  SegmentProgramChristmas5,
+  SegmentProgramChristmas6,
+  SegmentProgramChristmas7,
+  SegmentProgramChristmas8,
+  SegmentProgramChristmas9,
+};
+
+short BenchExampleNumPrograms() {return SIZEOF_ARRAY(ExamplePrograms);}
+short BenchExampleNumLEDs() {return nTotalLEDs;}
+
+void BenchExampleDefine(short iProgram, LEDSegs *target) {
+  strip = target;
+
+  //The programs pick the next color in their cycle each time they are set up. Start each cycle
+  //over, so a program looks the same every time the benchmark runs it.
+  C2ColorIndex = 0;
+  C6ColorIndex = 0;
+  C7ColorIndex = 0;
+  C7LastStartPos = 0;
+  C9ColorIndex = 0;
+  ExamplePrograms[iProgram]();
+}
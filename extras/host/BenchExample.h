@@ -0,0 +1,15 @@
+#ifndef _BENCHEXAMPLE_H
+#define _BENCHEXAMPLE_H
+
+//The segment programs from examples/ChristmasExample.ino (SegmentProgramChristmas1..9)
+
+class LEDSegs;
+
+short BenchExampleNumPrograms();
+short BenchExampleNumLEDs();  //The example's nTotalLEDs
+
+//Define program iProgram (0-origin) on the target strip, from the start of its color cycle. The
+//example's display routines keep talking to that strip until the next call.
+void BenchExampleDefine(short iProgram, LEDSegs *target);
+
+#endif
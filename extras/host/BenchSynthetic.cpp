@@ -0,0 +1,45 @@
+//Synthetic segment layouts for the benchmarks
+
+#include <LEDSegs.h>
+#include "BenchSynthetic.h"
+
+/*__________________
+BenchDefineSynthetic
+A synthetic layout for an n-LED strip: a dim static background plus up to cMaxSegments
+overlapping segments that cycle through every action, spacing and option.
+*/
+
+void BenchDefineSynthetic(LEDSegs *strip, short nLEDs) {
+  static const short actions[] = {cSegActionFromBottom, cSegActionFromTop, cSegActionFromMiddle, cSegActionStatic, cSegActionRandom};
+  static const uint32_t colors[] = {RGBRed, RGBGold, RGBPurple, RGBGreen, RGBBlue, RGBOrange, RGBSilver};
+  short nSegments, nLEDsPerSegment, iSegment, first;
+
+  nSegments = constrain(nLEDs / 10, 1, cMaxSegments - 1);
+  nLEDsPerSegment = nLEDs / nSegments;
+
+  strip->DefineSegment(0, nLEDs, cSegActionStatic, RGBBlueVeryDim, 0);
+  for (iSegment = 0; iSegment < nSegments; iSegment++) {
+    //Every third segment overlaps its neighbour by half a segment
+    first = iSegment * nLEDsPerSegment;
+    if ((iSegment % 3) == 2) {first -= nLEDsPerSegment / 2;}
+
+    strip->DefineSegment(first, nLEDsPerSegment, actions[iSegment % SIZEOF_ARRAY(actions)],
+      colors[iSegment % SIZEOF_ARRAY(colors)], (cSegBand2 << (iSegment % 5)) | ((iSegment & 1) ? cSegBand4 : 0));
+    if ((iSegment % 4) == 1) {strip->SetSegment_BackColor(RGBWhiteVeryDim);}
+    strip->SetSegment_Spacing((iSegment % 6) == 5 ? 1 : 0);
+    strip->SetSegment_Options(
+        ((iSegment % 4) == 1 ? cSegOptModulateSegment : 0)
+      | ((iSegment % 5) == 3 ? cSegOptNoOffOverwrite : 0)
+      | ((iSegment % 7) == 6 ? cSegOptInvertLevel : 0));
+  }
+}
+
+/*________________
+BenchDefineSparkle
+*/
+
+void BenchDefineSparkle(LEDSegs *strip, short nLEDs) {
+  strip->DefineSegment(0, nLEDs, cSegActionStatic, RGBBlueVeryDim, 0);
+  strip->DefineSegment(0, nLEDs, cSegActionRandom, RGBGold, cSegBand2 | cSegBand3);
+  strip->DefineSegment(0, nLEDs, cSegActionRandom, RGBWhite, cSegBand5 | cSegBand6);
+}
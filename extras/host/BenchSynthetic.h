@@ -0,0 +1,14 @@
+#ifndef _BENCHSYNTHETIC_H
+#define _BENCHSYNTHETIC_H
+
+class LEDSegs;
+
+//A synthetic layout for an n-LED strip: a dim static background plus up to cMaxSegments
+//overlapping segments that cycle through every action, spacing and option.
+void BenchDefineSynthetic(LEDSegs *strip, short nLEDs);
+
+//Sparkle over the whole of an n-LED strip: random segments over a static background, so every LED
+//is contested and keeps a stack of layers in the composite map (three per LED).
+void BenchDefineSparkle(LEDSegs *strip, short nLEDs);
+
+#endif
@@ -0,0 +1,246 @@
+//Host implementations of the Arduino core stand-ins declared in sim/Arduino.h and sim/Print.h,
+//plus the simulated MSGEQ7 spectrum shield they read from.
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include <stdio.h>
+#include <time.h>
+#include <mutex>
+
+//Pins the Bliptronics shield is wired to (match LEDSegs' cSpectrumReset/cSpectrumStrobe)
+const uint8_t cHostSpectrumReset = 5;
+const uint8_t cHostSpectrumStrobe = 4;
+const short cHostNumBands = 7;
+
+static HostSimStats simStats;
+static unsigned long long simMicros;
+static HostAudioGenerator simAudio = HostSimDefaultAudio;
+static unsigned long simAudioSeed;
+static unsigned long simSample;   //Audio sample (full multiplexer pass) being read out
+static short simBand;             //Band the shield's multiplexer currently outputs
+static uint8_t simStrobe, simReset;
+static uint32_t simRandomCtx = 1;
+static bool simAdcPending;        //An interrupt-driven conversion is in progress
+static unsigned long long simAdcDone; //...and completes at this time
+static int simAdcValue;
+static void (*simAdcInterrupt)() = NULL;
+static bool simShowBlocksInterrupts = true;
+static std::mutex simShowLock;
+
+/*____________
+HostSimReset
+*/
+
+void HostSimReset(unsigned long seed) {
+  memset(&simStats, 0, sizeof(simStats));
+  simMicros = 0;
+  simAudioSeed = seed;
+  simSample = 0;
+  simBand = 0;
+  simStrobe = LOW;
+  simReset = LOW;
+  simRandomCtx = 1;
+  simAdcPending = false;
+}
+
+/*______________
+HostSimAdvance
+Move the virtual clock on by us, running the ADC interrupt when its conversion completes on the way
+(or, with interrupts off, leaving it pending).
+*/
+
+static void HostSimAdvance(unsigned long long us, bool interrupts) {
+  unsigned long long until = simMicros + us;
+
+  while (interrupts && simAdcPending && (simAdcDone <= until)) {
+    if (simAdcDone > simMicros) {simMicros = simAdcDone;}
+    simAdcPending = false;
+    if (simAdcInterrupt != NULL) {simAdcInterrupt();}
+  }
+  simMicros = until;
+}
+
+void HostSimSetAudio(HostAudioGenerator generator) {simAudio = (generator != NULL) ? generator : HostSimDefaultAudio;}
+const HostSimStats &HostSimGetStats() {return simStats;}
+unsigned long long HostSimMicros() {return simMicros;}
+void HostSimAdvanceMicros(unsigned long long us) {HostSimAdvance(us, true);}
+void HostSimSetShowBlocksInterrupts(bool blocks) {simShowBlocksInterrupts = blocks;}
+
+void HostSimShow(unsigned short nLEDs) {
+  unsigned long long us = ((unsigned long long) nLEDs) * cHostShowMicrosPerLED + cHostShowLatchMicros;
+  std::lock_guard<std::mutex> lock(simShowLock);  //The multithreaded renderer shows strips concurrently
+
+  simStats.shows++;
+  simStats.ledsShown += nLEDs;
+  simStats.showMicros += us;
+  HostSimAdvance(us, !simShowBlocksInterrupts);
+  HostSimAdvance(0, true);  //Interrupts held off by show() run now
+}
+
+/*___________________
+HostSimDefaultAudio
+A repeatable stand-in for music: a kick on the low bands every 16 samples, slowly wandering mid
+and high bands, noise on everything, and a quiet stretch (noise floor only) every 256 samples so
+the idle-frame paths get exercised too.
+*/
+
+static uint32_t HostHash(uint32_t x) {
+  x ^= x >> 16; x *= 0x7FEB352DUL;
+  x ^= x >> 15; x *= 0x846CA68BUL;
+  x ^= x >> 16;
+  return x;
+}
+
+short HostSimDefaultAudio(short channel, short band, unsigned long sample) {
+  static const short bandBase[cHostNumBands] = {80, 80, 85, 95, 95, 105, 115};
+  long level, phase;
+  unsigned long beat;
+
+  level = bandBase[band] + (HostHash((sample * 16 + band * 2 + channel) ^ (simAudioSeed * 0x9E3779B9UL)) & 0x1F);
+  if ((sample & 0xFF) >= 208) {return level;}  //Quiet stretch
+
+  beat = sample & 0x0F;
+  if (band <= 1) {level += (700 >> beat);}
+  phase = ((long) ((sample * (band + 3) + simAudioSeed * 37) & 0x7F)) - 64;
+  level += 500 - (phase * phase) / 10 + (channel ? 20 : 0);
+  level += HostHash(sample * 131 + band) & 0x7F;
+  return constrain(level, 0, 1023);
+}
+
+/*_____________________
+Digital and analog I/O
+*/
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  simStats.digitalWrites++;
+  if (pin == cHostSpectrumReset) {
+    if (val == HIGH) {simBand = 0;}
+    simReset = val;
+  }
+  else if (pin == cHostSpectrumStrobe) {
+    //The multiplexer steps to the next band on each falling strobe edge while not held in reset
+    if ((simStrobe == HIGH) && (val == LOW) && (simReset == LOW)) {
+      simBand++;
+      if (simBand >= cHostNumBands) {simBand = 0; simSample++;}
+    }
+    simStrobe = val;
+  }
+}
+
+int analogRead(uint8_t pin) {
+  int value = (pin > 1) ? 0 : simAudio(pin, simBand, simSample);
+
+  simStats.analogReads++;
+  simStats.adcMicros += cHostAdcMicros;
+  HostSimAdvance(cHostAdcMicros, true);
+  return value;
+}
+
+//The shield's output is sampled when the conversion starts
+void hostAdcStart(uint8_t pin) {
+  simStats.analogReads++;
+  simStats.adcMicros += cHostAdcMicros;
+  simAdcValue = (pin > 1) ? 0 : simAudio(pin, simBand, simSample);
+  simAdcDone = simMicros + cHostAdcMicros;
+  simAdcPending = true;
+}
+
+void hostAdcStop() {simAdcPending = false;}
+int hostAdcResult() {return simAdcValue;}
+void hostAdcAttachInterrupt(void (*isr)()) {simAdcInterrupt = isr;}
+
+/*____
+Time
+*/
+
+unsigned long micros() {return (unsigned long) simMicros;}
+unsigned long millis() {return (unsigned long) (simMicros / 1000);}
+void delay(unsigned long ms) {HostSimAdvance(((unsigned long long) ms) * 1000, true);}
+void delayMicroseconds(unsigned int us) {HostSimAdvance(us, true);}
+
+uint32_t hostCycles() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t) (((unsigned long long) now.tv_sec) * 1000000000ULL + now.tv_nsec);
+}
+
+/*_________________________________________
+Random -- same generator as avr-libc/Arduino
+*/
+
+static long HostRandom() {
+  int32_t hi, lo, x;
+
+  x = (int32_t) simRandomCtx;
+  if (x == 0) {x = 123459876L;}
+  hi = x / 127773L;
+  lo = x % 127773L;
+  x = 16807L * lo - 2836L * hi;
+  if (x < 0) {x += 0x7FFFFFFFL;}
+  simRandomCtx = x;
+  return x;
+}
+
+void randomSeed(unsigned long seed) {if (seed != 0) {simRandomCtx = (uint32_t) seed;}}
+
+long random(long howbig) {
+  if (howbig == 0) {return 0;}
+  return HostRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {return howsmall;}
+  return random(howbig - howsmall) + howsmall;
+}
+
+/*______________
+Print and Serial
+*/
+
+HostSerial Serial;
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {n += write(*buffer++);}
+  return n;
+}
+
+static size_t PrintNumber(Print *out, unsigned long n, int base, bool negative) {
+  char buf[8 * sizeof(long) + 2];
+  char *str = &buf[sizeof(buf) - 1];
+
+  if (base < 2) {base = 10;}
+  *str = '\0';
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  if (negative) {*--str = '-';}
+  return out->write((const uint8_t *) str, strlen(str));
+}
+
+size_t Print::print(const char str[]) {return write((const uint8_t *) str, strlen(str));}
+size_t Print::print(char c) {return write((uint8_t) c);}
+size_t Print::print(int n, int base) {return print((long) n, base);}
+size_t Print::print(unsigned int n, int base) {return print((unsigned long) n, base);}
+size_t Print::print(long n, int base) {
+  if ((base == 10) && (n < 0)) {return PrintNumber(this, (unsigned long) -n, base, true);}
+  return PrintNumber(this, (unsigned long) n, base, false);
+}
+size_t Print::print(unsigned long n, int base) {return PrintNumber(this, n, base, false);}
+
+size_t Print::println() {return write((const uint8_t *) "\r\n", 2);}
+size_t Print::println(const char c[]) {size_t n = print(c); return n + println();}
+size_t Print::println(char c) {size_t n = print(c); return n + println();}
+size_t Print::println(int num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(unsigned int num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(long num, int base) {size_t n = print(num, base); return n + println();}
+size_t Print::println(unsigned long num, int base) {size_t n = print(num, base); return n + println();}
+
+size_t HostSerial::write(uint8_t c) {return fwrite(&c, 1, 1, stdout);}
+size_t HostSerial::write(const uint8_t *buffer, size_t size) {return fwrite(buffer, 1, size, stdout);}
+void HostSerial::flush() {fflush(stdout);}
@@ -0,0 +1,193 @@
+//Host multithreaded renderer. See HostEngine.h.
+
+#include "HostEngine.h"
+
+/*_________________________
+HostWorkPool::HostWorkPool
+*/
+
+HostWorkPool::HostWorkPool(short nThreads) : batchNumber(0), stopping(false), batchRoutine(NULL), batchContext(NULL),
+  batchRemaining(0), nSteals(0) {
+  short iThread;
+
+  if (nThreads <= 0) {nThreads = max((unsigned) std::thread::hardware_concurrency(), 1U);}
+  nPoolThreads = nThreads;
+  queues = new workQueue[nPoolThreads];
+
+  //Thread 0 is the caller of Run()
+  for (iThread = 1; iThread < nPoolThreads; iThread++) {threads.push_back(std::thread(&HostWorkPool::ThreadMain, this, iThread));}
+}
+
+HostWorkPool::~HostWorkPool() {
+  {
+    std::lock_guard<std::mutex> lock(batchLock);
+    stopping = true;
+  }
+  batchStart.notify_all();
+  for (size_t i = 0; i < threads.size(); i++) {threads[i].join();}
+  delete[] queues;
+}
+
+/*________________
+HostWorkPool::Run
+*/
+
+void HostWorkPool::Run(TaskRoutine routine, void *context, long nTasks) {
+  short iThread;
+  long iTask, blockSize;
+
+  if (nTasks <= 0) {return;}
+
+  //Set up the batch before any of its tasks are queued: a thread still finishing the last batch
+  //may pick them up straight away
+  {
+    std::lock_guard<std::mutex> lock(batchLock);
+    batchRoutine = routine;
+    batchContext = context;
+    batchRemaining = nTasks;
+    batchNumber++;
+  }
+
+  //Deal the tasks out in contiguous blocks, so neighbouring tasks (and the memory they touch) tend
+  //to stay on one thread unless it falls behind
+  blockSize = (nTasks + nPoolThreads - 1) / nPoolThreads;
+  for (iThread = 0; iThread < nPoolThreads; iThread++) {
+    std::lock_guard<std::mutex> lock(queues[iThread].queueLock);
+    for (iTask = iThread * blockSize; (iTask < (iThread + 1) * blockSize) && (iTask < nTasks); iTask++) {
+      queues[iThread].queueTasks.push_back(iTask);
+    }
+  }
+  batchStart.notify_all();
+
+  WorkBatch(0);
+
+  std::unique_lock<std::mutex> lock(batchLock);
+  batchDone.wait(lock, [this] {return batchRemaining == 0;});
+}
+
+/*_______________________
+HostWorkPool::ThreadMain
+*/
+
+void HostWorkPool::ThreadMain(short iThread) {
+  unsigned long lastBatch = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(batchLock);
+      batchStart.wait(lock, [this, lastBatch] {return stopping || (batchNumber != lastBatch);});
+      if (stopping) {return;}
+      lastBatch = batchNumber;
+    }
+    WorkBatch(iThread);
+  }
+}
+
+/*______________________
+HostWorkPool::WorkBatch
+Run tasks until there are none left to take
+*/
+
+void HostWorkPool::WorkBatch(short iThread) {
+  long iTask;
+
+  while (NextTask(iThread, &iTask)) {
+    batchRoutine(batchContext, iTask);
+    if (--batchRemaining == 0) {
+      std::lock_guard<std::mutex> lock(batchLock);
+      batchDone.notify_all();
+    }
+  }
+}
+
+/*_____________________
+HostWorkPool::NextTask
+Take the next task from our own queue's front, or steal one from the back of another's
+*/
+
+bool HostWorkPool::NextTask(short iThread, long *iTask) {
+  short k, iVictim;
+
+  {
+    std::lock_guard<std::mutex> lock(queues[iThread].queueLock);
+    if (!queues[iThread].queueTasks.empty()) {
+      *iTask = queues[iThread].queueTasks.front();
+      queues[iThread].queueTasks.pop_front();
+      return true;
+    }
+  }
+
+  for (k = 1; k < nPoolThreads; k++) {
+    iVictim = (iThread + k) % nPoolThreads;
+    std::lock_guard<std::mutex> lock(queues[iVictim].queueLock);
+    if (!queues[iVictim].queueTasks.empty()) {
+      *iTask = queues[iVictim].queueTasks.back();
+      queues[iVictim].queueTasks.pop_back();
+      nSteals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*__________________________
+HostRenderEngine::AddStrip
+*/
+
+void HostRenderEngine::AddStrip(LEDSegs *strip) {
+  strips.push_back(strip);
+  stripPainting.push_back(0);
+}
+
+/*____________________________
+HostRenderEngine::RenderFrame
+*/
+
+void HostRenderEngine::RenderFrame(bool doLeft, bool doRight) {
+  size_t iStrip;
+  short iSpan, nSpans, firstSpan;
+  long nLEDs;
+  paintTask task;
+
+  //The strips share the analyzer, so they read it one after another, as they would serially
+  for (iStrip = 0; iStrip < strips.size(); iStrip++) {strips[iStrip]->ReadSpectrum(doLeft, doRight);}
+
+  pool.Run(PrepareTask, this, strips.size());
+
+  //Cut each strip that changed into runs of spans of about chunkLEDs LEDs
+  paintTasks.clear();
+  for (iStrip = 0; iStrip < strips.size(); iStrip++) {
+    if (!stripPainting[iStrip]) {continue;}
+    task.taskStrip = strips[iStrip];
+    nSpans = task.taskStrip->GetNumSpans();
+    for (firstSpan = 0; firstSpan < nSpans; firstSpan = iSpan) {
+      nLEDs = 0;
+      for (iSpan = firstSpan; (iSpan < nSpans) && (nLEDs < chunkLEDs); iSpan++) {nLEDs += task.taskStrip->GetSpanLEDs(iSpan);}
+      task.taskFirstSpan = firstSpan;
+      task.taskNumSpans = iSpan - firstSpan;
+      paintTasks.push_back(task);
+    }
+  }
+  pool.Run(PaintTask, this, paintTasks.size());
+
+  pool.Run(FinishTask, this, strips.size());
+}
+
+void HostRenderEngine::PrepareTask(void *context, long iStrip) {
+  HostRenderEngine *engine = (HostRenderEngine *) context;
+
+  engine->strips[iStrip]->MapBandsToSegments();
+  engine->stripPainting[iStrip] = engine->strips[iStrip]->PrepareFrame();
+}
+
+void HostRenderEngine::PaintTask(void *context, long iTask) {
+  paintTask *task = &((HostRenderEngine *) context)->paintTasks[iTask];
+
+  task->taskStrip->PaintSpans(task->taskFirstSpan, task->taskNumSpans);
+}
+
+void HostRenderEngine::FinishTask(void *context, long iStrip) {
+  HostRenderEngine *engine = (HostRenderEngine *) context;
+
+  if (engine->stripPainting[iStrip]) {engine->strips[iStrip]->FinishFrame();}
+}
@@ -0,0 +1,110 @@
+#ifndef _HOSTENGINE_H
+#define _HOSTENGINE_H
+
+//Multithreaded rendering for host-driven installations: many LEDSegs strips, and strips far longer
+//than a board could drive, rendered from a Linux box on a work-stealing thread pool.
+//
+//A frame is rendered the way DisplaySpectrum() does it, split into steps that can run in parallel:
+//  1. ReadSpectrum() for every strip, in the order they were added (strips sharing an LEDSpectrum
+//     read it once between them)
+//  2. MapBandsToSegments() and PrepareFrame(), one task per strip
+//  3. PaintSpans(), in tasks of about SetChunkLEDs() LEDs, so one long strip is split up too
+//  4. FinishFrame() (show()), one task per strip
+//The frames come out bit-identical to calling DisplaySpectrum() on each strip in turn. Segment
+//display routines run in step 2 on any thread, so they must only touch their own strip.
+
+#include <LEDSegs.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*__________
+HostWorkPool
+A fixed set of threads that run batches of indexed tasks. Each batch is dealt out to the threads'
+queues in contiguous blocks; a thread works through its own queue from the front and, once that is
+empty, steals from the back of the others'. The calling thread works on the batch too.
+*/
+
+class HostWorkPool {
+
+  public:
+    typedef void (*TaskRoutine) (void *context, long iTask);
+
+    HostWorkPool(short nThreads);  //Total threads, including the caller. 0 = one per core.
+    ~HostWorkPool();
+
+    //Run routine(context, i) for i = 0..nTasks-1, and wait for them all
+    void Run(TaskRoutine routine, void *context, long nTasks);
+
+    short GetNumThreads() {return nPoolThreads;}
+    unsigned long GetSteals() {return nSteals;}
+
+  private:
+    struct workQueue {
+      std::mutex queueLock;
+      std::deque<long> queueTasks;
+    };
+
+    short nPoolThreads;
+    workQueue *queues;
+    std::vector<std::thread> threads;
+
+    std::mutex batchLock;
+    std::condition_variable batchStart, batchDone;
+    unsigned long batchNumber;      //Bumped for each batch, so sleeping threads know to wake
+    bool stopping;
+    TaskRoutine batchRoutine;
+    void *batchContext;
+    std::atomic<long> batchRemaining;
+    std::atomic<unsigned long> nSteals;
+
+    void ThreadMain(short iThread);
+    void WorkBatch(short iThread);
+    bool NextTask(short iThread, long *iTask);
+};
+
+/*______________
+HostRenderEngine
+*/
+
+class HostRenderEngine {
+
+  public:
+    HostRenderEngine(short nThreads) : pool(nThreads), chunkLEDs(cDefaultChunkLEDs) {}
+
+    void AddStrip(LEDSegs *strip);
+    short GetNumStrips() {return strips.size();}
+    short GetNumThreads() {return pool.GetNumThreads();}
+    HostWorkPool &GetPool() {return pool;}
+
+    //Target LEDs per paint task. Smaller chunks balance better but cost more scheduling.
+    void SetChunkLEDs(short nLEDs) {chunkLEDs = max(nLEDs, (short) 1);}
+
+    //One display cycle for every strip, as DisplaySpectrum(doLeft, doRight)
+    void RenderFrame(bool doLeft, bool doRight);
+
+  private:
+    const static short cDefaultChunkLEDs = 2048;
+
+    struct paintTask {
+      LEDSegs *taskStrip;
+      short taskFirstSpan;
+      short taskNumSpans;
+    };
+
+    HostWorkPool pool;
+    short chunkLEDs;
+    std::vector<LEDSegs *> strips;
+    std::vector<char> stripPainting;  //PrepareFrame() result for each strip (not vector<bool>: written concurrently)
+    std::vector<paintTask> paintTasks;
+
+    static void PrepareTask(void *context, long iStrip);
+    static void PaintTask(void *context, long iTask);
+    static void FinishTask(void *context, long iStrip);
+};
+
+#endif
@@ -0,0 +1,140 @@
+//Frames-per-second benchmark for the multithreaded host renderer (HostEngine.h).
+//
+//Renders three installations with 1, 2, 4... threads up to twice the machine's core count:
+//many strips of a few thousand LEDs each, and one very long strip split into paint chunks, once
+//with the synthetic layout and once all sparkle (BenchDefineSparkle), whose 60,000 composite layers
+//are past what a short can index.
+//Each run's pixel output is hashed and must match the serial run, which calls DisplaySpectrum()
+//on each strip in turn. The strips share one LEDSpectrum, as strips on one board would, and follow
+//its mix, left and right channels in turn.
+//
+//  lightorgan_mtbench [--quick] [--threads <max>]
+
+#include <LEDSegs.h>
+#include "HostSim.h"
+#include "HostEngine.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock BenchClock;
+
+const short cBenchFrames = 200;
+const unsigned long cBenchAudioSeed = 1;
+
+struct BenchInstallation {
+  const char *name;
+  short nStrips;
+  short nLEDsPerStrip;
+  void (*define)(LEDSegs *, short);  //Defines each strip's segments
+};
+
+static std::vector<LEDSegs *> BenchCreateStrips(const BenchInstallation &inst, LEDSpectrum **spectrum) {
+  static const short channelOptions[] = {0, cSegOptLeftChannel, cSegOptRightChannel};
+  std::vector<LEDSegs *> strips;
+  short iStrip, iSegment;
+  LEDSegs *strip;
+
+  HostSimReset(cBenchAudioSeed);
+  *spectrum = new LEDSpectrum();
+  for (iStrip = 0; iStrip < inst.nStrips; iStrip++) {
+    strip = new LEDSegs(inst.nLEDsPerStrip, 6, NEO_GRB + NEO_KHZ800);
+    strip->SetSpectrum(*spectrum);
+    inst.define(strip, inst.nLEDsPerStrip);
+    for (iSegment = 0; iSegment <= strip->GetSegmentIndex(); iSegment++) {
+      strip->SetSegment_Options(iSegment, strip->GetSegment_Options(iSegment) | channelOptions[iStrip % 3]);
+    }
+    strips.push_back(strip);
+  }
+  return strips;
+}
+
+static void BenchHashStrips(const std::vector<LEDSegs *> &strips, uint32_t *hash) {
+  size_t iStrip;
+  long iByte, nBytes;
+
+  for (iStrip = 0; iStrip < strips.size(); iStrip++) {
+    const uint8_t *buf = strips[iStrip]->GetPixelStrip()->getPixels();
+    nBytes = ((long) strips[iStrip]->GetNumLEDs()) * 3;
+    for (iByte = 0; iByte < nBytes; iByte++) {*hash = (*hash ^ buf[iByte]) * 16777619UL;}
+  }
+}
+
+/*_________
+BenchRender
+Render nFrames of an installation, serially (nThreads 0) or on the engine. Returns the frames per
+second; the hash of every frame's pixels goes to *checksum.
+*/
+
+static double BenchRender(const BenchInstallation &inst, short nThreads, short nFrames, uint32_t *checksum, unsigned long *steals) {
+  LEDSpectrum *spectrum;
+  std::vector<LEDSegs *> strips = BenchCreateStrips(inst, &spectrum);
+  HostRenderEngine *engine = NULL;
+  BenchClock::time_point t0;
+  double seconds = 0;
+  short iFrame;
+  size_t iStrip;
+
+  *checksum = 2166136261UL;
+  if (nThreads > 0) {
+    engine = new HostRenderEngine(nThreads);
+    for (iStrip = 0; iStrip < strips.size(); iStrip++) {engine->AddStrip(strips[iStrip]);}
+  }
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    t0 = BenchClock::now();
+    if (engine != NULL) {engine->RenderFrame(true, true);}
+    else {for (iStrip = 0; iStrip < strips.size(); iStrip++) {strips[iStrip]->DisplaySpectrum(true, true);}}
+    seconds += std::chrono::duration<double>(BenchClock::now() - t0).count();
+    BenchHashStrips(strips, checksum);
+  }
+
+  *steals = (engine != NULL) ? engine->GetPool().GetSteals() : 0;
+  delete engine;
+  for (iStrip = 0; iStrip < strips.size(); iStrip++) {delete strips[iStrip];}
+  delete spectrum;
+  return nFrames / seconds;
+}
+
+int main(int argc, char **argv) {
+  static const BenchInstallation installations[] = {
+    {"32 strips", 32, 3000, BenchDefineSynthetic},
+    {"1 long strip", 1, 20000, BenchDefineSynthetic},  //About the most one Adafruit_NeoPixel can hold (uint16_t byte count)
+    {"1 long sparkle", 1, 20000, BenchDefineSparkle},
+  };
+  short i, nThreads, maxThreads, nFrames = cBenchFrames;
+  unsigned long steals;
+  uint32_t serialChecksum, checksum;
+  double serialFPS, fps;
+  bool ok = true;
+
+  maxThreads = 2 * max((unsigned) std::thread::hardware_concurrency(), 1U);
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {nFrames = cBenchFrames / 10;}
+    else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {maxThreads = max(atoi(argv[++i]), 1);}
+    else {fprintf(stderr, "usage: %s [--quick] [--threads <max>]\n", argv[0]); return 2;}
+  }
+
+  printf("LEDSegs host engine benchmark (%u hardware threads, %d frames)\n\n", std::thread::hardware_concurrency(), nFrames);
+  printf("%-14s %7s %7s %8s %10s %8s %8s   %s\n", "installation", "LEDs", "threads", "fps", "LEDs/s", "speedup", "steals", "checksum");
+
+  for (i = 0; i < (short) SIZEOF_ARRAY(installations); i++) {
+    const BenchInstallation &inst = installations[i];
+    long nLEDs = ((long) inst.nStrips) * inst.nLEDsPerStrip;
+
+    serialFPS = BenchRender(inst, 0, nFrames, &serialChecksum, &steals);
+    printf("%-14s %7ld %7s %8.1f %10.3g %8s %8s   %08lx\n", inst.name, nLEDs, "serial", serialFPS, serialFPS * nLEDs, "", "", (unsigned long) serialChecksum);
+
+    for (nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+      fps = BenchRender(inst, nThreads, nFrames, &checksum, &steals);
+      printf("%-14s %7ld %7d %8.1f %10.3g %7.2fx %8lu   %08lx%s\n", inst.name, nLEDs, nThreads, fps, fps * nLEDs, fps / serialFPS, steals,
+        (unsigned long) checksum, (checksum == serialChecksum) ? "" : "  MISMATCH");
+      if (checksum != serialChecksum) {ok = false;}
+    }
+  }
+
+  if (!ok) {fprintf(stderr, "multithreaded output differs from the serial output\n");}
+  return ok ? 0 : 1;
+}
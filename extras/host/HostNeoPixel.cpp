@@ -0,0 +1,60 @@
+//Host implementation of the Adafruit_NeoPixel stand-in (sim/Adafruit_NeoPixel.h)
+
+#include "Adafruit_NeoPixel.h"
+#include "HostSim.h"
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, neoPixelType t)
+  : numLEDs(0), numBytes(0), pin(p), brightness(0), pixels(NULL) {
+  updateLength(n);
+  rOffset = (t >> 4) & 0x03;
+  gOffset = (t >> 2) & 0x03;
+  bOffset = t & 0x03;
+}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel() {free(pixels);}
+
+void Adafruit_NeoPixel::updateLength(uint16_t n) {
+  free(pixels);
+  numBytes = n * 3;
+  if ((pixels = (uint8_t *) malloc(numBytes)) != NULL) {
+    memset(pixels, 0, numBytes);
+    numLEDs = n;
+  }
+  else {numLEDs = numBytes = 0;}
+}
+
+void Adafruit_NeoPixel::show(void) {HostSimShow(numLEDs);}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n < numLEDs) {
+    if (brightness) {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+    }
+    uint8_t *p = &pixels[n * 3];
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n, (uint8_t) (c >> 16), (uint8_t) (c >> 8), (uint8_t) c);
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  if (n >= numLEDs) {return 0;}
+  const uint8_t *p = &pixels[n * 3];
+  uint32_t r = p[rOffset], g = p[gOffset], b = p[bOffset];
+  if (brightness) {
+    r = (r << 8) / brightness;
+    g = (g << 8) / brightness;
+    b = (b << 8) / brightness;
+  }
+  return (r << 16) | (g << 8) | b;
+}
+
+void Adafruit_NeoPixel::setBrightness(uint8_t b) {brightness = b + 1;}
+
+void Adafruit_NeoPixel::clear() {memset(pixels, 0, numBytes);}
@@ -0,0 +1,66 @@
+//Show file access for the host. See HostShowFile.h.
+
+#include "HostShowFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*______________________
+HostShowFile::OpenMapped
+*/
+
+bool HostShowFile::OpenMapped(const char *path, LEDShowPlayer *player) {
+  struct stat info;
+  int fd;
+
+  Close();
+  fd = open(path, O_RDONLY);
+  if ((fd < 0) || (fstat(fd, &info) != 0)) {
+    perror(path);
+    if (fd >= 0) {close(fd);}
+    return false;
+  }
+  mapBytes = info.st_size;
+  mapData = (mapBytes > 0) ? mmap(NULL, mapBytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapData == MAP_FAILED) {
+    fprintf(stderr, "%s: can't map the file\n", path);
+    mapData = NULL;
+    return false;
+  }
+
+  if (!player->Open((const byte *) mapData, mapBytes)) {
+    fprintf(stderr, "%s: not a show file for this strip\n", path);
+    return false;
+  }
+  return true;
+}
+
+/*________________________
+HostShowFile::OpenStreamed
+*/
+
+bool HostShowFile::OpenStreamed(const char *path, LEDShowPlayer *player) {
+  Close();
+  stream = fopen(path, "rb");
+  if (stream == NULL) {perror(path); return false;}
+
+  if (!player->Open(ReadStream, this)) {
+    fprintf(stderr, "%s: not a show file for this strip\n", path);
+    return false;
+  }
+  return true;
+}
+
+short HostShowFile::ReadStream(void *context, byte *buffer, short nBytes) {
+  return fread(buffer, 1, nBytes, ((HostShowFile *) context)->stream);
+}
+
+void HostShowFile::Close() {
+  if (mapData != NULL) {munmap(mapData, mapBytes);}
+  if (stream != NULL) {fclose(stream);}
+  mapData = NULL;
+  stream = NULL;
+}
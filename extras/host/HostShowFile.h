@@ -0,0 +1,30 @@
+#ifndef _HOSTSHOWFILE_H
+#define _HOSTSHOWFILE_H
+
+//Opens a show file for an LEDShowPlayer on the host: memory-mapped, or streamed through stdio a
+//small chunk at a time as a board would read it from an SD card.
+
+#include <LEDShowPlayer.h>
+
+#include <stdio.h>
+
+class HostShowFile {
+
+  public:
+    HostShowFile() : mapData(NULL), mapBytes(0), stream(NULL) {}
+    ~HostShowFile() {Close();}
+
+    //Both return false, with a message on stderr, if the file can't be opened or the player rejects it
+    bool OpenMapped(const char *path, LEDShowPlayer *player);
+    bool OpenStreamed(const char *path, LEDShowPlayer *player);
+    void Close();
+
+  private:
+    void *mapData;
+    size_t mapBytes;
+    FILE *stream;
+
+    static short ReadStream(void *context, byte *buffer, short nBytes);
+};
+
+#endif
@@ -0,0 +1,80 @@
+//Show file writer. See HostShowWriter.h.
+
+#include "HostShowWriter.h"
+
+#include <string.h>
+
+static void ShowPutLong(uint8_t *p, unsigned long value) {
+  p[0] = value; p[1] = value >> 8; p[2] = value >> 16; p[3] = value >> 24;
+}
+
+/*__________________
+HostShowWriter::Open
+*/
+
+bool HostShowWriter::Open(const char *path, short nLEDs, uint16_t ledType) {
+  uint8_t header[cShowHeaderBytes];
+
+  Close();
+  showFile = fopen(path, "wb");
+  if (showFile == NULL) {perror(path); return false;}
+
+  nShowLEDs = nLEDs;
+  bytesPerLED = ShowBytesPerLED(ledType);
+  nFrames = nFileBytes = 0;
+  lastPixels.assign(((size_t) nLEDs) * bytesPerLED, 0);
+
+  memset(header, 0, sizeof(header));
+  memcpy(header, "LSHW", 4);
+  header[4] = cShowVersion;
+  header[5] = bytesPerLED;
+  header[6] = nLEDs; header[7] = nLEDs >> 8;
+  header[8] = ledType; header[9] = ledType >> 8;
+  return Write(header, sizeof(header));  //The frame count goes in on Close()
+}
+
+/*________________________
+HostShowWriter::WriteFrame
+*/
+
+bool HostShowWriter::WriteFrame(unsigned long frameMicros, const uint8_t *pixels) {
+  uint8_t frameHeader[cShowFrameHeaderBytes];
+
+  if (showFile == NULL) {return false;}
+  EncodeFrame(pixels);
+  ShowPutLong(frameHeader, frameMicros);
+  ShowPutLong(frameHeader + 4, frameData.size());
+  nFrames++;
+  return Write(frameHeader, sizeof(frameHeader)) && Write(frameData.data(), frameData.size());
+}
+
+/*_________________________
+HostShowWriter::EncodeFrame
+The runs from lastPixels to pixels (see ShowEncodeRuns), leaving off unchanged LEDs at the end
+*/
+
+void HostShowWriter::EncodeFrame(const uint8_t *pixels) {
+  frameData.clear();
+  ShowEncodeRuns(pixels, lastPixels.data(), nShowLEDs, bytesPerLED, false, AddByte, this);
+}
+
+/*___________________
+HostShowWriter::Close
+*/
+
+bool HostShowWriter::Close() {
+  uint8_t count[4];
+  bool ok;
+
+  if (showFile == NULL) {return true;}
+  ShowPutLong(count, nFrames);
+  ok = (fseek(showFile, 12, SEEK_SET) == 0) && (fwrite(count, 1, 4, showFile) == 4);
+  ok &= (fclose(showFile) == 0);
+  showFile = NULL;
+  return ok;
+}
+
+bool HostShowWriter::Write(const void *data, size_t nBytes) {
+  nFileBytes += nBytes;
+  return fwrite(data, 1, nBytes, showFile) == nBytes;
+}
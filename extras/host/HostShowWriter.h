@@ -0,0 +1,41 @@
+#ifndef _HOSTSHOWWRITER_H
+#define _HOSTSHOWWRITER_H
+
+//Writes precomputed show files, in the format described in LEDShowPlayer.h.
+
+#include <LEDShowPlayer.h>
+
+#include <stdio.h>
+#include <vector>
+
+class HostShowWriter {
+
+  public:
+    HostShowWriter() : showFile(NULL), nFrames(0), nFileBytes(0) {}
+    ~HostShowWriter() {Close();}
+
+    bool Open(const char *path, short nLEDs, uint16_t ledType);
+
+    //Add a frame: the strip's pixel buffer, and when to show it (microseconds from the start)
+    bool WriteFrame(unsigned long frameMicros, const uint8_t *pixels);
+
+    //Fill in the frame count and close the file
+    bool Close();
+
+    unsigned long GetNumFrames() {return nFrames;}
+    unsigned long GetFileBytes() {return nFileBytes;}
+
+  private:
+    FILE *showFile;
+    short nShowLEDs;
+    short bytesPerLED;
+    unsigned long nFrames, nFileBytes;
+    std::vector<uint8_t> lastPixels;   //The frame before, as the player will have it
+    std::vector<uint8_t> frameData;
+
+    void EncodeFrame(const uint8_t *pixels);
+    static void AddByte(void *context, byte value) {((HostShowWriter *) context)->frameData.push_back(value);}
+    bool Write(const void *data, size_t nBytes);
+};
+
+#endif
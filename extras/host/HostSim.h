@@ -0,0 +1,50 @@
+#ifndef _HOSTSIM_H
+#define _HOSTSIM_H
+
+//Controls for the simulated board behind the host build (extras/host/sim). The stand-ins keep a
+//virtual microsecond clock that advances by what the real hardware would spend: an analogRead()
+//conversion, the WS2812 bitstream on show(), and delay(). micros()/millis() return that clock, so
+//runs are deterministic and independent of how fast the host is.
+
+#include <stdint.h>
+
+const unsigned long cHostAdcMicros = 100;         //One ADC conversion on an AVR at the default prescaler
+const unsigned long cHostShowMicrosPerLED = 30;   //24 bits at 800KHz
+const unsigned long cHostShowLatchMicros = 50;    //WS2812 reset/latch time after the data
+
+//Audio generator for the simulated MSGEQ7 shield. Returns the analog value (0..1023) for a channel
+//(0 = left, 1 = right) and band (0..6) at a given sample number. A "sample" is one full pass of
+//the shield's 7-band multiplexer.
+typedef short (*HostAudioGenerator) (short channel, short band, unsigned long sample);
+
+struct HostSimStats {
+  unsigned long analogReads;    //Number of analogRead() calls
+  unsigned long digitalWrites;  //Number of digitalWrite() calls
+  unsigned long shows;          //Number of Adafruit_NeoPixel::show() calls
+  unsigned long long ledsShown; //Total LEDs pushed out by show()
+  unsigned long long adcMicros; //Virtual time spent in analogRead()
+  unsigned long long showMicros;//Virtual time spent in show()
+};
+
+//Reset the virtual clock, counters, random() and the audio position. The seed selects a different
+//but repeatable audio program for the default generator.
+void HostSimReset(unsigned long seed);
+
+void HostSimSetAudio(HostAudioGenerator generator);   //NULL restores the default generator
+short HostSimDefaultAudio(short channel, short band, unsigned long sample);
+
+const HostSimStats &HostSimGetStats();
+unsigned long long HostSimMicros();                  //Virtual clock, full width
+void HostSimAdvanceMicros(unsigned long long us);
+
+//Interrupts. The simulated ADC's conversion-complete interrupt (hostAdcStart() in sim/Arduino.h)
+//runs when the virtual clock passes the conversion's end: in delay(), analogRead() or show().
+//Adafruit_NeoPixel's show() disables interrupts on AVR boards, so by default an interrupt due during
+//show() waits for it to finish. Turning that off models a strip driven by DMA.
+void HostSimSetShowBlocksInterrupts(bool blocks);
+
+//Account for one show() of nLEDs pixels (called by the Adafruit_NeoPixel stand-in). This is the
+//only call that may be made from several threads at once.
+void HostSimShow(unsigned short nLEDs);
+
+#endif
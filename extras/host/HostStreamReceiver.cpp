@@ -0,0 +1,171 @@
+//Frame stream receiver. See HostStreamReceiver.h.
+
+#include "HostStreamReceiver.h"
+
+#include <string.h>
+
+//Fletcher-16 as LEDFrameStream computes it: modulo 255 with end-around carry
+static uint16_t StreamChecksum(const uint8_t *data, size_t nBytes) {
+  uint8_t sum1 = 0, sum2 = 0;
+  size_t i;
+
+  for (i = 0; i < nBytes; i++) {
+    sum1 += data[i];
+    if (sum1 < data[i]) {sum1++;}
+    sum2 += sum1;
+    if (sum2 < sum1) {sum2++;}
+  }
+  return sum1 | (sum2 << 8);
+}
+
+/*________________________
+HostStreamReceiver::Reset
+*/
+
+void HostStreamReceiver::Reset() {
+  input.clear();
+  pixels.clear();
+  nLEDs = 0;
+  ledType = 0;
+  bytesPerLED = 3;
+  synced = false;
+  lastSequence = 0;
+  nFrames = nKeys = nBadPackets = nSkippedPackets = 0;
+}
+
+/*_______________________
+HostStreamReceiver::Push
+Find the packets in what has arrived. A packet that doesn't check out may have been found at a sync
+byte that wasn't one, so the search goes on from the byte after that, not after the packet.
+*/
+
+int HostStreamReceiver::Push(const uint8_t *data, size_t nBytes) {
+  size_t pos = 0;
+  long length;
+  int nDone = 0;
+
+  input.insert(input.end(), data, data + nBytes);
+  while (true) {
+    while ((pos < input.size()) && (input[pos] != cStreamSync)) {pos++;}
+    if (pos >= input.size()) {break;}
+
+    length = PacketLength(&input[pos], input.size() - pos);
+    if (length == 0) {break;}   //The rest of it is still to come
+    if ((length < 0) || (StreamChecksum(&input[pos + 1], length - 1 - cStreamChecksumBytes) !=
+      (input[pos + length - 2] | (input[pos + length - 1] << 8)))) {
+      nBadPackets++;
+      pos++;
+      continue;
+    }
+
+    Apply(&input[pos]);
+    if (synced) {nDone++;}
+    pos += length;
+  }
+  input.erase(input.begin(), input.begin() + pos);
+  return nDone;
+}
+
+/*_______________________________
+HostStreamReceiver::PacketLength
+The length of the packet starting at packet, as far as its runs go: 0 if more bytes are needed to
+tell, -1 if it can't be a packet.
+*/
+
+long HostStreamReceiver::PacketLength(const uint8_t *packet, size_t nBytes) {
+  size_t pos;
+  long iLED, nPacketLEDs, nRun;
+  short packetBytesPerLED;
+  uint8_t op;
+
+  if (nBytes < (size_t) cStreamHeaderBytes) {return 0;}
+  packetBytesPerLED = packet[1] & cStreamBytesPerLEDMask;
+  if (((packet[1] & ~(cStreamKey | cStreamBytesPerLEDMask)) != 0) || ((packetBytesPerLED != 3) && (packetBytesPerLED != 4))) {return -1;}
+  nPacketLEDs = packet[3] | (packet[4] << 8);
+  if ((nPacketLEDs == 0) || (nPacketLEDs > 0x7FFF)) {return -1;}
+  //Only a key can change the strip, so a garbled length doesn't hold up the search for long
+  if (!(packet[1] & cStreamKey) && (nLEDs > 0) && ((nPacketLEDs != nLEDs) || (packetBytesPerLED != bytesPerLED))) {return -1;}
+  pos = (packet[1] & cStreamKey) ? cStreamKeyHeaderBytes : cStreamHeaderBytes;
+
+  for (iLED = 0; iLED < nPacketLEDs; iLED += nRun) {
+    if (pos >= nBytes) {return 0;}
+    op = packet[pos++];
+    nRun = (op & (cShowMaxRun - 1)) + 1;
+    switch (op & 0xC0) {
+      case cShowOpFill:     pos += packetBytesPerLED; break;
+      case cShowOpLiteral:  pos += nRun * packetBytesPerLED; break;
+      case cShowOpLongSkip: nRun *= cShowMaxRun; break;
+    }
+  }
+  if (iLED != nPacketLEDs) {return -1;}   //The runs don't end at the last LED
+  pos += cStreamChecksumBytes;
+  return (pos <= nBytes) ? (long) pos : 0;
+}
+
+/*________________________
+HostStreamReceiver::Apply
+Apply a packet that checked out: a key starts a new frame, anything else needs the frame before it.
+*/
+
+void HostStreamReceiver::Apply(const uint8_t *packet) {
+  bool key = (packet[1] & cStreamKey) != 0;
+  uint8_t sequence = packet[2];
+  short packetLEDs = packet[3] | (packet[4] << 8);
+  short packetBytesPerLED = packet[1] & cStreamBytesPerLEDMask;
+  const uint8_t *runs;
+  long iLED, nRun, k;
+  uint8_t op;
+
+  if (key) {
+    nLEDs = packetLEDs;
+    bytesPerLED = packetBytesPerLED;
+    ledType = packet[5] | (packet[6] << 8);
+    pixels.assign(((size_t) nLEDs) * bytesPerLED, 0);
+    synced = true;
+    nKeys++;
+    runs = packet + cStreamKeyHeaderBytes;
+  }
+  else {
+    if (sequence != (uint8_t) (lastSequence + 1)) {synced = false;}   //Lost one
+    if ((packetLEDs != nLEDs) || (packetBytesPerLED != bytesPerLED)) {synced = false;}
+    runs = packet + cStreamHeaderBytes;
+  }
+  lastSequence = sequence;
+  if (!synced) {
+    nSkippedPackets++;
+    return;
+  }
+
+  for (iLED = 0; iLED < nLEDs; iLED += nRun) {
+    op = *runs++;
+    nRun = (op & (cShowMaxRun - 1)) + 1;
+    switch (op & 0xC0) {
+      case cShowOpFill:
+        for (k = 0; k < nRun; k++) {memcpy(&pixels[(iLED + k) * bytesPerLED], runs, bytesPerLED);}
+        runs += bytesPerLED;
+        break;
+      case cShowOpLiteral:
+        memcpy(&pixels[iLED * bytesPerLED], runs, nRun * bytesPerLED);
+        runs += nRun * bytesPerLED;
+        break;
+      case cShowOpLongSkip:
+        nRun *= cShowMaxRun;
+        break;
+    }
+  }
+  nFrames++;
+}
+
+/*________________________________
+HostStreamReceiver::GetPixelColor
+The NeoPixel type's color order gives where each channel is: white in bits 6-7, red 4-5, green 2-3
+and blue 0-1
+*/
+
+uint32_t HostStreamReceiver::GetPixelColor(short iLED) {
+  const uint8_t *p = &pixels[((size_t) iLED) * bytesPerLED];
+  uint32_t color = ((uint32_t) p[(ledType >> 4) & 3] << 16) | ((uint32_t) p[(ledType >> 2) & 3] << 8) | p[ledType & 3];
+
+  if (bytesPerLED == 4) {color |= (uint32_t) p[(ledType >> 6) & 3] << 24;}
+  return color;
+}
@@ -0,0 +1,56 @@
+#ifndef _HOSTSTREAMRECEIVER_H
+#define _HOSTSTREAMRECEIVER_H
+
+//Decodes a frame stream (see LEDFrameStream.h) as it arrives, a few bytes at a time or many.
+
+#include <LEDFrameStream.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class HostStreamReceiver {
+
+  public:
+    HostStreamReceiver() : nLEDs(0), ledType(0), bytesPerLED(3), synced(false), lastSequence(0),
+      nFrames(0), nKeys(0), nBadPackets(0), nSkippedPackets(0) {}
+
+    //Add bytes from the link. Returns the number of frames they completed; the pixels are then the
+    //last of them.
+    int Push(const uint8_t *data, size_t nBytes);
+
+    //Forget everything, as if just started
+    void Reset();
+
+    //The current frame: in the strip's color order, GetBytesPerLED() bytes an LED
+    const uint8_t *GetPixels() {return pixels.data();}
+    short GetNumLEDs() {return nLEDs;}
+    uint16_t GetLEDType() {return ledType;}
+    short GetBytesPerLED() {return bytesPerLED;}
+    uint32_t GetPixelColor(short iLED);   //As 0xRRGGBB (or 0xWWRRGGBB)
+
+    //Whether the frame is the stream's: false until the first key, and after a lost packet until
+    //the next key
+    bool IsSynced() {return synced;}
+    uint8_t GetSequence() {return lastSequence;}   //Of the last good packet, applied or not
+
+    unsigned long GetNumFrames() {return nFrames;}             //Packets applied
+    unsigned long GetNumKeys() {return nKeys;}
+    unsigned long GetBadPackets() {return nBadPackets;}        //Failed checksums or bad runs
+    unsigned long GetSkippedPackets() {return nSkippedPackets;}//Good, but waiting for a key
+
+  private:
+    std::vector<uint8_t> input;     //Bytes not yet made into a packet
+    std::vector<uint8_t> pixels;
+    short nLEDs;
+    uint16_t ledType;
+    short bytesPerLED;
+    bool synced;
+    uint8_t lastSequence;
+    unsigned long nFrames, nKeys, nBadPackets, nSkippedPackets;
+
+    long PacketLength(const uint8_t *packet, size_t nBytes);
+    void Apply(const uint8_t *packet);
+};
+
+#endif
@@ -0,0 +1,63 @@
+//WAV file reading for the host tools. See HostWav.h.
+
+#include "HostWav.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t WavLE32(const uint8_t *p) {return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);}
+static uint16_t WavLE16(const uint8_t *p) {return p[0] | (p[1] << 8);}
+
+/*_________
+HostWavRead
+Walk the RIFF chunks for "fmt " and "data"; anything else is skipped.
+*/
+
+bool HostWavRead(const char *path, std::vector<int16_t> *samples, long *sampleRate, short *nChannels) {
+  FILE *file;
+  uint8_t header[12], chunk[8], format[16];
+  uint32_t chunkSize;
+  size_t i, nSamples;
+  bool haveFormat = false, ok = false;
+  std::vector<uint8_t> data;
+
+  file = fopen(path, "rb");
+  if (file == NULL) {perror(path); return false;}
+
+  if ((fread(header, 1, sizeof(header), file) != sizeof(header)) || (memcmp(header, "RIFF", 4) != 0) || (memcmp(header + 8, "WAVE", 4) != 0)) {
+    fprintf(stderr, "%s: not a WAV file\n", path);
+    fclose(file);
+    return false;
+  }
+
+  while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk)) {
+    chunkSize = WavLE32(chunk + 4);
+    if ((memcmp(chunk, "fmt ", 4) == 0) && (chunkSize >= sizeof(format))) {
+      if (fread(format, 1, sizeof(format), file) != sizeof(format)) {break;}
+      if ((WavLE16(format) != 1) || (WavLE16(format + 14) != 16) || (WavLE16(format + 2) < 1) || (WavLE16(format + 2) > 2)) {
+        fprintf(stderr, "%s: only 16-bit PCM, mono or stereo, is supported\n", path);
+        fclose(file);
+        return false;
+      }
+      *nChannels = WavLE16(format + 2);
+      *sampleRate = WavLE32(format + 4);
+      haveFormat = true;
+      chunkSize -= sizeof(format);
+    }
+    else if ((memcmp(chunk, "data", 4) == 0) && haveFormat) {
+      data.resize(chunkSize);
+      data.resize(fread(data.data(), 1, chunkSize, file));
+      nSamples = data.size() / 2;
+      samples->resize(nSamples);
+      for (i = 0; i < nSamples; i++) {(*samples)[i] = (int16_t) WavLE16(&data[i * 2]);}
+      ok = true;
+      break;
+    }
+    if (fseek(file, chunkSize + (chunkSize & 1), SEEK_CUR) != 0) {break;}  //Chunks are padded to even sizes
+  }
+
+  if (!ok && haveFormat) {fprintf(stderr, "%s: no sample data\n", path);}
+  else if (!ok) {fprintf(stderr, "%s: no usable format chunk\n", path);}
+  fclose(file);
+  return ok;
+}
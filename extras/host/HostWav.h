@@ -0,0 +1,13 @@
+#ifndef _HOSTWAV_H
+#define _HOSTWAV_H
+
+//WAV file reading for the host tools: 16-bit PCM, any sample rate, mono or stereo.
+
+#include <stdint.h>
+#include <vector>
+
+//Read a WAV file's samples (interleaved if stereo). Returns false, with a message on stderr, if the
+//file can't be read or isn't 16-bit PCM with one or two channels.
+bool HostWavRead(const char *path, std::vector<int16_t> *samples, long *sampleRate, short *nChannels);
+
+#endif
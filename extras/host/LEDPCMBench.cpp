@@ -0,0 +1,187 @@
+//Benchmark and check of the PCM spectrum source (LEDPCMAnalyzer.h).
+//
+//  1. Band selectivity: a half scale stereo tone at each band's center, with the right channel
+//     playing the bands in reverse order. Each channel's loudest band must be the one playing.
+//  2. Throughput: 44.1KHz stereo audio through PushSamples() at several block sizes, as a real-time
+//     factor (seconds of audio analyzed per second of host time). It must keep up (factor > 1).
+//  3. End to end: a synthetic strip driven by the analyzer at 30 frames per second.
+//
+//The audio for 2 and 3 is a synthetic mix of tones and noise, or a WAV file given with --wav.
+//
+//  lightorgan_pcmbench [--quick] [--wav <file.wav>]
+
+#include <LEDSegs.h>
+#include <LEDPCMAnalyzer.h>
+#include "HostSim.h"
+#include "HostWav.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+const long cBenchSampleRate = 44100;
+const short cBenchFPS = 30;
+const short cBenchStripLEDs = 300;
+
+static const long cBenchCenters[cPCMMaxBands] = {63, 160, 400, 1000, 2500, 6250, 16000};
+
+/*_____________
+BenchToneCheck
+*/
+
+static bool BenchToneCheck() {
+  std::vector<int16_t> tone(cBenchSampleRate / 4 * 2);
+  short levels[cPCMMaxBands], iBand, iLoudest, channel, playing;
+  long i;
+  bool ok = true;
+
+  printf("band selectivity (level of each band, tone at the band in [ ])\n");
+  for (iBand = 0; iBand < cPCMMaxBands; iBand++) {
+    LEDPCMAnalyzer pcm(cBenchSampleRate, 2);
+
+    pcm.SetGain(256);  //Unity, so a half scale tone reads about 500
+    for (i = 0; i < (long) tone.size() / 2; i++) {
+      tone[i * 2] = (int16_t) (16000 * sin(2 * M_PI * cBenchCenters[iBand] * i / cBenchSampleRate));
+      tone[i * 2 + 1] = (int16_t) (16000 * sin(2 * M_PI * cBenchCenters[cPCMMaxBands - 1 - iBand] * i / cBenchSampleRate));
+    }
+    pcm.PushSamples(tone.data(), tone.size() / 2);
+
+    for (channel = 0; channel < 2; channel++) {
+      playing = (channel == 0) ? iBand : cPCMMaxBands - 1 - iBand;
+      pcm.ReadBands(levels, cPCMMaxBands, channel == 0, channel == 1);
+      printf("  %5ldHz %s ", cBenchCenters[playing], (channel == 0) ? "L" : "R");
+      for (i = 0, iLoudest = 0; i < cPCMMaxBands; i++) {
+        printf((i == playing) ? " [%4d]" : "  %4d ", levels[i]);
+        if (levels[i] > levels[iLoudest]) {iLoudest = i;}
+      }
+      printf("%s\n", (iLoudest == playing) ? "" : "  WRONG BAND");
+      if (iLoudest != playing) {ok = false;}
+    }
+  }
+  printf("\n");
+  return ok;
+}
+
+/*_____________
+BenchMakeAudio
+Synthetic stereo program: a bass line, a few chords, and noise bursts, changing every quarter second.
+*/
+
+static void BenchMakeAudio(std::vector<int16_t> *samples, long seconds) {
+  static const double notes[] = {55, 82.4, 110, 146.8, 220, 329.6, 440, 659.3, 880, 1318.5, 2637, 5274};
+  long i, nFrames = seconds * cBenchSampleRate, step;
+  double t, left, right;
+  unsigned long noise = 1;
+  short k;
+
+  samples->resize(nFrames * 2);
+  for (i = 0; i < nFrames; i++) {
+    t = (double) i / cBenchSampleRate;
+    step = i / (cBenchSampleRate / 4);
+    left = 0.3 * sin(2 * M_PI * notes[step % 4] * t);
+    right = 0.3 * sin(2 * M_PI * notes[(step + 2) % 4] * t);
+    for (k = 0; k < 3; k++) {
+      left += 0.1 * sin(2 * M_PI * notes[4 + (step + k * 3) % 8] * t);
+      right += 0.1 * sin(2 * M_PI * notes[4 + (step + k * 5) % 8] * t);
+    }
+    noise = noise * 1103515245UL + 12345;
+    if ((step & 3) == 3) {left += 0.05 * (((double) ((noise >> 8) & 0xFFFF)) / 32768.0 - 1.0);}
+    (*samples)[i * 2] = (int16_t) (left * 32767);
+    (*samples)[i * 2 + 1] = (int16_t) (right * 32767);
+  }
+}
+
+/*______________
+BenchThroughput
+*/
+
+static bool BenchThroughput(const std::vector<int16_t> &samples, long sampleRate, short nChannels) {
+  static const short blockSizes[] = {256, 512, 1024, 2048, 4096};
+  const long cPushFrames = 256;  //About what one DMA buffer would hand over
+  long nFrames = samples.size() / nChannels, iFrame;
+  double seconds, factor;
+  short i;
+  bool ok = true;
+
+  printf("throughput (%.1f s of %ldHz %s audio)\n", (double) nFrames / sampleRate, sampleRate, (nChannels == 2) ? "stereo" : "mono");
+  printf("  %6s %8s %10s %12s\n", "block", "blocks", "us/block", "x real time");
+  for (i = 0; i < (short) SIZEOF_ARRAY(blockSizes); i++) {
+    LEDPCMAnalyzer pcm(sampleRate, nChannels);
+
+    pcm.SetBlockSize(blockSizes[i]);
+    BenchClock::time_point t0 = BenchClock::now();
+    for (iFrame = 0; iFrame < nFrames; iFrame += cPushFrames) {
+      pcm.PushSamples(&samples[iFrame * nChannels], min(cPushFrames, nFrames - iFrame));
+    }
+    seconds = std::chrono::duration<double>(BenchClock::now() - t0).count();
+    factor = ((double) nFrames / sampleRate) / seconds;
+    printf("  %6d %8lu %10.1f %12.0f%s\n", blockSizes[i], pcm.GetBlocks(), seconds * 1e6 / max(pcm.GetBlocks(), 1UL), factor,
+      (factor > 1) ? "" : "  TOO SLOW");
+    if (factor <= 1) {ok = false;}
+  }
+  printf("\n");
+  return ok;
+}
+
+/*_____________
+BenchEndToEnd
+*/
+
+static void BenchEndToEnd(const std::vector<int16_t> &samples, long sampleRate, short nChannels) {
+  LEDPCMAnalyzer pcm(sampleRate, nChannels);
+  LEDSegs *strip;
+  long nFrames = samples.size() / nChannels, perFrame = sampleRate / cBenchFPS, iFrame, nDisplayed = 0, nLit = 0;
+  double seconds;
+  short iLED;
+
+  HostSimReset(1);
+  strip = new LEDSegs(cBenchStripLEDs, 6, NEO_GRB + NEO_KHZ800);
+  BenchDefineSynthetic(strip, cBenchStripLEDs);
+  strip->SetSpectrumSource(&pcm);
+
+  BenchClock::time_point t0 = BenchClock::now();
+  for (iFrame = 0; iFrame + perFrame <= nFrames; iFrame += perFrame) {
+    pcm.PushSamples(&samples[iFrame * nChannels], perFrame);
+    strip->DisplaySpectrum(true, true);
+    nDisplayed++;
+    for (iLED = 0; iLED < cBenchStripLEDs; iLED++) {if (strip->GetPixelStrip()->getPixelColor(iLED) != 0) {nLit++;}}
+  }
+  seconds = std::chrono::duration<double>(BenchClock::now() - t0).count();
+
+  printf("end to end (%d LED synthetic strip at %d fps)\n", cBenchStripLEDs, cBenchFPS);
+  printf("  %ld frames, %.1f us/frame on the host (analysis and display), %.0f%% of LEDs lit on average\n",
+    nDisplayed, seconds * 1e6 / max(nDisplayed, 1L), (100.0 * nLit) / max(nDisplayed * cBenchStripLEDs, 1L));
+  delete strip;
+}
+
+int main(int argc, char **argv) {
+  std::vector<int16_t> samples;
+  long sampleRate = cBenchSampleRate, seconds = 20;
+  short nChannels = 2, i;
+  const char *wavPath = NULL;
+  bool ok = true;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {seconds = 2;}
+    else if ((strcmp(argv[i], "--wav") == 0) && (i + 1 < argc)) {wavPath = argv[++i];}
+    else {fprintf(stderr, "usage: %s [--quick] [--wav <file.wav>]\n", argv[0]); return 2;}
+  }
+
+  if (wavPath != NULL) {
+    if (!HostWavRead(wavPath, &samples, &sampleRate, &nChannels)) {return 2;}
+  }
+  else {BenchMakeAudio(&samples, seconds);}
+
+  printf("LEDSegs PCM spectrum source benchmark\n\n");
+  ok &= BenchToneCheck();
+  ok &= BenchThroughput(samples, sampleRate, nChannels);
+  BenchEndToEnd(samples, sampleRate, nChannels);
+
+  if (!ok) {fprintf(stderr, "PCM analyzer check failed\n");}
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+//Compares LEDFrameScheduler with the old "display, then busy-wait for the refresh delay" loop on the
+//simulated board clock (the simulated analogRead() and show() cost what they would on a board).
+//
+//For each strip length, runs 10 simulated seconds at 30 frames per second with a segment program
+//change every second, and reports the frames shown and dropped, the frame rate, how late shown
+//frames started against the 30fps grid, and the share of the time left for other work (the
+//scheduler's idle routine; the old loop has none). The scheduler must account for every frame slot:
+//shown + dropped is the number of slots that came due.
+//
+//  lightorgan_schedbench
+
+#include <LEDSegs.h>
+#include <LEDFrameScheduler.h>
+#include "HostSim.h"
+#include "BenchSynthetic.h"
+
+#include <stdio.h>
+
+const short cSchedFPS = 30;
+const unsigned long cSchedSeconds = 10;
+const unsigned long cSchedLoopMicros = 20;    //What one pass through loop() costs besides Service()
+const unsigned long cSchedIdleMicros = 200;   //One call of the idle routine (e.g. pushing audio)
+
+static LEDSegs *schedStrip;
+static short schedLEDs;
+static unsigned long schedTaskRuns, schedIdleRuns;
+
+static void SchedNextProgram() {
+  schedStrip->ResetStrip();
+  BenchDefineSynthetic(schedStrip, schedLEDs);
+  schedTaskRuns++;
+}
+
+static void SchedIdle() {
+  HostSimAdvanceMicros(cSchedIdleMicros);
+  schedIdleRuns++;
+}
+
+/*_________
+SchedOldLoop
+The example's loop() before the scheduler
+*/
+
+static void SchedOldLoop(short nLEDs) {
+  unsigned long startMS, endMS, nFrames = 0, nextProgramMS = 0;
+
+  HostSimReset(1);
+  schedLEDs = nLEDs;
+  schedStrip = new LEDSegs(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+  endMS = millis() + cSchedSeconds * 1000;
+  while (millis() < endMS) {
+    startMS = millis();
+    if (nextProgramMS <= startMS) {
+      nextProgramMS = startMS + 1000;
+      SchedNextProgram();
+    }
+    schedStrip->DisplaySpectrum(true, true);
+    nFrames++;
+    if (millis() < startMS + 1000 / cSchedFPS) {HostSimAdvanceMicros((startMS + 1000 / cSchedFPS - millis()) * 1000ULL);}
+  }
+  printf("%6d %-10s %7lu %7s %7.1f %10s %7s\n", nLEDs, "busy-wait", nFrames, "", (double) nFrames / cSchedSeconds, "", "0%");
+  delete schedStrip;
+}
+
+/*____________
+SchedScheduler
+*/
+
+static bool SchedScheduler(short nLEDs) {
+  LEDFrameScheduler *scheduler;
+  unsigned long long endMicros, idleStart;
+  unsigned long nSlots, nAccounted;
+  bool ok;
+
+  HostSimReset(1);
+  schedLEDs = nLEDs;
+  schedStrip = new LEDSegs(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+  scheduler = new LEDFrameScheduler(schedStrip, cSchedFPS);
+  scheduler->AddTask(SchedNextProgram, 1000);
+  scheduler->SetIdleRoutine(SchedIdle);
+  schedIdleRuns = 0;
+
+  idleStart = HostSimMicros();
+  endMicros = HostSimMicros() + cSchedSeconds * 1000000ULL;
+  while (HostSimMicros() < endMicros) {
+    scheduler->Service();
+    HostSimAdvanceMicros(cSchedLoopMicros);
+  }
+
+  //Slots that came due: one at the start, then one each period. The ones that came due during the
+  //last frame aren't counted until the next Service().
+  nSlots = (endMicros - idleStart - 1) / scheduler->GetFramePeriod() + 1;
+  nAccounted = scheduler->GetFramesShown() + scheduler->GetFramesDropped();
+  ok = (nAccounted <= nSlots) && (nAccounted + 1 + scheduler->GetFrameEstimate() / scheduler->GetFramePeriod() >= nSlots);
+  printf("%6d %-10s %7lu %7lu %7.1f %10lu %6.0f%%   frame est %lu us%s\n", nLEDs, "scheduler", scheduler->GetFramesShown(), scheduler->GetFramesDropped(),
+    (double) scheduler->GetFramesShown() / cSchedSeconds, scheduler->GetMaxLateness(),
+    (100.0 * schedIdleRuns * cSchedIdleMicros) / (cSchedSeconds * 1000000.0), scheduler->GetFrameEstimate(), ok ? "" : "  SLOTS LOST");
+  delete scheduler;
+  delete schedStrip;
+  return ok;
+}
+
+int main() {
+  static const short stripLEDs[] = {30, 160, 600, 1000, 2000};
+  short i;
+  bool ok = true;
+
+  printf("LEDSegs frame scheduling at %d fps on the simulated board (%lu s)\n\n", cSchedFPS, cSchedSeconds);
+  printf("%6s %-10s %7s %7s %7s %10s %7s\n", "LEDs", "loop", "shown", "dropped", "fps", "max late", "idle");
+  for (i = 0; i < (short) SIZEOF_ARRAY(stripLEDs); i++) {
+    SchedOldLoop(stripLEDs[i]);
+    ok &= SchedScheduler(stripLEDs[i]);
+  }
+  return ok ? 0 : 1;
+}
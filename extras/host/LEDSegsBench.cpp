@@ -0,0 +1,331 @@
+//Frame-time benchmark for LEDSegs on the host build.
+//
+//Times the three DisplaySpectrum() stages (ReadSpectrum, MapBandsToSegments, ShowSegments)
+//separately for the segment programs in examples/ChristmasExample.ino and for synthetic strips
+//of 30..10,000 LEDs. Host times are wall-clock nanoseconds per frame on this machine; "board us"
+//is the simulated time a real board spends in analogRead() and show() per frame, over the checksum
+//run (below).
+//
+//"async us" is the simulated board time per frame with SetAsyncSpectrum(true), where the spectrum
+//is read by the ADC interrupt while the previous frame is shown. Show() holds interrupts off as it
+//does on AVR boards, unless --dma-show is given. Its output must match the synchronous run's.
+//
+//Each layout is also run on a strip wired as a serpentine panel with a gap after each row, remapped
+//by an LEDLayout, and its LEDs read back in logical order must match the plain run's.
+//
+//"skip%" is the share of frames where ShowSegments() found nothing changed and skipped show().
+//
+//"heap" and "peak" are the strip's heap after the timed run and the most it held at once, building
+//its composite map included (GetHeapBytes, GetPeakHeapBytes). The header gives the size of the
+//object itself. These are host bytes: pointers, longs and alignment are larger than on an AVR board.
+//
+//Before the layouts, the color of a cSegOptModulateSegment segment is checked at full and half level
+//on segments of up to 10,000 LEDs.
+//
+//"random cutoffs" is the host ns per LED to repaint a 10,000-LED cSegActionRandom segment, its level
+//moving every frame, through ShowSegments() (show() left out). Next to it, a plain loop writes the
+//same LEDs lit or off, its cutoffs from the 64-entry table the renderer used to look up (whose
+//pattern repeated every 64 LEDs), and then hashed for each LED as they were before the composite
+//map kept the hashes.
+//
+//The checksum column hashes the pixel buffer after every frame of a fixed run, so a change to
+//the renderer that alters any output shows up as a different checksum.
+//
+//  lightorgan_bench [--quick] [--dma-show] [--only <substring>]
+
+#include <LEDSegs.h>
+#include "HostSim.h"
+#include "BenchExample.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock BenchClock;
+
+const short cBenchChecksumFrames = 512;   //Two passes of the default audio program's 256-sample cycle
+const unsigned long cBenchAudioSeed = 1;
+const short cBenchPanelColumns = 16;      //The remapped run's panel
+const short cBenchPanelGap = 2;
+
+static bool benchQuick = false;
+static bool benchDmaShow = false;
+static const char *benchOnly = NULL;
+
+struct BenchLayout {
+  char name[32];
+  short nLEDs;
+  short iProgram;     //Example program index, or -1 for a synthetic layout
+};
+
+static LEDSegs *BenchCreate(const BenchLayout &layout, bool async, LEDLayout *wiring = NULL) {
+  LEDSegs *strip;
+  unsigned long randomSeed;
+
+  HostSimReset(cBenchAudioSeed);
+  strip = new LEDSegs(layout.nLEDs, 6, NEO_GRB + NEO_KHZ800);
+  if (wiring != NULL) {
+    //The random LEDs are seeded from the clock, which the longer strip's show() moves on further,
+    //so seed them as the plain strip's were
+    randomSeed = strip->GetRandomSeed();
+    delete strip;
+    HostSimReset(cBenchAudioSeed);
+    strip = new LEDSegs(wiring->GetPhysicalLEDs(), 6, NEO_GRB + NEO_KHZ800);
+    strip->SetPhysicalLayout(wiring);
+    strip->ResetRandom(randomSeed);
+  }
+  if (layout.iProgram >= 0) {BenchExampleDefine(layout.iProgram, strip);}
+  else {BenchDefineSynthetic(strip, layout.nLEDs);}
+  strip->SetAsyncSpectrum(async);
+  return strip;
+}
+
+/*___________
+BenchChecksum
+FNV-1a over the pixel buffer after every frame of a fixed, freshly-seeded run. Also returns the
+simulated board time per frame, if boardMicros isn't NULL. With wiring, the strip is remapped by it
+and the LEDs are hashed in logical order; a lit LED outside the map spoils the hash.
+*/
+
+static uint32_t BenchChecksum(const BenchLayout &layout, bool async, double *boardMicros, LEDLayout *wiring = NULL) {
+  LEDSegs *strip = BenchCreate(layout, async, wiring);
+  Adafruit_NeoPixel *pixels = strip->GetPixelStrip();
+  uint32_t hash = 2166136261UL;
+  short iFrame, iLED;
+  long iByte, iPixel, nBytes = ((long) pixels->numPixels()) * 3;
+  unsigned long long simStart = HostSimMicros();
+  uint8_t *unmapped = new uint8_t[nBytes], lit;
+
+  for (iFrame = 0; iFrame < cBenchChecksumFrames; iFrame++) {
+    strip->DisplaySpectrum(true, true);
+    const uint8_t *buf = pixels->getPixels();
+    if (wiring == NULL) {
+      for (iByte = 0; iByte < nBytes; iByte++) {hash = (hash ^ buf[iByte]) * 16777619UL;}
+      continue;
+    }
+
+    //Hash the logical LEDs, clearing them from a copy to leave the LEDs outside the map
+    memcpy(unmapped, buf, nBytes);
+    for (iLED = 0; iLED < layout.nLEDs; iLED++) {
+      iPixel = wiring->Physical(iLED) * 3L;
+      for (iByte = iPixel; iByte < iPixel + 3; iByte++) {
+        hash = (hash ^ buf[iByte]) * 16777619UL;
+        unmapped[iByte] = 0;
+      }
+    }
+    for (lit = 0, iByte = 0; iByte < nBytes; iByte++) {lit |= unmapped[iByte];}
+    if (lit != 0) {hash = 0;}
+  }
+  delete[] unmapped;
+  if (boardMicros != NULL) {*boardMicros = ((double) (HostSimMicros() - simStart)) / cBenchChecksumFrames;}
+  delete strip;
+  return hash;
+}
+
+static double BenchNanos(BenchClock::time_point t0, BenchClock::time_point t1) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+/*________
+BenchRun
+*/
+
+static bool BenchRun(const BenchLayout &layout) {
+  LEDSegs *strip;
+  long nFrames, iFrame;
+  double readNS = 0, mapNS = 0, showNS = 0, syncMicros, asyncMicros;
+  uint32_t checksum, asyncChecksum, panelChecksum;
+  BenchClock::time_point t0, t1, t2, t3;
+  LEDLayout panel;
+  short iRow;
+
+  checksum = BenchChecksum(layout, false, &syncMicros);
+  asyncChecksum = BenchChecksum(layout, true, &asyncMicros);
+
+  //Rows back and forth, a gap after each, and whatever is left over as a last, shorter row
+  for (iRow = 0; iRow < layout.nLEDs / cBenchPanelColumns; iRow++) {
+    panel.AddRun(cBenchPanelColumns, iRow & 1);
+    panel.AddGap(cBenchPanelGap);
+  }
+  panel.AddRun(layout.nLEDs % cBenchPanelColumns, iRow & 1);
+  panelChecksum = BenchChecksum(layout, false, NULL, &panel);
+
+  //Aim for a roughly constant amount of work per layout
+  nFrames = 4000000L / (layout.nLEDs + 200);
+  if (benchQuick) {nFrames /= 20;}
+  nFrames = constrain(nFrames, 50L, 20000L);
+
+  strip = BenchCreate(layout, false);
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    t0 = BenchClock::now();
+    strip->ReadSpectrum(true, true);
+    t1 = BenchClock::now();
+    strip->MapBandsToSegments();
+    t2 = BenchClock::now();
+    strip->ShowSegments();
+    t3 = BenchClock::now();
+    readNS += BenchNanos(t0, t1);
+    mapNS += BenchNanos(t1, t2);
+    showNS += BenchNanos(t2, t3);
+  }
+
+  printf("%-14s %6d %5ld %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %5.1f %7ld %7ld   %08lx\n",
+    layout.name, layout.nLEDs, nFrames,
+    readNS / nFrames, mapNS / nFrames, showNS / nFrames, (readNS + mapNS + showNS) / nFrames,
+    syncMicros, asyncMicros, (100.0 * strip->GetSkippedFrames()) / nFrames,
+    strip->GetHeapBytes(), strip->GetPeakHeapBytes(), (unsigned long) checksum);
+  delete strip;
+
+  if (panelChecksum != checksum) {
+    fprintf(stderr, "%s: remapped output differs (%08lx)\n", layout.name, (unsigned long) panelChecksum);
+    return false;
+  }
+  if (asyncChecksum != checksum) {
+    fprintf(stderr, "%s: asynchronous acquisition output differs (%08lx)\n", layout.name, (unsigned long) asyncChecksum);
+    return false;
+  }
+  return true;
+}
+
+/*___________________
+BenchCheckModulation
+A cSegOptModulateSegment segment's color at a few levels, on segments up to 10,000 LEDs long: full
+level must give exactly the foreground color, and half level must be within a step per channel of
+the lit fraction of the way from the background.
+*/
+
+static short benchModLevel;
+
+static void BenchModLevels(short *Levels, short nSegments) {
+  for (short i = 0; i < nSegments; i++) {Levels[i] = benchModLevel;}
+}
+
+static bool BenchCheckModulation() {
+  static const short modLEDs[] = {1, 30, 1000, 10000};
+  static const short modLevels[] = {cMaxSegmentLevel, 512};
+  const uint32_t foreColor = LEDSegs::Color(127, 90, 0), backColor = LEDSegs::Color(0, 10, 127);
+  LEDSegs *strip;
+  short iLEDs, iLevel, iChannel, nLEDs, segval;
+  byte fore[3], back[3], got[3];
+  long want;
+  bool ok = true;
+
+  LEDSegs::Colorvals(foreColor, fore);
+  LEDSegs::Colorvals(backColor, back);
+  for (iLEDs = 0; iLEDs < (short) SIZEOF_ARRAY(modLEDs); iLEDs++) {
+    nLEDs = modLEDs[iLEDs];
+    HostSimReset(cBenchAudioSeed);
+    strip = new LEDSegs(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+    strip->DefineSegment(0, nLEDs, cSegActionStatic, foreColor, cSegBand2);
+    strip->SetSegment_BackColor(backColor);
+    strip->SetSegment_Options(cSegOptModulateSegment);
+    strip->SetLevelRoutine(BenchModLevels);
+    for (iLevel = 0; iLevel < (short) SIZEOF_ARRAY(modLevels); iLevel++) {
+      benchModLevel = modLevels[iLevel];
+      strip->DisplaySpectrum(true, true);
+      LEDSegs::Colorvals(strip->GetPixelStrip()->getPixelColor(0), got);
+      segval = (benchModLevel >= cMaxSegmentLevel) ? nLEDs : ((((long) benchModLevel) * (nLEDs + 1)) >> 10);
+      for (iChannel = 0; iChannel < 3; iChannel++) {
+        want = back[iChannel] + ((((long) fore[iChannel]) - back[iChannel]) * segval) / nLEDs;
+        if ((benchModLevel >= cMaxSegmentLevel) ? (got[iChannel] != fore[iChannel]) : (abs(got[iChannel] - want) > 1)) {
+          fprintf(stderr, "%d LEDs, level %d: modulated channel %d is %d, not %ld\n", nLEDs, benchModLevel, iChannel, got[iChannel], want);
+          ok = false;
+        }
+      }
+    }
+    delete strip;
+  }
+  return ok;
+}
+
+/*________________
+BenchRandomCutoffs
+*/
+
+static short benchRandomLevel;
+
+static void BenchRandomLevels(short *Levels, short nSegments) {
+  for (short i = 0; i < nSegments; i++) {Levels[i] = benchRandomLevel;}
+}
+
+static void BenchRandomCutoffs() {
+  const short nLEDs = 10000;
+  const uint32_t foreColor = RGBWhite;
+  const unsigned short segKey = 0x1234;
+  short levels[64], i, level;
+  long nFrames, iFrame;
+  double stripNS = 0, tableNS = 0, hashNS = 0;
+  BenchClock::time_point t0, t1, t2;
+  Adafruit_NeoPixel *pixels;
+  LEDSegs *strip;
+
+  nFrames = benchQuick ? 20 : 400;
+  HostSimReset(cBenchAudioSeed);
+  strip = new LEDSegs(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+  strip->DefineSegment(0, nLEDs, cSegActionRandom, foreColor, cSegBand2);
+  strip->SetLevelRoutine(BenchRandomLevels);
+  strip->SetFrameSink(NULL, false);
+  pixels = strip->GetPixelStrip();
+  for (i = 0; i < 64; i++) {levels[i] = random(cMaxSegmentLevel);}
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    benchRandomLevel = (iFrame & 1) ? 700 : 300;
+    strip->MapBandsToSegments();
+    t0 = BenchClock::now();
+    strip->ShowSegments();
+    t1 = BenchClock::now();
+    if (iFrame >= 2) {stripNS += BenchNanos(t0, t1);}   //The first frames build the plans and the map
+
+    level = benchRandomLevel;
+    t0 = BenchClock::now();
+    for (i = 0; i < nLEDs; i++) {pixels->setPixelColor(i, (levels[i & 0x3F] <= level) ? foreColor : RGBOff);}
+    t1 = BenchClock::now();
+    for (i = 0; i < nLEDs; i++) {pixels->setPixelColor(i, ((LEDSegs::RandomHash(segKey + i) >> 6) <= level) ? foreColor : RGBOff);}
+    t2 = BenchClock::now();
+    tableNS += BenchNanos(t0, t1);
+    hashNS += BenchNanos(t1, t2);
+  }
+  printf("random cutoffs (ns/LED): %.2f through ShowSegments; %.2f from the 64-entry table, %.2f hashed per LED\n\n",
+    stripNS / ((nFrames - 2) * (double) nLEDs), tableNS / (nFrames * (double) nLEDs), hashNS / (nFrames * (double) nLEDs));
+  delete strip;
+}
+
+static bool BenchSelected(const char *name) {return (benchOnly == NULL) || (strstr(name, benchOnly) != NULL);}
+
+int main(int argc, char **argv) {
+  static const short syntheticLEDs[] = {30, 100, 300, 1000, 3000, 10000};
+  BenchLayout layout;
+  short i;
+  bool ok = true;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {benchQuick = true;}
+    else if (strcmp(argv[i], "--dma-show") == 0) {benchDmaShow = true;}
+    else if ((strcmp(argv[i], "--only") == 0) && (i + 1 < argc)) {benchOnly = argv[++i];}
+    else {fprintf(stderr, "usage: %s [--quick] [--dma-show] [--only <substring>]\n", argv[0]); return 2;}
+  }
+  HostSimSetShowBlocksInterrupts(!benchDmaShow);
+
+  printf("LEDSegs frame benchmark (host ns/frame per stage, simulated board us/frame)\n\n");
+  printf("sizeof(LEDSegs) %d (room for up to %d segments on the heap, grown as defined), sizeof(LEDSegsN<16>) %d\n\n",
+    (int) sizeof(LEDSegs), cMaxSegments, (int) sizeof(LEDSegsN<16>));
+  ok &= BenchCheckModulation();
+  if (BenchSelected("random")) {BenchRandomCutoffs();}
+  printf("%-14s %6s %5s %10s %10s %10s %10s %10s %10s %5s %7s %7s   %s\n",
+    "layout", "LEDs", "frms", "read", "map", "show", "total", "board us", "async us", "skip%", "heap", "peak", "checksum");
+
+  for (i = 0; i < BenchExampleNumPrograms(); i++) {
+    snprintf(layout.name, sizeof(layout.name), "christmas%d", i + 1);
+    layout.nLEDs = BenchExampleNumLEDs();
+    layout.iProgram = i;
+    if (BenchSelected(layout.name)) {ok &= BenchRun(layout);}
+  }
+  for (i = 0; i < (short) SIZEOF_ARRAY(syntheticLEDs); i++) {
+    snprintf(layout.name, sizeof(layout.name), "synthetic%d", syntheticLEDs[i]);
+    layout.nLEDs = syntheticLEDs[i];
+    layout.iProgram = -1;
+    if (BenchSelected(layout.name)) {ok &= BenchRun(layout);}
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+//Stage profile of LEDSegs on the host: runs the segment programs in examples/ChristmasExample.ino,
+//or a synthetic strip, with the library built with LEDSEGS_PROFILE, and dumps each strip's
+//LEDProfiler to stdout. Times are host nanoseconds (shown as microseconds); show() here only
+//accounts simulated board time, so its host time is just the call.
+//
+//  lightorgan_profile [--frames <n>] [--budget <us>] [--program <n> | --synthetic <LEDs>]
+
+#include <LEDSegs.h>
+#include "HostSim.h"
+#include "BenchExample.h"
+#include "BenchSynthetic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void ProfileRun(const char *name, short iProgram, short nLEDs, long nFrames, unsigned long budgetMicros) {
+  LEDSegs *strip;
+  long iFrame;
+
+  HostSimReset(1);
+  strip = new LEDSegs(nLEDs, 6, NEO_GRB + NEO_KHZ800);
+  if (iProgram >= 0) {BenchExampleDefine(iProgram, strip);}
+  else {BenchDefineSynthetic(strip, nLEDs);}
+  strip->GetProfiler().SetBudgetMicros(budgetMicros);
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {strip->DisplaySpectrum(true, true);}
+
+  printf("=== %s, %d LEDs, %ld frames\n", name, nLEDs, nFrames);
+  strip->GetProfiler().Dump(Serial);
+  printf("\n");
+  delete strip;
+}
+
+int main(int argc, char **argv) {
+  long nFrames = 500;
+  unsigned long budgetMicros = 0;
+  short iProgram = -1, nSynthetic = 0, i;
+  char name[32];
+
+  for (i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {nFrames = max(atol(argv[++i]), 1L);}
+    else if ((strcmp(argv[i], "--budget") == 0) && (i + 1 < argc)) {budgetMicros = strtoul(argv[++i], NULL, 10);}
+    else if ((strcmp(argv[i], "--program") == 0) && (i + 1 < argc)) {iProgram = atoi(argv[++i]) - 1; iProgram = constrain(iProgram, 0, BenchExampleNumPrograms() - 1);}
+    else if ((strcmp(argv[i], "--synthetic") == 0) && (i + 1 < argc)) {nSynthetic = atoi(argv[++i]); nSynthetic = constrain(nSynthetic, 1, 20000);}
+    else {
+      fprintf(stderr, "usage: %s [--frames <n>] [--budget <us>] [--program <n> | --synthetic <LEDs>]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (nSynthetic > 0) {
+    snprintf(name, sizeof(name), "synthetic%d", nSynthetic);
+    ProfileRun(name, -1, nSynthetic, nFrames, budgetMicros);
+  }
+  else {
+    for (i = 0; i < BenchExampleNumPrograms(); i++) {
+      if ((iProgram >= 0) && (i != iProgram)) {continue;}
+      snprintf(name, sizeof(name), "christmas%d", i + 1);
+      ProfileRun(name, i, BenchExampleNumLEDs(), nFrames, budgetMicros);
+    }
+  }
+  return 0;
+}
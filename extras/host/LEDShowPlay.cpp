@@ -0,0 +1,77 @@
+//Plays a precomputed show file (see LEDShowPlayer.h) on the simulated board, from a memory-mapped
+//file or streamed in small chunks (--stream), and reports what playback costs: host decode time per
+//frame, and the simulated board time in show(). With --realtime each frame waits for its time
+//stamp on the virtual clock, as it would on the board.
+//
+//The checksum hashes the pixels after every frame; it changes with any difference in the output.
+//
+//  lightorgan_play [--stream] [--realtime] <show.lshw>
+
+#include <LEDShowPlayer.h>
+#include "HostSim.h"
+#include "HostShowFile.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+typedef std::chrono::steady_clock PlayClock;
+
+int main(int argc, char **argv) {
+  const char *showPath = NULL;
+  bool streamed = false, realtime = false;
+  uint8_t header[cShowHeaderBytes];
+  uint32_t hash = 2166136261UL;
+  unsigned long nShown;
+  long iByte, nBytes;
+  short nLEDs, i;
+  uint16_t ledType;
+  double decodeSeconds = 0;
+  FILE *file;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stream") == 0) {streamed = true;}
+    else if (strcmp(argv[i], "--realtime") == 0) {realtime = true;}
+    else if ((argv[i][0] != '-') && (showPath == NULL)) {showPath = argv[i];}
+    else {showPath = NULL; break;}
+  }
+  if (showPath == NULL) {fprintf(stderr, "usage: %s [--stream] [--realtime] <show.lshw>\n", argv[0]); return 2;}
+
+  //The strip has to be made to the show's size and type before the player can check the rest
+  file = fopen(showPath, "rb");
+  if (file == NULL) {perror(showPath); return 2;}
+  nBytes = fread(header, 1, sizeof(header), file);
+  fclose(file);
+  if (nBytes != (long) sizeof(header)) {fprintf(stderr, "%s: not a show file\n", showPath); return 2;}
+  nLEDs = header[6] | (header[7] << 8);
+  ledType = header[8] | (header[9] << 8);
+
+  HostSimReset(1);
+  Adafruit_NeoPixel pixels(nLEDs, 6, ledType);
+  LEDShowPlayer player(&pixels, ledType);
+  HostShowFile show;
+
+  if (!(streamed ? show.OpenStreamed(showPath, &player) : show.OpenMapped(showPath, &player))) {return 1;}
+
+  nBytes = ((long) nLEDs) * header[5];
+  for (;;) {
+    PlayClock::time_point t0 = PlayClock::now();
+    if (realtime ? !player.PlayFrame() : !player.NextFrame()) {break;}
+    decodeSeconds += std::chrono::duration<double>(PlayClock::now() - t0).count();
+    if (!realtime && player.GetFrameChanged()) {pixels.show();}
+    for (iByte = 0; iByte < nBytes; iByte++) {hash = (hash ^ pixels.getPixels()[iByte]) * 16777619UL;}
+  }
+  if (player.GetFrameIndex() != player.GetNumFrames()) {
+    fprintf(stderr, "%s: bad frame data at frame %lu\n", showPath, player.GetFrameIndex());
+    return 1;
+  }
+
+  nShown = HostSimGetStats().shows;
+  printf("%s: %lu frames of %d LEDs, %s\n", showPath, player.GetNumFrames(), nLEDs, streamed ? "streamed" : "mapped");
+  printf("%.2f us/frame host %s, %lu frames shown, %.0f us/frame board time in show()",
+    decodeSeconds * 1e6 / max(player.GetNumFrames(), 1UL), realtime ? "decode and wait" : "decode", nShown,
+    ((double) HostSimGetStats().showMicros) / max(player.GetNumFrames(), 1UL));
+  if (realtime) {printf(", %.1f s on the board clock", HostSimMicros() / 1e6);}
+  printf("\nchecksum %08lx\n", (unsigned long) hash);
+  return 0;
+}
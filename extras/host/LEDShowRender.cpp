@@ -0,0 +1,124 @@
+//Renders a precomputed show file (see LEDShowPlayer.h) from a WAV file, running the whole LEDSegs
+//pipeline (ReadSpectrum, MapBandsToSegments, ShowSegments) on the audio, with LEDPCMAnalyzer as the
+//spectrum source, as fast as the host can go.
+//
+//The strip is one of the segment programs in examples/ChristmasExample.ino (--program, 1..9), or a
+//synthetic layout of any length (--synthetic). The show is then played back from the file, mapped
+//and streamed, and each frame checked against what was rendered; streamed again onto a strip of
+//another color order, to check the player puts the pixels in its order.
+//
+//  lightorgan_render [--fps <n>] [--program <n> | --synthetic <LEDs>] <audio.wav> <show.lshw>
+
+#include <LEDSegs.h>
+#include <LEDPCMAnalyzer.h>
+#include <LEDShowPlayer.h>
+#include "HostSim.h"
+#include "HostWav.h"
+#include "HostShowWriter.h"
+#include "HostShowFile.h"
+#include "BenchExample.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef std::chrono::steady_clock RenderClock;
+
+const uint16_t cRenderLEDType = NEO_GRB + NEO_KHZ800;
+
+static uint32_t RenderHash(const uint8_t *pixels, long nBytes) {
+  uint32_t hash = 2166136261UL;
+  long i;
+
+  for (i = 0; i < nBytes; i++) {hash = (hash ^ pixels[i]) * 16777619UL;}
+  return hash;
+}
+
+/*__________
+RenderCheck
+Play the show back onto a strip of type ledType and compare every frame with the hashes taken while
+rendering (of the pixels in the render's color order)
+*/
+
+static bool RenderCheck(const char *showPath, short nLEDs, uint16_t ledType, bool streamed, const std::vector<uint32_t> &frameHashes) {
+  Adafruit_NeoPixel pixels(nLEDs, 6, ledType), rendered(nLEDs, 6, cRenderLEDType);
+  LEDShowPlayer player(&pixels, ledType);
+  HostShowFile file;
+  size_t iFrame;
+  short i;
+  bool ok;
+
+  ok = streamed ? file.OpenStreamed(showPath, &player) : file.OpenMapped(showPath, &player);
+  for (iFrame = 0; ok && (iFrame < frameHashes.size()); iFrame++) {
+    ok = player.NextFrame();
+    for (i = 0; ok && (i < nLEDs); i++) {rendered.setPixelColor(i, pixels.getPixelColor(i));}
+    ok = ok && (RenderHash(rendered.getPixels(), ((long) nLEDs) * 3) == frameHashes[iFrame]);
+  }
+  ok = ok && !player.NextFrame();
+  if (!ok) {fprintf(stderr, "%s: %s playback differs from the render at frame %lu\n", showPath, streamed ? "streamed" : "mapped", (unsigned long) iFrame);}
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  std::vector<int16_t> samples;
+  std::vector<uint32_t> frameHashes;
+  long sampleRate, nFrames, iFrame, fromFrame, toFrame, fps = 30;
+  short nChannels, nLEDs = 0, iProgram = 0, i;
+  const char *wavPath = NULL, *showPath = NULL;
+  bool synthetic = false;
+  double seconds;
+
+  for (i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "--fps") == 0) && (i + 1 < argc)) {fps = atol(argv[++i]); fps = constrain(fps, 1L, 1000L);}
+    else if ((strcmp(argv[i], "--program") == 0) && (i + 1 < argc)) {iProgram = atoi(argv[++i]) - 1; iProgram = constrain(iProgram, 0, BenchExampleNumPrograms() - 1);}
+    else if ((strcmp(argv[i], "--synthetic") == 0) && (i + 1 < argc)) {synthetic = true; nLEDs = atoi(argv[++i]); nLEDs = constrain(nLEDs, 1, 20000);}
+    else if ((argv[i][0] != '-') && (wavPath == NULL)) {wavPath = argv[i];}
+    else if ((argv[i][0] != '-') && (showPath == NULL)) {showPath = argv[i];}
+    else {showPath = NULL; break;}
+  }
+  if (showPath == NULL) {
+    fprintf(stderr, "usage: %s [--fps <n>] [--program <n> | --synthetic <LEDs>] <audio.wav> <show.lshw>\n", argv[0]);
+    return 2;
+  }
+  if (!HostWavRead(wavPath, &samples, &sampleRate, &nChannels)) {return 2;}
+
+  HostSimReset(1);
+  if (!synthetic) {nLEDs = BenchExampleNumLEDs();}
+  LEDSegs *strip = new LEDSegs(nLEDs, 6, cRenderLEDType);
+  LEDPCMAnalyzer pcm(sampleRate, nChannels);
+  HostShowWriter writer;
+
+  if (synthetic) {BenchDefineSynthetic(strip, nLEDs);}
+  else {BenchExampleDefine(iProgram, strip);}
+  strip->SetSpectrumSource(&pcm);
+  if (!writer.Open(showPath, nLEDs, cRenderLEDType)) {return 1;}
+
+  //Frame n shows the audio up to its own time
+  nFrames = ((long long) (samples.size() / nChannels)) * fps / sampleRate;
+  RenderClock::time_point t0 = RenderClock::now();
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    fromFrame = ((long long) iFrame) * sampleRate / fps;
+    toFrame = ((long long) (iFrame + 1)) * sampleRate / fps;
+    pcm.PushSamples(&samples[fromFrame * nChannels], toFrame - fromFrame);
+    strip->DisplaySpectrum(true, true);
+    if (!writer.WriteFrame(((long long) iFrame) * 1000000 / fps, strip->GetPixelStrip()->getPixels())) {
+      perror(showPath);
+      return 1;
+    }
+    frameHashes.push_back(RenderHash(strip->GetPixelStrip()->getPixels(), ((long) nLEDs) * 3));
+  }
+  if (!writer.Close()) {perror(showPath); return 1;}
+  seconds = std::chrono::duration<double>(RenderClock::now() - t0).count();
+  delete strip;
+
+  printf("%s: %ld frames of %d LEDs at %ld fps, %.1f s of audio rendered %.0fx faster than real time\n",
+    showPath, nFrames, nLEDs, fps, (double) nFrames / fps, ((double) nFrames / fps) / seconds);
+  printf("%lu bytes, %.1f per frame (%.1f%% of raw pixels)\n", writer.GetFileBytes(), (double) writer.GetFileBytes() / max(nFrames, 1L),
+    (100.0 * writer.GetFileBytes()) / max(nFrames * nLEDs * 3L, 1L));
+
+  return (RenderCheck(showPath, nLEDs, cRenderLEDType, false, frameHashes) && RenderCheck(showPath, nLEDs, cRenderLEDType, true, frameHashes) &&
+    RenderCheck(showPath, nLEDs, NEO_RGB + NEO_KHZ800, true, frameHashes)) ? 0 : 1;
+}
@@ -0,0 +1,415 @@
+//Streams a strip's frames (see LEDFrameStream.h) and receives them, for previewing a layout on the
+//host and for sizing a link.
+//
+//bench runs each layout through an LEDFrameStream into HostStreamReceiver over a simulated link of
+//--baud, at --fps on the virtual clock, and checks that every frame the receiver completes is the
+//strip's frame, pixel for pixel. It reports the bytes a frame takes against what the link carries
+//per frame, and the frames the stream had to leave out for want of link time. --corrupt <n> garbles
+//a byte in every nth packet, to check that the receiver drops it and picks up again at the next key.
+//
+//send renders a layout in real time (--fast: as fast as it can) and writes the stream to a file or
+//"-" for stdout, a TCP connection (--connect <host>:<port>), a local TCP port it waits on for a
+//receiver (--listen <port>), or a pseudo-terminal (--pty), whose name it prints, for software that
+//expects a serial port.
+//
+//recv decodes a stream from the same kinds of places, or a serial device, and prints what it gets
+//once a second; --show draws each frame as a row of colored cells (an ANSI terminal with 24-bit
+//color), one per LED, or an average of several for long strips.
+//
+//  lightorgan_stream bench [--baud <n>] [--fps <n>] [--frames <n>] [--corrupt <n>]
+//                          [--program <n> | --synthetic <LEDs>]
+//  lightorgan_stream send [--baud <n>] [--fps <n>] [--frames <n>] [--fast]
+//                         [--program <n> | --synthetic <LEDs>]
+//                         [--connect <host>:<port> | --listen <port> | --pty | <file>]
+//  lightorgan_stream recv [--show] [--connect <host>:<port> | --listen <port> | <file>]
+
+#include <LEDSegs.h>
+#include <LEDFrameStream.h>
+#include "HostSim.h"
+#include "HostStreamReceiver.h"
+#include "BenchExample.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock StreamClock;
+
+const uint16_t cStreamLEDType = NEO_GRB + NEO_KHZ800;
+const long cStreamDefaultBaud = 115200;
+const long cStreamDefaultFrames = 900;      //30 seconds at 30 fps
+const short cStreamShowColumns = 100;       //Widest --show row
+const short cBenchSynthetic[] = {60, 150, 300, 600};
+
+struct StreamLayout {
+  bool synthetic;
+  short n;          //Program (0-origin), or the synthetic strip's LEDs
+};
+
+//A Print that collects a frame's packet, to be sent on (or garbled) as a whole
+class StreamBufferPrint : public Print {
+  public:
+    size_t write(uint8_t value) {data.push_back(value); return 1;}
+    std::vector<uint8_t> data;
+};
+
+static LEDSegs *StreamCreate(const StreamLayout &layout) {
+  LEDSegs *strip = new LEDSegs(layout.synthetic ? layout.n : BenchExampleNumLEDs(), 6, cStreamLEDType);
+
+  if (layout.synthetic) {BenchDefineSynthetic(strip, layout.n);}
+  else {BenchExampleDefine(layout.n, strip);}
+  return strip;
+}
+
+static void StreamLayoutName(const StreamLayout &layout, char *name, size_t nName) {
+  if (layout.synthetic) {snprintf(name, nName, "synthetic %d", layout.n);}
+  else {snprintf(name, nName, "christmas%d", layout.n + 1);}
+}
+
+/*___________
+StreamBench
+One layout over the simulated link. Returns the number of frames the receiver got wrong.
+*/
+
+static long StreamBench(const StreamLayout &layout, long baud, long fps, long nFrames, long corruptEvery) {
+  StreamBufferPrint link;
+  LEDFrameStream stream(link);
+  HostStreamReceiver receiver;
+  LEDSegs *strip;
+  unsigned long long frameMicros;
+  unsigned long maxPacket = 0, nPackets = 0;
+  uint8_t sequence;
+  long iFrame, nWrong = 0;
+  size_t nPixelBytes;
+  char name[32];
+
+  HostSimReset(1);
+  strip = StreamCreate(layout);
+  strip->SetFrameSink(&stream);
+  stream.SetByteRate(baud / 10);   //8N1: ten bits a byte
+  nPixelBytes = ((size_t) strip->GetNumLEDs()) * 3;
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    frameMicros = ((unsigned long long) iFrame) * 1000000 / fps;
+    if (HostSimMicros() < frameMicros) {HostSimAdvanceMicros(frameMicros - HostSimMicros());}
+
+    link.data.clear();
+    strip->DisplaySpectrum(true, true);
+    if (link.data.empty()) {continue;}
+    nPackets++;
+    maxPacket = max(maxPacket, (unsigned long) link.data.size());
+    sequence = link.data[2];
+    if ((corruptEvery > 0) && (nPackets % corruptEvery == 0)) {link.data[random(link.data.size())] ^= 1 << random(8);}
+
+    //A frame the receiver has as this one has to be this one
+    if ((receiver.Push(link.data.data(), link.data.size()) > 0) && receiver.IsSynced() && (receiver.GetSequence() == sequence) &&
+      ((receiver.GetNumLEDs() != strip->GetNumLEDs()) || (memcmp(receiver.GetPixels(), strip->GetPixelStrip()->getPixels(), nPixelBytes) != 0))) {
+      nWrong++;
+    }
+  }
+  //Over a clean link every packet has to be used
+  if (corruptEvery == 0) {nWrong += labs((long) (stream.GetFramesSent() - receiver.GetNumFrames()));}
+
+  StreamLayoutName(layout, name, sizeof(name));
+  printf("%-14s %6d %9.1f %8lu %8lu %8lu %6lu %8lu %6lu %6ld\n", name, strip->GetNumLEDs(),
+    (double) stream.GetBytesSent() / max(stream.GetFramesSent(), 1UL), maxPacket, (unsigned long) (baud / 10 / fps),
+    stream.GetFramesSent(), stream.GetFramesDropped(), receiver.GetNumKeys(), receiver.GetBadPackets(), nWrong);
+  delete strip;
+  return nWrong;
+}
+
+static int StreamBenchAll(const StreamLayout &layout, bool layoutGiven, long baud, long fps, long nFrames, long corruptEvery) {
+  StreamLayout each;
+  long nWrong = 0;
+  short i;
+
+  printf("%ld baud at %ld fps, %ld frames%s\n", baud, fps, nFrames, (corruptEvery > 0) ? ", some packets garbled" : "");
+  printf("%-14s %6s %9s %8s %8s %8s %6s %8s %6s %6s\n", "layout", "LEDs", "bytes/fr", "max", "link/fr",
+    "sent", "left", "keys", "bad", "wrong");
+  if (layoutGiven) {nWrong += StreamBench(layout, baud, fps, nFrames, corruptEvery);}
+  else {
+    each.synthetic = false;
+    for (each.n = 0; each.n < BenchExampleNumPrograms(); each.n++) {nWrong += StreamBench(each, baud, fps, nFrames, corruptEvery);}
+    each.synthetic = true;
+    for (i = 0; i < (short) (sizeof(cBenchSynthetic) / sizeof(cBenchSynthetic[0])); i++) {
+      each.n = cBenchSynthetic[i];
+      nWrong += StreamBench(each, baud, fps, nFrames, corruptEvery);
+    }
+  }
+  if (nWrong > 0) {fprintf(stderr, "the receiver showed %ld frames that weren't the strip's\n", nWrong); return 1;}
+  return 0;
+}
+
+/*______________
+Link endpoints
+A file descriptor for the place a stream goes to or comes from, or -1 after reporting why not
+*/
+
+static int StreamConnect(const char *hostPort) {
+  char host[256];
+  const char *colon = strrchr(hostPort, ':');
+  struct addrinfo hints, *found, *each;
+  int fd = -1, error;
+
+  if ((colon == NULL) || ((size_t) (colon - hostPort) >= sizeof(host))) {fprintf(stderr, "%s: expected <host>:<port>\n", hostPort); return -1;}
+  memcpy(host, hostPort, colon - hostPort);
+  host[colon - hostPort] = 0;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  error = getaddrinfo(host, colon + 1, &hints, &found);
+  if (error != 0) {fprintf(stderr, "%s: %s\n", hostPort, gai_strerror(error)); return -1;}
+  for (each = found; each != NULL; each = each->ai_next) {
+    fd = socket(each->ai_family, each->ai_socktype, each->ai_protocol);
+    if (fd < 0) {continue;}
+    if (connect(fd, each->ai_addr, each->ai_addrlen) == 0) {break;}
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(found);
+  if (fd < 0) {fprintf(stderr, "%s: %s\n", hostPort, strerror(errno));}
+  return fd;
+}
+
+//Wait on the loopback interface for one connection
+static int StreamListen(int port) {
+  struct sockaddr_in addr;
+  int listener, fd, one = 1;
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0) {perror("socket"); return -1;}
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if ((bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(listener, 1) != 0)) {
+    perror("listen");
+    close(listener);
+    return -1;
+  }
+  fprintf(stderr, "waiting on 127.0.0.1:%d\n", port);
+  fd = accept(listener, NULL, NULL);
+  if (fd < 0) {perror("accept");}
+  close(listener);
+  return fd;
+}
+
+//Terminals (a serial port, or a pty) pass the bytes through as they are, not as lines of text
+static void StreamMakeRaw(int fd) {
+  struct termios settings;
+
+  if (tcgetattr(fd, &settings) != 0) {return;}
+  cfmakeraw(&settings);
+  tcsetattr(fd, TCSANOW, &settings);
+}
+
+static int StreamOpenPty() {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0)) {
+    perror("pty");
+    if (fd >= 0) {close(fd);}
+    return -1;
+  }
+  StreamMakeRaw(fd);
+  fprintf(stderr, "streaming to %s\n", ptsname(fd));
+  return fd;
+}
+
+static int StreamOpen(const char *connectTo, int listenPort, bool pty, const char *path, bool output) {
+  int fd;
+
+  if (connectTo != NULL) {return StreamConnect(connectTo);}
+  if (listenPort > 0) {return StreamListen(listenPort);}
+  if (pty) {return StreamOpenPty();}
+  if (strcmp(path, "-") == 0) {return output ? 1 : 0;}
+  fd = output ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {perror(path);}
+  else if (isatty(fd)) {StreamMakeRaw(fd);}
+  return fd;
+}
+
+static bool StreamWriteAll(int fd, const uint8_t *data, size_t nBytes) {
+  ssize_t nWritten;
+
+  while (nBytes > 0) {
+    nWritten = write(fd, data, nBytes);
+    if (nWritten < 0) {
+      if (errno == EINTR) {continue;}
+      if (errno == EAGAIN) {std::this_thread::sleep_for(std::chrono::milliseconds(1)); continue;}
+      return false;
+    }
+    data += nWritten;
+    nBytes -= nWritten;
+  }
+  return true;
+}
+
+/*__________
+StreamSend
+*/
+
+static int StreamSend(const StreamLayout &layout, long baud, long fps, long nFrames, bool fast, int fd) {
+  StreamBufferPrint link;
+  LEDFrameStream stream(link);
+  LEDSegs *strip;
+  StreamClock::time_point start = StreamClock::now();
+  unsigned long long frameMicros;
+  long iFrame;
+
+  HostSimReset(1);
+  strip = StreamCreate(layout);
+  strip->SetFrameSink(&stream);
+  stream.SetByteRate(baud / 10);
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    frameMicros = ((unsigned long long) iFrame) * 1000000 / fps;
+    if (HostSimMicros() < frameMicros) {HostSimAdvanceMicros(frameMicros - HostSimMicros());}
+    if (!fast) {std::this_thread::sleep_until(start + std::chrono::microseconds(frameMicros));}
+
+    link.data.clear();
+    strip->DisplaySpectrum(true, true);
+    if (!link.data.empty() && !StreamWriteAll(fd, link.data.data(), link.data.size())) {
+      perror("write");
+      delete strip;
+      return 1;
+    }
+  }
+
+  fprintf(stderr, "sent %lu of %ld frames, %lu bytes (%.1f a frame), %lu left out for link time\n", stream.GetFramesSent(),
+    nFrames, stream.GetBytesSent(), (double) stream.GetBytesSent() / max(stream.GetFramesSent(), 1UL), stream.GetFramesDropped());
+  delete strip;
+  return 0;
+}
+
+/*__________
+StreamRecv
+*/
+
+//One frame as a row of cells, each the average of the LEDs under it
+static void StreamShowFrame(HostStreamReceiver *receiver) {
+  short nLEDs = receiver->GetNumLEDs(), nColumns = min(nLEDs, cStreamShowColumns), iColumn, iLED, fromLED, toLED;
+  unsigned long r, g, b;
+  uint32_t color;
+
+  for (iColumn = 0; iColumn < nColumns; iColumn++) {
+    fromLED = ((long) iColumn) * nLEDs / nColumns;
+    toLED = ((long) (iColumn + 1)) * nLEDs / nColumns;
+    r = g = b = 0;
+    for (iLED = fromLED; iLED < toLED; iLED++) {
+      color = receiver->GetPixelColor(iLED);
+      r += (color >> 16) & 0xFF;
+      g += (color >> 8) & 0xFF;
+      b += color & 0xFF;
+    }
+    //Segment colors only go to 127, so double them to be seen
+    printf("\x1b[48;2;%lu;%lu;%lum ", min(2 * r / (toLED - fromLED), 255UL), min(2 * g / (toLED - fromLED), 255UL), min(2 * b / (toLED - fromLED), 255UL));
+  }
+  printf("\x1b[0m\n");
+}
+
+static int StreamRecv(bool show, int fd) {
+  HostStreamReceiver receiver;
+  uint8_t buffer[4096];
+  ssize_t nRead;
+  unsigned long long nBytes = 0;
+  unsigned long lastFrames = 0;
+  StreamClock::time_point lastReport = StreamClock::now();
+
+  for (;;) {
+    nRead = read(fd, buffer, sizeof(buffer));
+    if (nRead < 0) {
+      if (errno == EINTR) {continue;}
+      if (errno == EIO) {break;}   //The other end of a pty closed
+      perror("read");
+      return 1;
+    }
+    if (nRead == 0) {break;}
+    nBytes += nRead;
+    if ((receiver.Push(buffer, nRead) > 0) && show) {StreamShowFrame(&receiver);}
+
+    if (!show && (StreamClock::now() - lastReport >= std::chrono::seconds(1))) {
+      printf("%d LEDs, %lu frames/s, %s\n", receiver.GetNumLEDs(), receiver.GetNumFrames() - lastFrames,
+        receiver.IsSynced() ? "in step" : "waiting for a key");
+      fflush(stdout);
+      lastFrames = receiver.GetNumFrames();
+      lastReport = StreamClock::now();
+    }
+  }
+
+  printf("received %llu bytes: %lu frames, %lu of them keys, %lu bad packets, %lu skipped waiting for a key\n", nBytes,
+    receiver.GetNumFrames(), receiver.GetNumKeys(), receiver.GetBadPackets(), receiver.GetSkippedPackets());
+  return 0;
+}
+
+static int StreamUsage(const char *program) {
+  fprintf(stderr, "usage: %s bench [--baud <n>] [--fps <n>] [--frames <n>] [--corrupt <n>]\n"
+                  "                         [--program <n> | --synthetic <LEDs>]\n"
+                  "       %s send [--baud <n>] [--fps <n>] [--frames <n>] [--fast]\n"
+                  "                        [--program <n> | --synthetic <LEDs>]\n"
+                  "                        [--connect <host>:<port> | --listen <port> | --pty | <file>]\n"
+                  "       %s recv [--show] [--connect <host>:<port> | --listen <port> | <file>]\n", program, program, program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  StreamLayout layout = {false, 0};
+  bool layoutGiven = false, fast = false, show = false, pty = false, bench, send;
+  const char *path = NULL, *connectTo = NULL;
+  long baud = cStreamDefaultBaud, fps = 30, nFrames = cStreamDefaultFrames, corruptEvery = 0;
+  int listenPort = 0, fd, result;
+  short i;
+
+  if (argc < 2) {return StreamUsage(argv[0]);}
+  bench = (strcmp(argv[1], "bench") == 0);
+  send = (strcmp(argv[1], "send") == 0);
+  if (!bench && !send && (strcmp(argv[1], "recv") != 0)) {return StreamUsage(argv[0]);}
+
+  for (i = 2; i < argc; i++) {
+    if (!send && !bench && (strcmp(argv[i], "--show") == 0)) {show = true;}
+    else if ((bench || send) && (strcmp(argv[i], "--program") == 0) && (i + 1 < argc)) {
+      layout.synthetic = false;
+      layout.n = atoi(argv[++i]) - 1;
+      layout.n = constrain(layout.n, 0, BenchExampleNumPrograms() - 1);
+      layoutGiven = true;
+    }
+    else if ((bench || send) && (strcmp(argv[i], "--synthetic") == 0) && (i + 1 < argc)) {
+      layout.synthetic = true;
+      layout.n = atoi(argv[++i]);
+      layout.n = constrain(layout.n, 1, 20000);
+      layoutGiven = true;
+    }
+    else if ((bench || send) && (strcmp(argv[i], "--baud") == 0) && (i + 1 < argc)) {baud = atol(argv[++i]); baud = constrain(baud, 300L, 100000000L);}
+    else if ((bench || send) && (strcmp(argv[i], "--fps") == 0) && (i + 1 < argc)) {fps = atol(argv[++i]); fps = constrain(fps, 1L, 1000L);}
+    else if ((bench || send) && (strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {nFrames = max(atol(argv[++i]), 1L);}
+    else if (bench && (strcmp(argv[i], "--corrupt") == 0) && (i + 1 < argc)) {corruptEvery = max(atol(argv[++i]), 1L);}
+    else if (send && (strcmp(argv[i], "--fast") == 0)) {fast = true;}
+    else if (send && (strcmp(argv[i], "--pty") == 0)) {pty = true;}
+    else if (!bench && (strcmp(argv[i], "--connect") == 0) && (i + 1 < argc)) {connectTo = argv[++i];}
+    else if (!bench && (strcmp(argv[i], "--listen") == 0) && (i + 1 < argc)) {listenPort = atoi(argv[++i]);}
+    else if (!bench && ((argv[i][0] != '-') || (strcmp(argv[i], "-") == 0)) && (path == NULL)) {path = argv[i];}
+    else {return StreamUsage(argv[0]);}
+  }
+
+  if (bench) {return StreamBenchAll(layout, layoutGiven, baud, fps, nFrames, corruptEvery);}
+  if (((connectTo != NULL) + (listenPort > 0) + pty + (path != NULL)) != 1) {return StreamUsage(argv[0]);}
+
+  fd = StreamOpen(connectTo, listenPort, pty, path, send);
+  if (fd < 0) {return 1;}
+  result = send ? StreamSend(layout, baud, fps, nFrames, fast, fd) : StreamRecv(show, fd);
+  if (fd > 1) {close(fd);}
+  return result;
+}
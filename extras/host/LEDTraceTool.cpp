@@ -0,0 +1,286 @@
+//Records spectrum traces (see LEDSpectrumTrace.h) and replays them through the LEDSegs renderer,
+//checking every frame's pixels against a golden file.
+//
+//record runs a strip live, on the simulated shield (--seed picks its audio) or on a WAV file through
+//LEDPCMAnalyzer, and writes what its spectrum read as a trace. With --golden it also writes the hash
+//of every frame's pixels, as the live run drew them.
+//
+//check replays the trace on a fresh strip with the recorded random seed, and compares each frame
+//with the golden file: a change to the renderer that alters any pixel of any frame is reported with
+//the first frame it shows in. The replay is timed (the fastest of --repeat passes), so two builds can
+//be compared on exactly the same input. --update writes the golden file from the replay instead.
+//
+//The strip is one of the segment programs in examples/ChristmasExample.ino (--program, 1..9), or a
+//synthetic layout of any length (--synthetic); a golden file remembers which.
+//
+//  lightorgan_trace record [--frames <n>] [--seed <n> | --wav <file> [--fps <n>]]
+//                          [--program <n> | --synthetic <LEDs>] [--golden <file>] <trace.lstr>
+//  lightorgan_trace check [--repeat <n>] [--golden <file> [--update]]
+//                         [--program <n> | --synthetic <LEDs>] <trace.lstr>
+
+#include <LEDSegs.h>
+#include <LEDPCMAnalyzer.h>
+#include <LEDSpectrumTrace.h>
+#include "HostSim.h"
+#include "HostWav.h"
+#include "BenchExample.h"
+#include "BenchSynthetic.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef std::chrono::steady_clock TraceClock;
+
+const uint16_t cTraceLEDType = NEO_GRB + NEO_KHZ800;
+const long cTraceDefaultFrames = 900;   //30 seconds at 30 fps
+
+struct TraceLayout {
+  bool synthetic;
+  short n;          //Program (0-origin), or the synthetic strip's LEDs
+};
+
+//A Print onto a stdio file, for LEDTraceRecorder
+class TraceFilePrint : public Print {
+  public:
+    TraceFilePrint(FILE *File) : file(File) {}
+    size_t write(uint8_t value) {return (fputc(value, file) == EOF) ? 0 : 1;}
+  private:
+    FILE *file;
+};
+
+static LEDSegs *TraceCreate(const TraceLayout &layout) {
+  LEDSegs *strip = new LEDSegs(layout.synthetic ? layout.n : BenchExampleNumLEDs(), 6, cTraceLEDType);
+
+  if (layout.synthetic) {BenchDefineSynthetic(strip, layout.n);}
+  else {BenchExampleDefine(layout.n, strip);}
+  return strip;
+}
+
+static uint32_t TraceHash(LEDSegs *strip) {
+  const uint8_t *pixels = strip->GetPixelStrip()->getPixels();
+  uint32_t hash = 2166136261UL;
+  long i, nBytes = ((long) strip->GetNumLEDs()) * 3;
+
+  for (i = 0; i < nBytes; i++) {hash = (hash ^ pixels[i]) * 16777619UL;}
+  return hash;
+}
+
+static uint32_t TraceCombine(const std::vector<uint32_t> &hashes) {
+  uint32_t hash = 2166136261UL;
+  size_t i;
+
+  for (i = 0; i < hashes.size(); i++) {hash = (hash ^ hashes[i]) * 16777619UL;}
+  return hash;
+}
+
+/*___________
+Golden files
+A header line naming the layout, then each frame's pixel hash on a line of its own
+*/
+
+static bool TraceWriteGolden(const char *path, const TraceLayout &layout, const std::vector<uint32_t> &hashes) {
+  FILE *file = fopen(path, "w");
+  size_t i;
+
+  if (file == NULL) {perror(path); return false;}
+  fprintf(file, "lightorgan_trace golden %s %d %lu\n", layout.synthetic ? "synthetic" : "program",
+    layout.synthetic ? layout.n : layout.n + 1, (unsigned long) hashes.size());
+  for (i = 0; i < hashes.size(); i++) {fprintf(file, "%08lx\n", (unsigned long) hashes[i]);}
+  if (fclose(file) != 0) {perror(path); return false;}
+  return true;
+}
+
+static bool TraceReadGolden(const char *path, TraceLayout *layout, std::vector<uint32_t> *hashes) {
+  FILE *file = fopen(path, "r");
+  char kind[16];
+  int n;
+  unsigned long nFrames, hash;
+
+  if (file == NULL) {perror(path); return false;}
+  if (fscanf(file, "lightorgan_trace golden %15s %d %lu", kind, &n, &nFrames) != 3) {
+    fprintf(stderr, "%s: not a golden file\n", path);
+    fclose(file);
+    return false;
+  }
+  layout->synthetic = (strcmp(kind, "synthetic") == 0);
+  layout->n = layout->synthetic ? n : n - 1;
+  hashes->clear();
+  while ((hashes->size() < nFrames) && (fscanf(file, "%lx", &hash) == 1)) {hashes->push_back(hash);}
+  fclose(file);
+  if (hashes->size() != nFrames) {fprintf(stderr, "%s: truncated\n", path); return false;}
+  return true;
+}
+
+/*_________
+TraceRecord
+*/
+
+static int TraceRecord(const char *tracePath, const TraceLayout &layout, long nFrames, unsigned long seed,
+  const char *wavPath, long fps, const char *goldenPath) {
+  std::vector<int16_t> samples;
+  std::vector<uint32_t> hashes;
+  long sampleRate = 0, iFrame, fromFrame, toFrame;
+  short nChannels = 0;
+  LEDPCMAnalyzer *pcm = NULL;
+  LEDTraceRecorder recorder;
+  LEDSegs *strip;
+  FILE *file;
+
+  if ((wavPath != NULL) && !HostWavRead(wavPath, &samples, &sampleRate, &nChannels)) {return 2;}
+  file = fopen(tracePath, "wb");
+  if (file == NULL) {perror(tracePath); return 1;}
+  TraceFilePrint out(file);
+
+  HostSimReset(seed);
+  strip = TraceCreate(layout);
+  if (wavPath != NULL) {
+    pcm = new LEDPCMAnalyzer(sampleRate, nChannels);
+    strip->SetSpectrumSource(pcm);
+    nFrames = min(nFrames, (long) (((long long) (samples.size() / nChannels)) * fps / sampleRate));
+  }
+  recorder.Begin(out, strip->GetSpectrum(), strip->GetRandomSeed());
+
+  for (iFrame = 0; iFrame < nFrames; iFrame++) {
+    if (pcm != NULL) {
+      fromFrame = ((long long) iFrame) * sampleRate / fps;
+      toFrame = ((long long) (iFrame + 1)) * sampleRate / fps;
+      pcm->PushSamples(&samples[fromFrame * nChannels], toFrame - fromFrame);
+    }
+    strip->DisplaySpectrum(true, true);
+    hashes.push_back(TraceHash(strip));
+  }
+  recorder.End();
+  delete strip;
+  delete pcm;
+  if (fclose(file) != 0) {perror(tracePath); return 1;}
+
+  printf("%s: %lu frames, %lu bytes (%.1f per frame), checksum %08lx\n", tracePath, recorder.GetNumFrames(),
+    recorder.GetNumBytes(), (double) recorder.GetNumBytes() / max(recorder.GetNumFrames(), 1UL), (unsigned long) TraceCombine(hashes));
+  if ((goldenPath != NULL) && !TraceWriteGolden(goldenPath, layout, hashes)) {return 1;}
+  return 0;
+}
+
+/*________
+TraceCheck
+*/
+
+static int TraceCheck(const char *tracePath, TraceLayout layout, bool layoutGiven, short nRepeats,
+  const char *goldenPath, bool update) {
+  std::vector<byte> trace;
+  std::vector<uint32_t> hashes, golden;
+  LEDTracePlayer player;
+  LEDSegs *strip;
+  TraceLayout goldenLayout;
+  TraceClock::time_point t0;
+  double seconds, bestSeconds = 0;
+  unsigned long iFrame, nDiffer = 0, firstDiffer = 0;
+  short iRepeat;
+  FILE *file;
+  int c;
+
+  file = fopen(tracePath, "rb");
+  if (file == NULL) {perror(tracePath); return 1;}
+  while ((c = fgetc(file)) != EOF) {trace.push_back(c);}
+  fclose(file);
+
+  if ((goldenPath != NULL) && !update) {
+    if (!TraceReadGolden(goldenPath, &goldenLayout, &golden)) {return 1;}
+    if (!layoutGiven) {layout = goldenLayout;}
+  }
+
+  for (iRepeat = 0; iRepeat < nRepeats; iRepeat++) {
+    HostSimReset(1);
+    strip = TraceCreate(layout);
+    if (!player.Open(trace.data(), trace.size())) {
+      fprintf(stderr, "%s: not a spectrum trace\n", tracePath);
+      delete strip;
+      return 1;
+    }
+    strip->SetSpectrumSource(&player);
+    strip->ResetRandom(player.GetRandomSeed());
+
+    seconds = 0;
+    hashes.clear();
+    while (!player.AtEnd()) {
+      t0 = TraceClock::now();
+      strip->DisplaySpectrum(true, true);
+      seconds += std::chrono::duration<double>(TraceClock::now() - t0).count();
+      hashes.push_back(TraceHash(strip));
+    }
+    if ((iRepeat == 0) || (seconds < bestSeconds)) {bestSeconds = seconds;}
+    delete strip;
+  }
+
+  printf("%s: %lu frames of %d LEDs (%s %d), %.0f ns/frame, checksum %08lx\n", tracePath, (unsigned long) hashes.size(),
+    layout.synthetic ? layout.n : BenchExampleNumLEDs(), layout.synthetic ? "synthetic" : "program", layout.synthetic ? layout.n : layout.n + 1,
+    1e9 * bestSeconds / max(hashes.size(), (size_t) 1), (unsigned long) TraceCombine(hashes));
+
+  if (goldenPath == NULL) {return 0;}
+  if (update) {return TraceWriteGolden(goldenPath, layout, hashes) ? 0 : 1;}
+
+  for (iFrame = 0; iFrame < max(hashes.size(), golden.size()); iFrame++) {
+    if ((iFrame >= hashes.size()) || (iFrame >= golden.size()) || (hashes[iFrame] != golden[iFrame])) {
+      if (nDiffer == 0) {firstDiffer = iFrame;}
+      nDiffer++;
+    }
+  }
+  if (nDiffer == 0) {
+    printf("%s: all %lu frames match\n", goldenPath, (unsigned long) golden.size());
+    return 0;
+  }
+  fprintf(stderr, "%s: %lu of %lu frames differ, the first at frame %lu\n", goldenPath, nDiffer, (unsigned long) golden.size(), firstDiffer);
+  return 1;
+}
+
+static int TraceUsage(const char *program) {
+  fprintf(stderr, "usage: %s record [--frames <n>] [--seed <n> | --wav <file> [--fps <n>]]\n"
+                  "                        [--program <n> | --synthetic <LEDs>] [--golden <file>] <trace.lstr>\n"
+                  "       %s check [--repeat <n>] [--golden <file> [--update]]\n"
+                  "                       [--program <n> | --synthetic <LEDs>] <trace.lstr>\n", program, program);
+  return 2;
+}
+
+int main(int argc, char **argv) {
+  TraceLayout layout = {false, 0};
+  bool layoutGiven = false, update = false, record;
+  const char *tracePath = NULL, *goldenPath = NULL, *wavPath = NULL;
+  long nFrames = cTraceDefaultFrames, fps = 30;
+  unsigned long seed = 1;
+  short nRepeats = 1, i;
+
+  if (argc < 2) {return TraceUsage(argv[0]);}
+  if (strcmp(argv[1], "record") == 0) {record = true;}
+  else if (strcmp(argv[1], "check") == 0) {record = false;}
+  else {return TraceUsage(argv[0]);}
+
+  for (i = 2; i < argc; i++) {
+    if ((strcmp(argv[i], "--program") == 0) && (i + 1 < argc)) {
+      layout.synthetic = false;
+      layout.n = atoi(argv[++i]) - 1;
+      layout.n = constrain(layout.n, 0, BenchExampleNumPrograms() - 1);
+      layoutGiven = true;
+    }
+    else if ((strcmp(argv[i], "--synthetic") == 0) && (i + 1 < argc)) {
+      layout.synthetic = true;
+      layout.n = atoi(argv[++i]);
+      layout.n = constrain(layout.n, 1, 20000);
+      layoutGiven = true;
+    }
+    else if ((strcmp(argv[i], "--golden") == 0) && (i + 1 < argc)) {goldenPath = argv[++i];}
+    else if (record && (strcmp(argv[i], "--frames") == 0) && (i + 1 < argc)) {nFrames = max(atol(argv[++i]), 1L);}
+    else if (record && (strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {seed = strtoul(argv[++i], NULL, 0);}
+    else if (record && (strcmp(argv[i], "--wav") == 0) && (i + 1 < argc)) {wavPath = argv[++i];}
+    else if (record && (strcmp(argv[i], "--fps") == 0) && (i + 1 < argc)) {fps = atol(argv[++i]); fps = constrain(fps, 1L, 1000L);}
+    else if (!record && (strcmp(argv[i], "--repeat") == 0) && (i + 1 < argc)) {nRepeats = atoi(argv[++i]); nRepeats = constrain(nRepeats, 1, 1000);}
+    else if (!record && (strcmp(argv[i], "--update") == 0)) {update = true;}
+    else if ((argv[i][0] != '-') && (tracePath == NULL)) {tracePath = argv[i];}
+    else {return TraceUsage(argv[0]);}
+  }
+  if ((tracePath == NULL) || (update && (goldenPath == NULL))) {return TraceUsage(argv[0]);}
+
+  if (record) {return TraceRecord(tracePath, layout, nFrames, seed, wavPath, fps, goldenPath);}
+  return TraceCheck(tracePath, layout, layoutGiven, nRepeats, goldenPath, update);
+}
@@ -0,0 +1,54 @@
+#ifndef _HOST_ADAFRUIT_NEOPIXEL_H
+#define _HOST_ADAFRUIT_NEOPIXEL_H
+
+//Host stand-in for Adafruit_NeoPixel. The pixel buffer, color ordering and brightness scaling
+//behave like the real library; show() only accounts for the time the data would take on the wire
+//(see HostSim.h) instead of bit-banging a pin.
+
+#include "Arduino.h"
+
+#define NEO_RGB  ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_RBG  ((0 << 6) | (0 << 4) | (2 << 2) | (1))
+#define NEO_GRB  ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_GBR  ((2 << 6) | (2 << 4) | (0 << 2) | (1))
+#define NEO_BRG  ((1 << 6) | (1 << 4) | (2 << 2) | (0))
+#define NEO_BGR  ((2 << 6) | (2 << 4) | (1 << 2) | (0))
+
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+typedef uint16_t neoPixelType;
+
+class Adafruit_NeoPixel {
+  public:
+    Adafruit_NeoPixel(uint16_t n, uint8_t p = 6, neoPixelType t = NEO_GRB + NEO_KHZ800);
+    ~Adafruit_NeoPixel();
+
+    void begin(void) {}
+    void show(void);
+    void setPin(uint8_t p) {pin = p;}
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void setPixelColor(uint16_t n, uint32_t c);
+    void setBrightness(uint8_t);
+    void clear();
+    void updateLength(uint16_t n);
+
+    uint8_t *getPixels(void) const {return pixels;}
+    uint8_t getBrightness(void) const {return brightness - 1;}
+    uint16_t numPixels(void) const {return numLEDs;}
+    uint32_t getPixelColor(uint16_t n) const;
+
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+      return ((uint32_t)r << 16) | ((uint32_t)g <<  8) | b;
+    }
+
+  private:
+    uint16_t numLEDs;
+    uint16_t numBytes;
+    uint8_t  pin;
+    uint8_t  brightness;
+    uint8_t *pixels;
+    uint8_t  rOffset, gOffset, bOffset;
+};
+
+#endif
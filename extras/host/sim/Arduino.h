@@ -0,0 +1,63 @@
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+//Host (Linux) stand-in for the parts of the Arduino core that LEDSegs uses. Only meant for
+//building and profiling the library off-board -- see extras/host/HostSim.h for the knobs.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+//Arduino defines these as macros, which does not mix with the C++ standard headers the host
+//tools use. Templates give the same results for the way the library calls them.
+template <class A, class B> inline A min(A a, B b) {return (b < a) ? (A) b : a;}
+template <class A, class B> inline A max(A a, B b) {return (a < b) ? (A) b : a;}
+
+//No separate program memory on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+//Stand-in for the AVR's interrupt-driven ADC, which LEDSegs' asynchronous spectrum mode uses.
+//A conversion started by hostAdcStart() completes cHostAdcMicros of virtual time later, when the
+//attached interrupt routine is called (see extras/host/HostSim.h).
+#define HOST_SIM_ADC 1
+void hostAdcStart(uint8_t pin);
+void hostAdcStop();
+int hostAdcResult();
+void hostAdcAttachInterrupt(void (*isr)());
+
+//Cycle counter for LEDSegs' profiler (LEDProfile.h): nanoseconds of host time, not the virtual clock
+#define HOST_SIM_CYCLES 1
+uint32_t hostCycles();
+
+#include "Print.h"
+
+#endif
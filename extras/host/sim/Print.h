@@ -0,0 +1,47 @@
+#ifndef _HOST_PRINT_H
+#define _HOST_PRINT_H
+
+//Host stand-in for the Arduino Print/Serial classes. Serial writes to stdout.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char[]);
+    size_t print(char);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+
+    size_t println();
+    size_t println(const char[]);
+    size_t println(char);
+    size_t println(int, int = DEC);
+    size_t println(unsigned int, int = DEC);
+    size_t println(long, int = DEC);
+    size_t println(unsigned long, int = DEC);
+};
+
+class HostSerial : public Print {
+  public:
+    void begin(unsigned long) {}
+    int available() {return 0;}
+    int read() {return -1;}
+    void flush();
+    size_t write(uint8_t);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif